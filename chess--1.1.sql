@@ -0,0 +1,992 @@
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION chess" to load this file. \quit
+
+/******************************************************************************
+ * Input/Output chessboard
+ ******************************************************************************/
+
+
+
+CREATE OR REPLACE FUNCTION chessboard_in(cstring)
+  RETURNS chessboard
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION chessboard_out(chessboard)
+  RETURNS cstring
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- chessboard is the preferred type of its category so that an untyped
+-- literal on the right of @> still means a board rather than a pattern
+CREATE TYPE chessboard (
+  internallength = 69,
+  input          = chessboard_in,
+  output         = chessboard_out,
+  category       = 'H',
+  preferred      = true
+);
+
+CREATE OR REPLACE FUNCTION chessboard(text)
+  RETURNS chessboard
+  AS 'MODULE_PATHNAME', 'chessboard_cast_from_text'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (text as chessboard) WITH FUNCTION chessboard(text) AS IMPLICIT;
+
+/******************************************************************************
+ * Input/Output chessgame
+ ******************************************************************************/
+
+
+
+-- STABLE: what input stores depends on settings such as chess.store_tags
+CREATE OR REPLACE FUNCTION chessgame_in(cstring)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'chessgame_in_1_1'
+  LANGUAGE C STABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION chessgame_out(chessgame)
+  RETURNS cstring
+  AS 'MODULE_PATHNAME', 'chessgame_out_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE chessgame (
+  internallength = VARIABLE,
+  input          = chessgame_in,
+  output         = chessgame_out,
+  storage        = extended
+);
+
+CREATE OR REPLACE FUNCTION chessgame(text)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'chessgame_cast_from_text_1_1'
+  LANGUAGE C STABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (text as chessgame) WITH FUNCTION chessgame(text) AS IMPLICIT;
+
+-- storage formats, e.g. UPDATE archive SET game = chessgame_pack(game)
+
+CREATE FUNCTION chessgame_pack(chessgame)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'chessgame_pack'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- reads chess_prefixes, see below
+CREATE FUNCTION chessgame_compress(chessgame)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'chessgame_compress'
+  LANGUAGE C STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_unpack(chessgame)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'chessgame_unpack'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/*
+chessgame || text: The game followed by a move in SAN or coordinates, e.g.
+UPDATE live SET game = game || 'Nf3' WHERE id = 42
+*/
+CREATE FUNCTION game_append_move(chessgame, text)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'game_append_move'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR || (
+  PROCEDURE = game_append_move,
+  LEFTARG = chessgame, RIGHTARG = text
+);
+
+
+
+
+
+CREATE FUNCTION chessboard_hash(chessboard)
+  RETURNS integer
+  AS 'MODULE_PATHNAME', 'chessboard_hash'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_position_key(chessboard)
+  RETURNS bigint
+  AS 'MODULE_PATHNAME', 'chessboard_position_key'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_eq(chessboard, chessboard)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessboard_eq'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR = (
+  LEFTARG = chessboard, RIGHTARG = chessboard,
+  PROCEDURE = chessboard_eq,
+  COMMUTATOR = =,
+  MERGES
+);
+
+/******************************************************************************
+ * Constructors
+ ******************************************************************************/
+
+CREATE FUNCTION chessboard(double precision)
+  RETURNS chessboard
+  AS 'MODULE_PATHNAME', 'chessboard_constructor'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+CREATE FUNCTION chessgame(double precision)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'chessgame_constructor_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+/******************************************************************************
+ * Functions
+ ******************************************************************************/
+
+/*
+getBoard(chessgame, integer) -> chessboard: Return the board state
+at a given half-move (A full move is counted only when both players
+have played). The integer parameter indicates the count of half
+moves since the beginning of the game. A 0 value of this parameter
+means the initial board state, i.e.,(
+rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1).
+*/
+
+CREATE FUNCTION getBoard(chessgame, integer)
+  RETURNS chessboard
+  AS 'MODULE_PATHNAME', 'getBoard_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+/**
+  getFirstMoves(chessgame, integer) -> chessgame: Returns the
+  chessgame truncated to its first N half-moves. This function may also
+  be called getOpening(...). Again the integer parameter is zero based.
+*/
+CREATE FUNCTION getFirstMoves(chessgame, integer)
+  RETURNS chessgame
+  AS 'MODULE_PATHNAME', 'getFirstMoves_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+/*
+game_result(chessgame) -> text: Returns the result of the game as
+given by the PGN termination marker: 1-0, 0-1, 1/2-1/2 or * when the
+result is unknown.
+*/
+CREATE FUNCTION game_result(chessgame)
+  RETURNS text
+  AS 'MODULE_PATHNAME', 'game_result'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/*
+pgn_tags(text) -> jsonb: Returns the tag pairs of a PGN header as a
+jsonb object. With chess.store_tags = on, chessgame input keeps the tags
+in a compact dictionary read by game_tags(chessgame) and
+game_tag(chessgame, text), so filters on e.g. WhiteElo or ECO don't need
+to parse the PGN text again.
+*/
+CREATE FUNCTION pgn_tags(text)
+  RETURNS jsonb
+  AS 'MODULE_PATHNAME', 'pgn_tags'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION game_tags(chessgame)
+  RETURNS jsonb
+  AS 'MODULE_PATHNAME', 'game_tags'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION game_tag(chessgame, text)
+  RETURNS text
+  AS 'MODULE_PATHNAME', 'game_tag'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_has_result(chessgame, text)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessgame_has_result'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @@ (
+  PROCEDURE = chessgame_has_result,
+  LEFTARG = chessgame, RIGHTARG = text
+);
+
+CREATE FUNCTION chessgame_compare(chessboard, chessboard)
+    RETURNS int
+    AS 'MODULE_PATHNAME', 'chessgame_compare'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_gin_extract_value(chessgame, internal, internal)
+    RETURNS internal
+    AS 'MODULE_PATHNAME', 'chessgame_gin_extract_value_1_1'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_gin_extract_query(internal, internal, int2, internal, internal, internal, internal)
+    RETURNS internal
+    AS 'MODULE_PATHNAME', 'chessgame_gin_extract_query_1_1'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_gin_triconsistent(internal, int2, internal, int4, internal, internal, internal)
+    RETURNS char
+    AS 'MODULE_PATHNAME', 'chessgame_gin_triconsistent_1_1'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_move_gin_extract_value(chessgame, internal, internal)
+    RETURNS internal
+    AS 'MODULE_PATHNAME', 'chessgame_move_gin_extract_value'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_gin_compare_partial(int8, int8, int2, internal)
+    RETURNS int4
+    AS 'MODULE_PATHNAME', 'chessgame_gin_compare_partial'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgameContainsChessgame(chessgame, chessgame)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'chessgameContainsChessgame_1_1'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_contains_chessboard(chessgame, chessboard)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'chessgame_contains_chessboard_1_1'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+
+CREATE OPERATOR @> (
+  PROCEDURE = chessgame_contains_chessboard,
+  LEFTARG = chessgame, RIGHTARG = chessboard
+);
+
+/*
+chessgame @~ chessboard: True if the game reaches the position of the
+board by any move order. Only the pieces, the player to move, castling
+rights and a possible en passant capture are compared, not the clocks.
+*/
+CREATE FUNCTION chessgame_reaches_chessboard(chessgame, chessboard)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'chessgame_reaches_chessboard'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @~ (
+  PROCEDURE = chessgame_reaches_chessboard,
+  LEFTARG = chessgame, RIGHTARG = chessboard
+);
+
+/*
+chessgame @# text: True if some position of the game has exactly the given
+material, e.g. g @# 'KRPvKR' for rook-and-pawn against rook endgames.
+*/
+CREATE FUNCTION reaches_material(chessgame, text)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'reaches_material'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @# (
+  PROCEDURE = reaches_material,
+  LEFTARG = chessgame, RIGHTARG = text
+);
+
+/*
+chessgame @! text: True if a move of the game matches a SAN pattern, where
+'?' is any file, rank or promotion piece and '*' any piece, e.g.
+g @! 'Bxh7+', g @! 'Q??' (any queen move) or g @! '*xf7#'.
+*/
+CREATE FUNCTION game_has_move(chessgame, text)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'game_has_move'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @! (
+  PROCEDURE = game_has_move,
+  LEFTARG = chessgame, RIGHTARG = text
+);
+
+/*
+chessgame ~> chessgame: True if the moves of the second game are played in
+a row at any point of the first one. chessgame ~>> text takes the moves in
+coordinates, as they do not have to start from the initial position, e.g.
+g ~>> 'd3h7 g8h7 f3g5' for the Greek gift sacrifice.
+*/
+CREATE FUNCTION chessgame_contains_sequence(chessgame, chessgame)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'chessgame_contains_sequence'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR ~> (
+  PROCEDURE = chessgame_contains_sequence,
+  LEFTARG = chessgame, RIGHTARG = chessgame
+);
+
+CREATE FUNCTION chessgame_contains_moves(chessgame, text)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'chessgame_contains_moves'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR ~>> (
+  PROCEDURE = chessgame_contains_moves,
+  LEFTARG = chessgame, RIGHTARG = text
+);
+
+CREATE FUNCTION chessgame_contains_chessboard_within(chessgame, chessboard, integer)
+    RETURNS boolean
+    AS 'MODULE_PATHNAME', 'chessgame_contains_chessboard_within'
+    LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+-- inlined, so that @> can use an index
+CREATE FUNCTION hasBoard(cg chessgame, cb chessboard, i integer)
+  RETURNS boolean
+  AS 
+$$
+    SELECT cg @> cb and chessgame_contains_chessboard_within(cg, cb, i);
+$$
+ LANGUAGE SQL;
+
+  -- Create the operator class
+  -- Keys are int8: position hashes, the game result and material
+  -- signatures, see chess.h
+CREATE OPERATOR CLASS chessboard_gin_ops
+    DEFAULT FOR TYPE ChessGame USING gin AS
+    OPERATOR   7 @> (chessgame, chessboard),
+    OPERATOR   8 @@ (chessgame, text),
+    OPERATOR   9 @~ (chessgame, chessboard),
+    OPERATOR  10 @# (chessgame, text),
+    FUNCTION   1    btint8cmp(int8, int8),
+    FUNCTION   2    chessgame_gin_extract_value(chessgame, internal, internal),
+    FUNCTION   3    chessgame_gin_extract_query(internal, internal, int2, internal, internal, internal, internal),
+    FUNCTION   6    chessgame_gin_triconsistent(internal, int2, internal, int4, internal, internal, internal),
+    STORAGE         int8;
+
+/*
+The move tokens (@!) and move trigrams (~>, ~>>) of the games, in an index
+of their own, e.g.
+CREATE INDEX ON games USING gin (game chessgame_move_gin_ops);
+*/
+CREATE OPERATOR CLASS chessgame_move_gin_ops
+    FOR TYPE chessgame USING gin AS
+    OPERATOR  11 @! (chessgame, text),
+    OPERATOR  12 ~> (chessgame, chessgame),
+    OPERATOR  13 ~>> (chessgame, text),
+    FUNCTION   1    btint8cmp(int8, int8),
+    FUNCTION   2    chessgame_move_gin_extract_value(chessgame, internal, internal),
+    FUNCTION   3    chessgame_gin_extract_query(internal, internal, int2, internal, internal, internal, internal),
+    FUNCTION   5    chessgame_gin_compare_partial(int8, int8, int2, internal),
+    FUNCTION   6    chessgame_gin_triconsistent(internal, int2, internal, int4, internal, internal, internal),
+    STORAGE         int8;
+
+
+/*****************************************************************************/
+CREATE FUNCTION hasOpening(game1 chessgame, game2 chessgame)
+  RETURNS boolean
+  AS $$
+    -- select hasOpening_cmp(game1, game2) = 0; 
+    select game1 >= game2 AND chessgameContainsChessgame(game1, game2);
+  $$
+  LANGUAGE SQL;
+
+/******************************************************************************/
+
+/* B-Tree comparison functions */
+
+CREATE OR REPLACE FUNCTION hasOpening_eq(chessgame, chessgame)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'hasOpening_eq_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hasOpening_lt(chessgame, chessgame)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'hasOpening_lt_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hasOpening_le(chessgame, chessgame)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'hasOpening_le_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hasOpening_gt(chessgame, chessgame)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'hasOpening_gt_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hasOpening_ge(chessgame, chessgame)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'hasOpening_ge_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+
+/******************************************************************************/
+
+/*
+B-Tree comparison operators: games are ordered by length, then by moves and
+result (1.0 ordered them by length only), so that = compares whole games.
+*/
+
+CREATE OPERATOR = (
+  LEFTARG = chessgame, RIGHTARG = chessgame,
+  PROCEDURE = hasOpening_eq,
+  COMMUTATOR = =,
+  MERGES, HASHES
+);
+CREATE OPERATOR < (
+  LEFTARG = chessgame, RIGHTARG = chessgame,
+  PROCEDURE = hasOpening_lt,
+  COMMUTATOR = >, NEGATOR = >=
+);
+CREATE OPERATOR <= (
+  LEFTARG = chessgame, RIGHTARG = chessgame,
+  PROCEDURE = hasOpening_le,
+  COMMUTATOR = >=, NEGATOR = >
+);
+CREATE OPERATOR >= (
+  LEFTARG = chessgame, RIGHTARG = chessgame,
+  PROCEDURE = hasOpening_ge,
+  COMMUTATOR = <=, NEGATOR = <
+);
+CREATE OPERATOR > (
+  LEFTARG = chessgame, RIGHTARG = chessgame,
+  PROCEDURE = hasOpening_gt,
+  COMMUTATOR = <, NEGATOR = <=
+);
+
+/******************************************************************************/
+
+/* B-Tree support functions */
+
+CREATE OR REPLACE FUNCTION hasOpening_cmp(chessgame, chessgame)
+  RETURNS integer
+  AS 'MODULE_PATHNAME', 'hasOpening_cmp_1_1'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OR REPLACE FUNCTION hasOpening_sortsupport(internal)
+  RETURNS void
+  AS 'MODULE_PATHNAME', 'hasOpening_sortsupport'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+/******************************************************************************/
+
+/* B-Tree operator class */
+
+CREATE OPERATOR CLASS chessgame_hasopening_ops
+DEFAULT FOR TYPE chessgame USING btree
+AS
+        OPERATOR        1       <  ,
+        OPERATOR        2       <= ,
+        OPERATOR        3       =  ,
+        OPERATOR        4       >= ,
+        OPERATOR        5       >  ,
+        FUNCTION        1       hasOpening_cmp(chessgame, chessgame),
+        FUNCTION        2       hasOpening_sortsupport(internal);
+
+/******************************************************************************/
+
+/******************************************************************************
+ * Stored positions
+ ******************************************************************************/
+
+/*
+Opt-in materialization of the positions of a chessgame column into the
+chess_positions side table, so that position lookups use a plain index on
+the hash instead of replaying every game:
+
+  SELECT chess_materialize_positions('games', 'moves');
+
+  SELECT g.* FROM chess_positions p JOIN games g ON g.ctid = p.game_tid
+  WHERE p.game_rel = 'games'::regclass
+    AND p.board_hash = chessboard_hash($1) AND p.board = $1;
+
+Triggers keep the table in sync with INSERT, UPDATE, DELETE and TRUNCATE.
+Its rows are dumped with the extension, but row locations change with
+VACUUM FULL, CLUSTER or a dump and restore, run chess_refresh_positions()
+afterwards.
+*/
+
+CREATE FUNCTION chessgame_positions(chessgame, OUT ply integer, OUT board_hash integer, OUT board chessboard)
+  RETURNS SETOF record
+  AS 'MODULE_PATHNAME', 'chessgame_positions'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TABLE chess_positions (
+  game_rel   regclass NOT NULL,
+  game_tid   tid NOT NULL,
+  ply        integer NOT NULL,
+  board_hash integer NOT NULL,
+  board      chessboard NOT NULL
+);
+
+CREATE INDEX chess_positions_hash_idx ON chess_positions USING hash (board_hash);
+CREATE INDEX chess_positions_game_idx ON chess_positions (game_rel, game_tid);
+
+SELECT pg_catalog.pg_extension_config_dump('chess_positions', '');
+
+CREATE FUNCTION chess_positions_sync()
+  RETURNS trigger
+  AS $$
+DECLARE
+  game chessgame;
+BEGIN
+  IF TG_OP IN ('UPDATE', 'DELETE') THEN
+    DELETE FROM chess_positions
+    WHERE game_rel = TG_RELID AND game_tid = OLD.ctid;
+  END IF;
+  IF TG_OP IN ('INSERT', 'UPDATE') THEN
+    EXECUTE format('SELECT ($1).%I', TG_ARGV[0]) INTO game USING NEW;
+    INSERT INTO chess_positions
+    SELECT TG_RELID, NEW.ctid, p.ply, p.board_hash, p.board
+    FROM chessgame_positions(game) p;
+  END IF;
+  RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION chess_positions_truncate()
+  RETURNS trigger
+  AS $$
+BEGIN
+  DELETE FROM chess_positions WHERE game_rel = TG_RELID;
+  RETURN NULL;
+END;
+$$ LANGUAGE plpgsql;
+
+-- (re)builds the stored positions of a table with a single replay per game
+CREATE FUNCTION chess_refresh_positions(tbl regclass, col name)
+  RETURNS bigint
+  AS $$
+DECLARE
+  n bigint;
+BEGIN
+  DELETE FROM chess_positions WHERE game_rel = tbl;
+  EXECUTE format(
+    'INSERT INTO chess_positions
+     SELECT $1, t.ctid, p.ply, p.board_hash, p.board
+     FROM %s t, chessgame_positions(t.%I) p', tbl, col)
+  USING tbl;
+  GET DIAGNOSTICS n = ROW_COUNT;
+  RETURN n;
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION chess_materialize_positions(tbl regclass, col name)
+  RETURNS bigint
+  AS $$
+BEGIN
+  EXECUTE format(
+    'CREATE TRIGGER chess_positions_sync
+     AFTER INSERT OR UPDATE OR DELETE ON %s
+     FOR EACH ROW EXECUTE FUNCTION chess_positions_sync(%L)', tbl, col);
+  EXECUTE format(
+    'CREATE TRIGGER chess_positions_truncate
+     AFTER TRUNCATE ON %s
+     FOR EACH STATEMENT EXECUTE FUNCTION chess_positions_truncate()', tbl);
+  RETURN chess_refresh_positions(tbl, col);
+END;
+$$ LANGUAGE plpgsql;
+
+CREATE FUNCTION chess_dematerialize_positions(tbl regclass)
+  RETURNS void
+  AS $$
+BEGIN
+  EXECUTE format('DROP TRIGGER IF EXISTS chess_positions_sync ON %s', tbl);
+  EXECUTE format('DROP TRIGGER IF EXISTS chess_positions_truncate ON %s', tbl);
+  DELETE FROM chess_positions WHERE game_rel = tbl;
+END;
+$$ LANGUAGE plpgsql;
+
+/******************************************************************************
+ * Engine
+ ******************************************************************************/
+
+/*
+Alpha-beta search of the position to a depth of 1 to 8 plies, backed by a
+per-backend transposition table (chess.tt_size). chessboard_eval returns
+centipawns from white's point of view, chessboard_bestmove a move such as
+'e2e4'.
+*/
+
+CREATE FUNCTION chessboard_eval(chessboard, depth int)
+  RETURNS int
+  AS 'MODULE_PATHNAME', 'chessboard_eval'
+  LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_bestmove(chessboard, depth int)
+  RETURNS text
+  AS 'MODULE_PATHNAME', 'chessboard_bestmove'
+  LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+-- chessboard_eval of every position of a game, the initial one included
+CREATE FUNCTION game_eval_curve(chessgame, depth int)
+  RETURNS int[]
+  AS 'MODULE_PATHNAME', 'game_eval_curve'
+  LANGUAGE C VOLATILE STRICT PARALLEL SAFE;
+
+/******************************************************************************
+ * Patterns
+ ******************************************************************************/
+
+/*
+A chesspattern lists square constraints, e.g. 'Ne5 kg8 .f7': a piece or
+'.' (empty) followed by a square, unlisted squares can hold anything.
+chessboard @> chesspattern checks a board, chessgame @> chesspattern
+checks whether some position of the game matches.
+*/
+
+CREATE FUNCTION chesspattern_in(cstring)
+  RETURNS chesspattern
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chesspattern_out(chesspattern)
+  RETURNS cstring
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE chesspattern (
+  internallength = 64,
+  input          = chesspattern_in,
+  output         = chesspattern_out,
+  category       = 'H'
+);
+
+CREATE FUNCTION chesspattern(text)
+  RETURNS chesspattern
+  AS 'MODULE_PATHNAME', 'chesspattern_cast_from_text'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE CAST (text as chesspattern) WITH FUNCTION chesspattern(text);
+
+CREATE FUNCTION chessboard_matches_pattern(chessboard, chesspattern)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessboard_matches_pattern'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+  PROCEDURE = chessboard_matches_pattern,
+  LEFTARG = chessboard, RIGHTARG = chesspattern
+);
+
+CREATE FUNCTION chessgame_matches_pattern(chessgame, chesspattern)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessgame_matches_pattern'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR @> (
+  PROCEDURE = chessgame_matches_pattern,
+  LEFTARG = chessgame, RIGHTARG = chesspattern
+);
+
+/*
+GiST index keys: per-piece bitboards of the squares occupied in any
+position of a game (or any game of a subtree).
+*/
+
+CREATE FUNCTION chesssignature_in(cstring)
+  RETURNS chesssignature
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chesssignature_out(chesssignature)
+  RETURNS cstring
+  AS 'MODULE_PATHNAME'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE TYPE chesssignature (
+  internallength = 96,
+  input          = chesssignature_in,
+  output         = chesssignature_out,
+  alignment      = double
+);
+
+CREATE FUNCTION chessgame_gist_consistent(internal, chesspattern, int2, oid, internal)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessgame_gist_consistent'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_gist_compress(internal)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'chessgame_gist_compress'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chess_gist_union(internal, internal)
+  RETURNS chesssignature
+  AS 'MODULE_PATHNAME', 'chess_gist_union'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chess_gist_penalty(internal, internal, internal)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'chess_gist_penalty'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chess_gist_picksplit(internal, internal)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'chess_gist_picksplit'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chess_gist_same(chesssignature, chesssignature, internal)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'chess_gist_same'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS chessgame_pattern_gist_ops
+    DEFAULT FOR TYPE chessgame USING gist AS
+    OPERATOR   7 @> (chessgame, chesspattern),
+    FUNCTION   1    chessgame_gist_consistent(internal, chesspattern, int2, oid, internal),
+    FUNCTION   2    chess_gist_union(internal, internal),
+    FUNCTION   3    chessgame_gist_compress(internal),
+    FUNCTION   5    chess_gist_penalty(internal, internal, internal),
+    FUNCTION   6    chess_gist_picksplit(internal, internal),
+    FUNCTION   7    chess_gist_same(chesssignature, chesssignature, internal),
+    STORAGE         chesssignature;
+
+/*
+chessboard <-> chessboard: The number of (piece, square) occurrences of
+either board missing from the other, e.g. for the positions closest to
+a given one: ORDER BY board <-> $1 LIMIT 20, with the GiST index below.
+*/
+CREATE FUNCTION chessboard_distance(chessboard, chessboard)
+  RETURNS integer
+  AS 'MODULE_PATHNAME', 'chessboard_distance'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR <-> (
+  PROCEDURE = chessboard_distance,
+  LEFTARG = chessboard, RIGHTARG = chessboard,
+  COMMUTATOR = <->
+);
+
+CREATE FUNCTION chessboard_gist_compress(internal)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'chessboard_gist_compress'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_gist_distance(internal, chessboard, int2, oid, internal)
+  RETURNS float8
+  AS 'MODULE_PATHNAME', 'chessboard_gist_distance'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS chessboard_gist_ops
+    DEFAULT FOR TYPE chessboard USING gist AS
+    OPERATOR   7 @> (chessboard, chesspattern),
+    OPERATOR  15 <-> (chessboard, chessboard) FOR ORDER BY pg_catalog.integer_ops,
+    FUNCTION   1    chessgame_gist_consistent(internal, chesspattern, int2, oid, internal),
+    FUNCTION   2    chess_gist_union(internal, internal),
+    FUNCTION   3    chessboard_gist_compress(internal),
+    FUNCTION   5    chess_gist_penalty(internal, internal, internal),
+    FUNCTION   6    chess_gist_picksplit(internal, internal),
+    FUNCTION   7    chess_gist_same(chesssignature, chesssignature, internal),
+    FUNCTION   8    chessboard_gist_distance(internal, chessboard, int2, oid, internal),
+    STORAGE         chesssignature;
+
+/******************************************************************************
+ * BRIN
+ ******************************************************************************/
+
+/*
+chessgame ^@ chessgame: True if the first game starts with the moves of the
+second, e.g. g ^@ '1. e4 c5' for Sicilian games.
+*/
+CREATE OPERATOR ^@ (
+  PROCEDURE = chessgameContainsChessgame,
+  LEFTARG = chessgame, RIGHTARG = chessgame
+);
+
+/*
+A Bloom filter per block range of the positions of its games (for @>) and
+of their first 16 moves (for ^@), small enough for large append-only
+tables, e.g.
+CREATE INDEX ON games USING brin (game chessgame_bloom_ops(filter_size = 4096))
+  WITH (pages_per_range = 8);
+A range should hold no more positions than about 8 * filter_size.
+*/
+
+CREATE FUNCTION chessgame_brin_bloom_opcinfo(internal)
+  RETURNS internal
+  AS 'MODULE_PATHNAME', 'chessgame_brin_bloom_opcinfo'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_brin_bloom_add_value(internal, internal, internal, internal)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessgame_brin_bloom_add_value'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_brin_bloom_consistent(internal, internal, internal)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessgame_brin_bloom_consistent'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_brin_bloom_union(internal, internal, internal)
+  RETURNS void
+  AS 'MODULE_PATHNAME', 'chessgame_brin_bloom_union'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_brin_bloom_options(internal)
+  RETURNS void
+  AS 'MODULE_PATHNAME', 'chessgame_brin_bloom_options'
+  LANGUAGE C IMMUTABLE PARALLEL SAFE;
+
+CREATE OPERATOR CLASS chessgame_bloom_ops
+    DEFAULT FOR TYPE chessgame USING brin AS
+    OPERATOR   7 @> (chessgame, chessboard),
+    OPERATOR  28 ^@ (chessgame, chessgame),
+    FUNCTION   1    chessgame_brin_bloom_opcinfo(internal),
+    FUNCTION   2    chessgame_brin_bloom_add_value(internal, internal, internal, internal),
+    FUNCTION   3    chessgame_brin_bloom_consistent(internal, internal, internal),
+    FUNCTION   4    chessgame_brin_bloom_union(internal, internal, internal),
+    FUNCTION   5    chessgame_brin_bloom_options(internal),
+    STORAGE         bytea;
+
+/******************************************************************************
+ * Openings
+ ******************************************************************************/
+
+/*
+Opening book for eco_classify, to be filled by the user, e.g.
+INSERT INTO chess_openings VALUES ('C60', 'Ruy Lopez', '1. e4 e5 2. Nf3 Nc6 3. Bb5');
+Each backend compiles it into a move trie on first use and again after
+the table changes.
+*/
+
+CREATE TABLE chess_openings (
+  eco text NOT NULL,
+  name text,
+  moves chessgame NOT NULL
+);
+
+SELECT pg_catalog.pg_extension_config_dump('chess_openings', '');
+
+CREATE FUNCTION chess_openings_changed()
+  RETURNS trigger
+  AS 'MODULE_PATHNAME', 'chess_openings_changed'
+  LANGUAGE C;
+
+CREATE TRIGGER chess_openings_changed
+  AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON chess_openings
+  FOR EACH STATEMENT EXECUTE FUNCTION chess_openings_changed();
+
+CREATE FUNCTION eco_classify(chessgame)
+  RETURNS text
+  AS 'MODULE_PATHNAME', 'eco_classify'
+  LANGUAGE C STABLE STRICT PARALLEL SAFE;
+
+/******************************************************************************
+ * Prefix dictionary
+ ******************************************************************************/
+
+/*
+Shared first moves for chessgame_compress(), e.g.
+INSERT INTO chess_prefixes (moves) VALUES ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6');
+UPDATE games SET game = chessgame_compress(game);
+Compressed games refer to the rows by id, so they can only be added: the
+triggers below refuse other changes. Reading a game whose row was removed
+with the triggers disabled raises a data corruption error.
+*/
+
+CREATE TABLE chess_prefixes (
+  id serial PRIMARY KEY,
+  moves text NOT NULL
+);
+
+SELECT pg_catalog.pg_extension_config_dump('chess_prefixes', '');
+SELECT pg_catalog.pg_extension_config_dump('chess_prefixes_id_seq', '');
+
+CREATE FUNCTION chess_prefixes_changed()
+  RETURNS trigger
+  AS 'MODULE_PATHNAME', 'chess_prefixes_changed'
+  LANGUAGE C;
+
+CREATE TRIGGER chess_prefixes_added
+  AFTER INSERT ON chess_prefixes
+  FOR EACH STATEMENT EXECUTE FUNCTION chess_prefixes_changed();
+
+CREATE TRIGGER chess_prefixes_frozen
+  BEFORE UPDATE OR DELETE OR TRUNCATE ON chess_prefixes
+  FOR EACH STATEMENT EXECUTE FUNCTION chess_prefixes_changed();
+
+/******************************************************************************
+ * Ordering of boards
+ ******************************************************************************/
+
+/* B-Tree ordering of boards: by position hash, only for sorts and merge joins */
+
+CREATE FUNCTION chessboard_lt(chessboard, chessboard)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessboard_lt'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_le(chessboard, chessboard)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessboard_le'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_gt(chessboard, chessboard)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessboard_gt'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_ge(chessboard, chessboard)
+  RETURNS boolean
+  AS 'MODULE_PATHNAME', 'chessboard_ge'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_cmp(chessboard, chessboard)
+  RETURNS integer
+  AS 'MODULE_PATHNAME', 'chessboard_cmp'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessboard_sortsupport(internal)
+  RETURNS void
+  AS 'MODULE_PATHNAME', 'chessboard_sortsupport'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR < (
+  LEFTARG = chessboard, RIGHTARG = chessboard,
+  PROCEDURE = chessboard_lt,
+  COMMUTATOR = >, NEGATOR = >=
+);
+CREATE OPERATOR <= (
+  LEFTARG = chessboard, RIGHTARG = chessboard,
+  PROCEDURE = chessboard_le,
+  COMMUTATOR = >=, NEGATOR = >
+);
+CREATE OPERATOR >= (
+  LEFTARG = chessboard, RIGHTARG = chessboard,
+  PROCEDURE = chessboard_ge,
+  COMMUTATOR = <=, NEGATOR = <
+);
+CREATE OPERATOR > (
+  LEFTARG = chessboard, RIGHTARG = chessboard,
+  PROCEDURE = chessboard_gt,
+  COMMUTATOR = <, NEGATOR = <=
+);
+
+CREATE OPERATOR CLASS chessboard_ops
+DEFAULT FOR TYPE chessboard USING btree
+AS
+        OPERATOR        1       <  ,
+        OPERATOR        2       <= ,
+        OPERATOR        3       =  ,
+        OPERATOR        4       >= ,
+        OPERATOR        5       >  ,
+        FUNCTION        1       chessboard_cmp(chessboard, chessboard),
+        FUNCTION        2       chessboard_sortsupport(internal);
+
+/******************************************************************************
+ * Hashing of games
+ ******************************************************************************/
+
+/* Hash operator class: the same equality, for hash joins, hash aggregation and hash indexes */
+
+CREATE FUNCTION chessgame_hash(chessgame)
+  RETURNS integer
+  AS 'MODULE_PATHNAME', 'chessgame_hash'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION chessgame_hash_extended(chessgame, bigint)
+  RETURNS bigint
+  AS 'MODULE_PATHNAME', 'chessgame_hash_extended'
+  LANGUAGE C IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE OPERATOR CLASS chessgame_hash_ops
+DEFAULT FOR TYPE chessgame USING hash
+AS
+        OPERATOR        1       =  ,
+        FUNCTION        1       chessgame_hash(chessgame),
+        FUNCTION        2       chessgame_hash_extended(chessgame, bigint);
@@ -13,17 +13,260 @@
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <catalog/namespace.h>
+#include <catalog/pg_extension.h>
+#include <common/hashfn.h>
 #include <catalog/pg_type.h>
+#include <commands/explain.h>
+#include <commands/extension.h>
+#include <commands/trigger.h>
+#include <executor/executor.h>
+#include <executor/spi.h>
+#include <access/brin_internal.h>
+#include <access/genam.h>
+#include <access/htup_details.h>
+#include <access/brin_tuple.h>
 #include <access/gin.h>
+#include <access/gist.h>
+#include <access/reloptions.h>
 #include <access/stratnum.h>
+#include <access/table.h>
+#include <access/tableam.h>
+#include <nodes/extensible.h>
+#include <nodes/makefuncs.h>
+#include <nodes/nodeFuncs.h>
+#include <optimizer/cost.h>
+#include <optimizer/optimizer.h>
+#include <optimizer/pathnode.h>
+#include <optimizer/paths.h>
+#include <parser/parse_func.h>
+#include <utils/array.h>
 #include <utils/builtins.h>
+#include <utils/fmgroids.h>
+#include <utils/guc.h>
+#include <utils/inval.h>
+#include <utils/jsonb.h>
+#include <utils/lsyscache.h>
+#include <utils/memutils.h>
+#include <utils/ruleutils.h>
+#include <utils/sortsupport.h>
+#include <utils/syscache.h>
+#include <utils/spccache.h>
+#include <utils/timestamp.h>
+#include <utils/typcache.h>
+#include <funcapi.h>
+#include <miscadmin.h>
+#include <port/pg_bitutils.h>
+#include <storage/ipc.h>
+#include <storage/lwlock.h>
+#include <storage/shmem.h>
+#include <lib/stringinfo.h>
 #include <libpq/pqformat.h>
+#include <mb/pg_wchar.h>
+#if PG_VERSION_NUM >= 160000
+#include <varatt.h>
+#endif
 
-#include "smallchesslib.h"
+/* let long engine searches be cancelled, workers are stopped by the backend */
+#define SCL_CALL_WDT_RESET 1
+#define wdt_reset()             \
+  do                            \
+  {                             \
+    if (!chess_search_in_worker) \
+      CHECK_FOR_INTERRUPTS();   \
+  } while (0)
+
+#include "chess_search.h"
 #include "chess.h"
 
 PG_MODULE_MAGIC;
 
+/* GUC variables */
+
+static bool chess_store_tags = false;
+static int chess_tt_size = 16384; /* kB */
+static int chess_search_workers = 0;
+static bool chess_deterministic_search = false;
+static int chess_search_node_limit = 0;
+static int chess_search_time_limit = 0; /* ms */
+static int chess_shared_cache_size = 0; /* kB */
+static int chess_storage_format = CHESS_STORAGE_PLAIN;
+static int chess_checkpoint_interval = 0;
+static bool chess_position_filter = false;
+static bool chess_enable_batch_scan = true;
+
+/* prefix is not a setting: type input must not read chess_prefixes */
+static const struct config_enum_entry chess_storage_formats[] = {
+    {"plain", CHESS_STORAGE_PLAIN, false},
+    {"packed", CHESS_STORAGE_PACKED, false},
+    {NULL, 0, false}};
+
+static void chess_cache_shmem_request(void);
+static void chess_cache_shmem_startup(void);
+static void chess_tables_invalidate(Datum arg, Oid relid);
+static void chess_batch_scan_register(void);
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+void _PG_init(void);
+
+void _PG_init(void)
+{
+  DefineCustomBoolVariable("chess.store_tags",
+                           "Keep the PGN header tags of parsed games.",
+                           "When on, chessgame input stores the tag pairs in a compact "
+                           "dictionary next to the moves, see game_tag().",
+                           &chess_store_tags,
+                           false,
+                           PGC_USERSET,
+                           0,
+                           NULL, NULL, NULL);
+
+  DefineCustomEnumVariable("chess.storage_format",
+                           "How chessgame input stores the moves.",
+                           "With packed, moves are stored as indexes among the legal "
+                           "moves, smaller but slower to decode. See also "
+                           "chessgame_compress().",
+                           &chess_storage_format,
+                           CHESS_STORAGE_PLAIN,
+                           chess_storage_formats,
+                           PGC_USERSET,
+                           0,
+                           NULL, NULL, NULL);
+
+  DefineCustomBoolVariable("chess.position_filter",
+                           "Store a Bloom filter of the positions of parsed games.",
+                           "@> and hasBoard() then reject most games without "
+                           "replaying their moves.",
+                           &chess_position_filter,
+                           false,
+                           PGC_USERSET,
+                           0,
+                           NULL, NULL, NULL);
+
+  DefineCustomIntVariable("chess.checkpoint_interval",
+                          "Half-moves between the board snapshots stored in games.",
+                          "getBoard() replays the moves from the nearest snapshot, "
+                          "0 stores none.",
+                          &chess_checkpoint_interval,
+                          0,
+                          0,
+                          PG_UINT16_MAX,
+                          PGC_USERSET,
+                          0,
+                          NULL, NULL, NULL);
+
+  DefineCustomIntVariable("chess.tt_size",
+                          "Size of the transposition table of the search engine.",
+                          "The table is allocated per backend on first use by "
+                          "chessboard_eval() or chessboard_bestmove(), 0 disables it.",
+                          &chess_tt_size,
+                          16384,
+                          0,
+                          1024 * 1024,
+                          PGC_USERSET,
+                          GUC_UNIT_KB,
+                          NULL, NULL, NULL);
+
+  DefineCustomIntVariable("chess.search_workers",
+                          "Number of threads searching the root moves of the engine.",
+                          "With 0 the backend searches alone.",
+                          &chess_search_workers,
+                          0,
+                          0,
+                          CHESS_SEARCH_MAX_WORKERS,
+                          PGC_USERSET,
+                          0,
+                          NULL, NULL, NULL);
+
+  DefineCustomIntVariable("chess.search_node_limit",
+                          "Stop engine searches after this many positions.",
+                          "Searches deepen iteratively and return the result of the "
+                          "last completed depth, parallel searches stop searching more "
+                          "root moves. 0 means no limit.",
+                          &chess_search_node_limit,
+                          0,
+                          0,
+                          INT_MAX,
+                          PGC_USERSET,
+                          0,
+                          NULL, NULL, NULL);
+
+  DefineCustomIntVariable("chess.search_time_limit",
+                          "Stop engine searches after this time.",
+                          "Searches deepen iteratively and return the result of the "
+                          "last completed depth, parallel searches stop searching more "
+                          "root moves. 0 means no limit.",
+                          &chess_search_time_limit,
+                          0,
+                          0,
+                          INT_MAX,
+                          PGC_USERSET,
+                          GUC_UNIT_MS,
+                          NULL, NULL, NULL);
+
+  DefineCustomBoolVariable("chess.deterministic_search",
+                           "Make engine results depend only on the position and depth.",
+                           "When on, searches do not use the transposition table, whose "
+                           "contents depend on previous and concurrent searches, nor "
+                           "chess.search_time_limit (nor chess.search_node_limit with "
+                           "chess.search_workers).",
+                           &chess_deterministic_search,
+                           false,
+                           PGC_USERSET,
+                           0,
+                           NULL, NULL, NULL);
+
+  DefineCustomIntVariable("chess.shared_cache_size",
+                          "Size of the cache of positions and search results shared by "
+                          "the backends.",
+                          "Needs chess in shared_preload_libraries, 0 disables it.",
+                          &chess_shared_cache_size,
+                          0,
+                          0,
+                          INT_MAX / 2,
+                          /* fixed at startup, which is over when chess is not preloaded */
+                          process_shared_preload_libraries_in_progress ? PGC_POSTMASTER
+                                                                       : PGC_INTERNAL,
+                          GUC_UNIT_KB,
+                          NULL, NULL, NULL);
+
+  DefineCustomBoolVariable("chess.enable_batch_scan",
+                           "Let the planner use batched scans for @> and hasBoard().",
+                           "The scan evaluates the position clauses of a sequential "
+                           "scan on batches of games, see ChessBatchScan in EXPLAIN.",
+                           &chess_enable_batch_scan,
+                           true,
+                           PGC_USERSET,
+                           0,
+                           NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 150000
+  MarkGUCPrefixReserved("chess");
+#else
+  EmitWarningsOnPlaceholders("chess");
+#endif
+
+  if (process_shared_preload_libraries_in_progress && chess_shared_cache_size > 0)
+  {
+#if PG_VERSION_NUM >= 150000
+    prev_shmem_request_hook = shmem_request_hook;
+    shmem_request_hook = chess_cache_shmem_request;
+#else
+    chess_cache_shmem_request();
+#endif
+    prev_shmem_startup_hook = shmem_startup_hook;
+    shmem_startup_hook = chess_cache_shmem_startup;
+  }
+
+  CacheRegisterRelcacheCallback(chess_tables_invalidate, (Datum)0);
+  chess_batch_scan_register();
+}
+
 /*****************************************************************************/
 
 // create a chessboard datatype with a constructor takes FEN notation as input
@@ -49,8 +292,6 @@ chessboard_parse(char *fen)
 static char *
 chessboard_to_str(const ChessBoard *cb)
 {
-  // char *result = psprintf("%s", cb->fen);
-
   char *result = palloc0(sizeof(char) * SCL_FEN_MAX_LENGTH);
   SCL_boardToFEN(cb->board, result);
   return result;
@@ -90,393 +331,5482 @@ Datum chessboard_out(PG_FUNCTION_ARGS)
 PG_FUNCTION_INFO_V1(chessboard_cast_from_text);
 Datum chessboard_cast_from_text(PG_FUNCTION_ARGS)
 {
-  text *txt = PG_GETARG_TEXT_P(0);
-  char *str = DatumGetCString(DirectFunctionCall1(textout,
-                                                  PointerGetDatum(txt)));
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(0));
   PG_RETURN_CHESSBOARD_P(chessboard_parse(str));
 }
 
-/*****************************************************************************/
+/*
+chessboard_hash(chessboard) -> integer: the position hash used by @> and
+the GIN index (SCL_boardHash32).
+*/
 
-// create a chessboard datatype with a constructor takes FEN notation as input
-static ChessGame *
-chessgame_make(SCL_Record record, char *pgn)
+PG_FUNCTION_INFO_V1(chessboard_hash);
+Datum chessboard_hash(PG_FUNCTION_ARGS)
 {
-  ChessGame *cg = palloc0(sizeof(ChessGame));
-
-  // Copy the array elements
-  SCL_recordCopy(record, cg->record);
-  return cg;
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(0);
+  PG_RETURN_INT32((int32)SCL_boardHash32(cb->board));
 }
 
-static ChessGame *
-chessgame_parse(char *pgn)
+/*
+chessboard_position_key(chessboard) -> bigint: the hash of the position
+without the move clocks (SCL_boardHash64), equal for transpositions.
+*/
+
+PG_FUNCTION_INFO_V1(chessboard_position_key);
+Datum chessboard_position_key(PG_FUNCTION_ARGS)
 {
-  SCL_Record record;
-  SCL_recordFromPGN(record, pgn);
-  return chessgame_make(record, pgn);
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(0);
+  int64 result = (int64)SCL_boardHash64(cb->board);
+  PG_FREE_IF_COPY(cb, 0);
+  PG_RETURN_INT64(result);
 }
 
-static char *
-chessgame_to_str(const ChessGame *cg)
+PG_FUNCTION_INFO_V1(chessboard_eq);
+Datum chessboard_eq(PG_FUNCTION_ARGS)
 {
-  char *result = palloc0(sizeof(char) * SCL_RECORD_MAX_SIZE);
-  SCL_printPGN(cg->record, result, 0);
-  return result;
+  ChessBoard *a = PG_GETARG_CHESSBOARD_P(0);
+  ChessBoard *b = PG_GETARG_CHESSBOARD_P(1);
+  PG_RETURN_BOOL(!SCL_boardsDiffer(a->board, b->board));
 }
 
-/*****************************************************************************/
-
-PG_FUNCTION_INFO_V1(chessgame_constructor);
-Datum chessgame_constructor(PG_FUNCTION_ARGS)
+/*
+Boards are ordered by position hash (SCL_boardHash64), then by state, so
+that = stays the equality of the states and sorts can compare the hashes
+as abbreviated keys. The order only serves sorts, merge joins and
+grouping, it means nothing chess-wise.
+*/
+static int
+chessboard_cmp_internal(const ChessBoard *a, const ChessBoard *b)
 {
-  char *pgn = PG_GETARG_CSTRING(0);
-  PG_RETURN_CHESSGAME_P(chessgame_parse(pgn));
+  uint64 hashA = SCL_boardHash64(a->board);
+  uint64 hashB = SCL_boardHash64(b->board);
+
+  if (hashA != hashB)
+    return hashA < hashB ? -1 : 1;
+  return memcmp(a->board, b->board, SCL_BOARD_STATE_SIZE);
 }
 
-/*********************************INPUT OUTPUT*****************************************/
+PG_FUNCTION_INFO_V1(chessboard_lt);
+Datum chessboard_lt(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(chessboard_cmp_internal(PG_GETARG_CHESSBOARD_P(0), PG_GETARG_CHESSBOARD_P(1)) < 0);
+}
 
-/* in out cast functions of chessgame */
+PG_FUNCTION_INFO_V1(chessboard_le);
+Datum chessboard_le(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(chessboard_cmp_internal(PG_GETARG_CHESSBOARD_P(0), PG_GETARG_CHESSBOARD_P(1)) <= 0);
+}
 
-PG_FUNCTION_INFO_V1(chessgame_in);
-Datum chessgame_in(PG_FUNCTION_ARGS)
+PG_FUNCTION_INFO_V1(chessboard_gt);
+Datum chessboard_gt(PG_FUNCTION_ARGS)
 {
-  char *str = PG_GETARG_CSTRING(0);
-  return PointerGetDatum(chessgame_parse(str));
+  PG_RETURN_BOOL(chessboard_cmp_internal(PG_GETARG_CHESSBOARD_P(0), PG_GETARG_CHESSBOARD_P(1)) > 0);
 }
 
-PG_FUNCTION_INFO_V1(chessgame_out);
-Datum chessgame_out(PG_FUNCTION_ARGS)
+PG_FUNCTION_INFO_V1(chessboard_ge);
+Datum chessboard_ge(PG_FUNCTION_ARGS)
 {
-  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
-  char *result = chessgame_to_str(cg);
-  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(chessboard_cmp_internal(PG_GETARG_CHESSBOARD_P(0), PG_GETARG_CHESSBOARD_P(1)) >= 0);
+}
 
-  PG_RETURN_CSTRING(result);
+PG_FUNCTION_INFO_V1(chessboard_cmp);
+Datum chessboard_cmp(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_INT32(chessboard_cmp_internal(PG_GETARG_CHESSBOARD_P(0), PG_GETARG_CHESSBOARD_P(1)));
 }
 
-PG_FUNCTION_INFO_V1(chessgame_cast_from_text);
-Datum chessgame_cast_from_text(PG_FUNCTION_ARGS)
+#if PG_VERSION_NUM < 150000
+// abbreviated keys compare as unsigned integers (a PostgreSQL 15 helper)
+static int
+ssup_datum_unsigned_cmp(Datum x, Datum y, SortSupport ssup)
 {
-  text *txt = PG_GETARG_TEXT_P(0);
-  char *str = DatumGetCString(DirectFunctionCall1(textout,
-                                                  PointerGetDatum(txt)));
-  PG_RETURN_CHESSGAME_P(chessgame_parse(str));
+  return x < y ? -1 : x > y ? 1 : 0;
 }
+#endif
 
-/*********************************Functions*****************************/
-/*
-getBoard(chessgame, integer) -> chessboard: Return the board state
-at a given half-move (A full move is counted only when both players
-have played). The integer parameter indicates the count of half
-moves since the beginning of the game. A 0 value of this parameter
-means the initial board state, i.e.,(
-rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1).
-*/
+static int
+chessboard_fastcmp(Datum x, Datum y, SortSupport ssup)
+{
+  return chessboard_cmp_internal(DatumGetChessBoardP(x), DatumGetChessBoardP(y));
+}
 
-PG_FUNCTION_INFO_V1(getBoard);
-Datum getBoard(PG_FUNCTION_ARGS)
+// the abbreviated key is the position hash (its high bits on 32 bit platforms)
+static Datum
+chessboard_abbrev_convert(Datum original, SortSupport ssup)
 {
-  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
-  int halfMove = PG_GETARG_INT32(1);
+  uint64 hash = SCL_boardHash64(DatumGetChessBoardP(original)->board);
 
-  ChessBoard *cb = palloc0(sizeof(ChessBoard));
+#if SIZEOF_DATUM == 8
+  return (Datum)hash;
+#else
+  return (Datum)(hash >> 32);
+#endif
+}
 
-  SCL_recordApply(cg->record, cb->board, halfMove);
+// hashes of distinct positions hardly ever collide, abbreviation always pays
+static bool
+chessboard_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+  return false;
+}
 
-  PG_FREE_IF_COPY(cg, 0);
+PG_FUNCTION_INFO_V1(chessboard_sortsupport);
+Datum chessboard_sortsupport(PG_FUNCTION_ARGS)
+{
+  SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
 
-  PG_RETURN_CHESSBOARD_P(cb);
+  ssup->comparator = chessboard_fastcmp;
+  if (ssup->abbreviate)
+  {
+    ssup->comparator = ssup_datum_unsigned_cmp;
+    ssup->abbrev_converter = chessboard_abbrev_convert;
+    ssup->abbrev_abort = chessboard_abbrev_abort;
+    ssup->abbrev_full_comparator = chessboard_fastcmp;
+  }
+  PG_RETURN_VOID();
 }
 
-/**
-  getFirstMoves(chessgame, integer) -> chessgame: Returns the
-  chessgame truncated to its first N half-moves. This function may also
-  be called getOpening(...). Again the integer parameter is zero based.
+/*****************************************************************************/
+
+/*********************************PGN TAGS*****************************************/
+
+/*
+The tags of a PGN header are kept as a compact dictionary: a sequence of
+entries made of a one byte tag code (an index into chess_tag_names, or
+CHESS_TAG_CUSTOM followed by a length prefixed tag name) and a length
+prefixed value. Names and values longer than 255 bytes are truncated at a
+character boundary.
 */
 
-PG_FUNCTION_INFO_V1(getFirstMoves);
-Datum getFirstMoves(PG_FUNCTION_ARGS)
-{
-  ChessGame *originalGame = PG_GETARG_CHESSGAME_P(0);
-  int nOfHalfMoves = PG_GETARG_INT32(1);
+static const char *const chess_tag_names[] = {
+    "Event", "Site", "Date", "Round", "White", "Black", "Result",
+    "WhiteElo", "BlackElo", "ECO", "Opening", "Variation", "TimeControl",
+    "Termination", "WhiteTitle", "BlackTitle", "EventDate", "UTCDate",
+    "UTCTime", "WhiteRatingDiff", "BlackRatingDiff", "PlyCount", "Annotator",
+    "Mode", "FEN", "SetUp"};
 
-  ChessGame *cg = palloc0(sizeof(ChessGame));
-  SCL_recordCopy(originalGame->record, cg->record);
+#define CHESS_TAG_NAMES (sizeof(chess_tag_names) / sizeof(chess_tag_names[0]))
+#define CHESS_TAG_CUSTOM 0xff
+#define CHESS_TAG_MAX_LENGTH 255
 
-  int shouldContinue = 1;
-  uint16_t length = SCL_recordLength(cg->record);
-  for (uint16_t i = 0; i < (length - nOfHalfMoves) && shouldContinue; i++)
+typedef struct
+{
+  char *name;
+  char *value;
+} PGNTag;
+
+/*
+Reads the [Name "Value"] tag pairs at the beginning of a PGN string and
+returns a pointer to the movetext that follows them. When tags is not
+NULL the tag pairs are appended to it as PGNTag items.
+*/
+static const char *
+pgn_read_tags(const char *pgn, List **tags)
+{
+  for (;;)
   {
-    shouldContinue = SCL_recordRemoveLast(cg->record);
-  }
-  PG_FREE_IF_COPY(originalGame, 0);
+    const char *name;
+    int nameLength;
+    StringInfoData value;
+
+    while (isspace((unsigned char)*pgn))
+      pgn++;
+    if (*pgn != '[')
+      break;
+
+    pgn++;
+    while (isspace((unsigned char)*pgn))
+      pgn++;
+    name = pgn;
+    while (*pgn != '\0' && *pgn != ']' && *pgn != '"' && !isspace((unsigned char)*pgn))
+      pgn++;
+    nameLength = pgn - name;
 
-  PG_RETURN_CHESSGAME_P(cg);
+    if (tags != NULL)
+      initStringInfo(&value);
+    while (*pgn != '\0' && *pgn != '"' && *pgn != ']')
+      pgn++;
+    if (*pgn == '"')
+    {
+      for (pgn++; *pgn != '\0' && *pgn != '"'; pgn++)
+      {
+        if (*pgn == '\\' && pgn[1] != '\0')
+          pgn++;
+        if (tags != NULL)
+          appendStringInfoChar(&value, *pgn);
+      }
+      if (tags != NULL && nameLength > 0)
+      {
+        PGNTag *tag = palloc(sizeof(PGNTag));
+        tag->name = pnstrdup(name, pg_mbcliplen(name, nameLength, CHESS_TAG_MAX_LENGTH));
+        tag->value = value.data;
+        *tags = lappend(*tags, tag);
+      }
+    }
+
+    // skip to the end of the tag pair
+    while (*pgn != '\0' && *pgn != ']')
+      pgn++;
+    if (*pgn == ']')
+      pgn++;
+  }
+  return pgn;
 }
 
-bool chessgameContainsChessboard(ChessGame *cg, ChessBoard *cb, int halfMoves)
+// serialize tags into the compact dictionary format
+static void
+chess_tags_serialize(List *tags, StringInfo buf)
 {
-  ChessBoard *temp = palloc0(sizeof(ChessBoard));
+  ListCell *lc;
 
-  for (uint16_t i = 0; i <= halfMoves; i++)
+  foreach (lc, tags)
   {
-    SCL_recordApply(cg->record, temp->board, i);
+    PGNTag *tag = (PGNTag *)lfirst(lc);
+    int valueLength = pg_mbcliplen(tag->value, strlen(tag->value), CHESS_TAG_MAX_LENGTH);
+    uint8 code = CHESS_TAG_CUSTOM;
 
-    uint32_t hash = SCL_boardHash32(temp->board);
-    if (hash == SCL_boardHash32(cb->board))
+    for (int i = 0; i < CHESS_TAG_NAMES; i++)
+      if (strcmp(tag->name, chess_tag_names[i]) == 0)
+      {
+        code = i;
+        break;
+      }
+
+    appendStringInfoChar(buf, (char)code);
+    if (code == CHESS_TAG_CUSTOM)
     {
-      return true;
+      appendStringInfoChar(buf, (char)strlen(tag->name));
+      appendBinaryStringInfo(buf, tag->name, strlen(tag->name));
     }
+    appendStringInfoChar(buf, (char)valueLength);
+    appendBinaryStringInfo(buf, tag->value, valueLength);
   }
-  return false;
 }
 
-bool chessgame_contains_chessgame(ChessGame *c1, ChessGame *c2)
+/*
+Iterates over the tag dictionary of a chessgame, returns false when there
+are no more entries. Names and values are not null terminated.
+*/
+static bool
+chessgame_tags_next(const uint8 **pos, const uint8 *end,
+                    const char **name, int *nameLength,
+                    const char **value, int *valueLength)
 {
-  // Get number of half moves of the 1st chess game
-  uint16_t length1 = SCL_recordLength(c1->record);
+  const uint8 *p = *pos;
 
-  // Get number of half moves of the 2nd chess game
-  uint16_t length2 = SCL_recordLength(c2->record);
+  if (p >= end)
+    return false;
 
-  if (length2 > length1)
+  if (*p == CHESS_TAG_CUSTOM)
   {
-    return false;
+    *nameLength = p[1];
+    *name = (const char *)p + 2;
+    p += 2 + *nameLength;
   }
-  // Check if the chessgame matches with minLength
-  for (uint16_t i = 0; i < length2; i++)
+  else
   {
-    uint8_t squareFrom1;
-    uint8_t squareTo1;
-    uint8_t squareFrom2;
-    uint8_t squareTo2;
-    char promotedPiece;
-    uint8_t mov1 = SCL_recordGetMove(c1->record, i, &squareFrom1, &squareTo1, &promotedPiece);
-    uint8_t mov2 = SCL_recordGetMove(c2->record, i, &squareFrom2, &squareTo2, &promotedPiece);
-    if ((squareFrom1 != squareFrom2) || (squareTo1 != squareTo2))
-    {
-      return false;
-    }
+    *name = chess_tag_names[*p];
+    *nameLength = strlen(*name);
+    p++;
   }
+  *valueLength = *p;
+  *value = (const char *)p + 1;
+  *pos = p + 1 + *valueLength;
   return true;
 }
 
-PG_FUNCTION_INFO_V1(chessgameContainsChessgame);
-Datum chessgameContainsChessgame(PG_FUNCTION_ARGS)
-{
-  ChessGame *c1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *c2 = PG_GETARG_CHESSGAME_P(1);
-  bool result = chessgame_contains_chessgame(c1, c2);
-  PG_RETURN_BOOL(result);
-}
-
-PG_FUNCTION_INFO_V1(chessgame_gin_extract_value);
-Datum chessgame_gin_extract_value(PG_FUNCTION_ARGS)
+// build a jsonb object out of tag pairs
+static Jsonb *
+chess_tags_to_jsonb(List *tags)
 {
-  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
-  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
-  bool **nullFlags = (bool **)PG_GETARG_POINTER(2);
-  Datum *entries = NULL;
-  *nullFlags = NULL; // Assume all keys are non-null
+  JsonbParseState *state = NULL;
+  JsonbValue *res;
+  ListCell *lc;
 
-  if (PG_ARGISNULL(0))
+  pushJsonbValue(&state, WJB_BEGIN_OBJECT, NULL);
+  foreach (lc, tags)
   {
-    *nkeys = 0;
-    PG_RETURN_NULL();
-  }
+    PGNTag *tag = (PGNTag *)lfirst(lc);
+    JsonbValue k;
+    JsonbValue v;
 
-  uint16_t length = SCL_recordLength(cg->record);
-  if (length > 0)
-  {
-    entries = (Datum *)palloc(sizeof(Datum) * length + 1);
-    *nkeys = length + 1;
-  }
-  for (uint16_t i = 0; i <= length; ++i)
-  {
-    ChessBoard *cb = palloc0(sizeof(ChessBoard));
-    SCL_recordApply(cg->record, cb->board, i);
-    entries[i] = ChessBoardPGetDatum(cb);
+    k.type = jbvString;
+    k.val.string.val = tag->name;
+    k.val.string.len = strlen(tag->name);
+    v.type = jbvString;
+    v.val.string.val = tag->value;
+    v.val.string.len = strlen(tag->value);
+    pushJsonbValue(&state, WJB_KEY, &k);
+    pushJsonbValue(&state, WJB_VALUE, &v);
   }
+  res = pushJsonbValue(&state, WJB_END_OBJECT, NULL);
 
-  PG_RETURN_POINTER(entries);
+  return JsonbValueToJsonb(res);
 }
 
-PG_FUNCTION_INFO_V1(chessgame_gin_extract_query);
-Datum chessgame_gin_extract_query(PG_FUNCTION_ARGS)
+// the tags stored in a chessgame as a list of PGNTag
+static List *
+chessgame_get_tags(const ChessGame *cg)
 {
-  Datum query = PG_GETARG_DATUM(0);
-  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
-  StrategyNumber strategy = PG_GETARG_UINT16(2);
-  bool **pmatch = (bool **)PG_GETARG_POINTER(3);
-  Pointer **extra_data = (Pointer **)PG_GETARG_POINTER(4);
-  bool **nullFlags = (bool **)PG_GETARG_POINTER(5);
-  int32 *searchMode = (int32 *)PG_GETARG_POINTER(6);
+  List *tags = NIL;
+  const uint8 *pos;
+  const uint8 *end;
+  const char *name;
+  const char *value;
+  int nameLength;
+  int valueLength;
 
-  *nullFlags = NULL; // Assume all keys are non-null
-  *searchMode = GIN_SEARCH_MODE_DEFAULT;
+  if (!(cg->flags & CHESSGAME_HAS_TAGS))
+    return NIL;
 
-  if (PG_ARGISNULL(0))
+  pos = CHESSGAME_TAGS(cg);
+  end = pos + CHESSGAME_TAGS_SIZE(cg);
+  while (chessgame_tags_next(&pos, end, &name, &nameLength, &value, &valueLength))
   {
-    *nkeys = 0;
-    PG_RETURN_NULL();
+    PGNTag *tag = palloc(sizeof(PGNTag));
+    tag->name = pnstrdup(name, nameLength);
+    tag->value = pnstrdup(value, valueLength);
+    tags = lappend(tags, tag);
   }
+  return tags;
+}
 
-  switch (strategy)
-  {
-  case RTContainsStrategyNumber:
-  {
-    *nkeys = 1;
-    Datum *states = (Datum *)palloc(sizeof(Datum));
-    states[0] = query;
-    // For simplicity, assume all keys require exact match (no partial match)
-    *pmatch = (bool *)palloc(sizeof(bool));
-    **pmatch = false;
+/*********************************Move tries*********************************/
 
-    // Assume no extra data is needed for this example
-    *extra_data = NULL;
+/*
+Tries of move sequences, for eco_classify and the prefix dictionary. A
+trie is built with linked children, then compiled into one array in
+breadth-first order: the children of a node are contiguous and sorted by
+move, so that looking a game up costs one binary search per ply.
+*/
 
-    // Assume no null flags for this example
+typedef struct
+{
+  uint16 move;       /* chess_trie_move of the move leading here */
+  uint16 childCount;
+  int32 childStart;  /* index of the first child */
+  int32 value;       /* set by the owner of the trie, -1 if none */
+} ChessTrieNode;
 
-    // Assume default search mode
-    *searchMode = GIN_SEARCH_MODE_DEFAULT;
+/* node of a trie being built, children as a linked list */
+typedef struct
+{
+  uint16 move;
+  int32 firstChild;
+  int32 nextSibling;
+  int32 value;
+} ChessTrieBuildNode;
 
-    PG_RETURN_POINTER(states);
-  }
-  break;
-  default:
-    elog(ERROR, "chessgame_gin_extract_query: unknown strategy number: %d", strategy);
-  }
+typedef struct
+{
+  ChessTrieBuildNode *nodes; /* nodes[0] is the root */
+  int32 count;
+  int32 size;
+} ChessTrieBuilder;
 
-  PG_RETURN_NULL();
+// move i of a record as a trie key: squares and promotion, without the end flags
+static inline uint16
+chess_trie_move(const SCL_Record record, uint16 i)
+{
+  return (record[2 * i] & 0x3f) | ((uint16)record[2 * i + 1] << 6);
 }
 
-int evaluateBoard(SCL_Board board)
+static void
+chess_trie_builder_init(ChessTrieBuilder *builder)
 {
-  const char *p = board;
-  int total = 0;
-  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i, ++p)
+  builder->size = 1024;
+  builder->count = 1;
+  builder->nodes = palloc(sizeof(ChessTrieBuildNode) * builder->size);
+  builder->nodes[0].move = 0;
+  builder->nodes[0].firstChild = builder->nodes[0].nextSibling = builder->nodes[0].value = -1;
+}
+
+// add the first length moves of the record, returns the value of their node
+static int32 *
+chess_trie_insert(ChessTrieBuilder *builder, const SCL_Record record, uint16 length)
+{
+  int32 node = 0;
+
+  for (uint16 i = 0; i < length; i++)
   {
-    char s = *p;
+    uint16 move = chess_trie_move(record, i);
+    int32 child = builder->nodes[node].firstChild;
 
-    if (s != '.')
+    while (child >= 0 && builder->nodes[child].move != move)
+      child = builder->nodes[child].nextSibling;
+
+    if (child < 0)
     {
-      total += SCL_pieceValue(s);
+      if (builder->count == builder->size)
+      {
+        builder->size *= 2;
+        builder->nodes = repalloc_huge(builder->nodes,
+                                       sizeof(ChessTrieBuildNode) * builder->size);
+      }
+      child = builder->count++;
+      builder->nodes[child].move = move;
+      builder->nodes[child].firstChild = -1;
+      builder->nodes[child].value = -1;
+      builder->nodes[child].nextSibling = builder->nodes[node].firstChild;
+      builder->nodes[node].firstChild = child;
     }
+    node = child;
   }
-  return total;
+  return &builder->nodes[node].value;
 }
 
-PG_FUNCTION_INFO_V1(chessgame_compare);
-Datum chessgame_compare(PG_FUNCTION_ARGS)
+// the compiled trie, allocated in context, the builder is freed
+static ChessTrieNode *
+chess_trie_compile(ChessTrieBuilder *builder, MemoryContext context)
 {
-  ChessBoard *a = PG_GETARG_CHESSBOARD_P(0);
-  ChessBoard *b = PG_GETARG_CHESSBOARD_P(1);
+  ChessTrieBuildNode *build = builder->nodes;
+  ChessTrieNode *nodes = MemoryContextAllocHuge(context, sizeof(ChessTrieNode) * builder->count);
+  int32 *queue = palloc(sizeof(int32) * builder->count); /* build node of each node */
+  int32 head = 0, tail = 0;
 
-  int16_t result = evaluateBoard(a->board) - evaluateBoard(b->board);
+  queue[tail++] = 0;
+  nodes[0].move = 0;
+  nodes[0].value = build[0].value;
+  while (head < tail)
+  {
+    ChessTrieNode *compiled = &nodes[head];
+    int32 node = queue[head++];
 
-  PG_FREE_IF_COPY(a, 0);
-  PG_FREE_IF_COPY(b, 1);
-  PG_RETURN_INT16(result);
+    compiled->childStart = tail;
+    compiled->childCount = 0;
+    for (int32 child = build[node].firstChild; child >= 0; child = build[child].nextSibling)
+    {
+      nodes[tail].move = build[child].move;
+      nodes[tail].value = build[child].value;
+      queue[tail++] = child;
+      compiled->childCount++;
+    }
+
+    // sort the children and their queue entries together
+    for (int32 i = compiled->childStart + 1; i < tail; i++)
+      for (int32 j = i; j > compiled->childStart && nodes[j - 1].move > nodes[j].move; j--)
+      {
+        ChessTrieNode tmpNode = nodes[j];
+        int32 tmpQueue = queue[j];
+
+        nodes[j] = nodes[j - 1];
+        nodes[j - 1] = tmpNode;
+        queue[j] = queue[j - 1];
+        queue[j - 1] = tmpQueue;
+      }
+  }
+
+  pfree(queue);
+  pfree(build);
+  return nodes;
 }
 
-PG_FUNCTION_INFO_V1(chessgame_gin_triconsistent);
-Datum chessgame_gin_triconsistent(PG_FUNCTION_ARGS)
+static int
+chess_trie_node_cmp(const void *a, const void *b)
 {
-  PG_RETURN_GIN_TERNARY_VALUE(GIN_TRUE);
+  return (int)((const ChessTrieNode *)a)->move - (int)((const ChessTrieNode *)b)->move;
 }
 
-PG_FUNCTION_INFO_V1(chessgame_contains_chessboard);
-Datum chessgame_contains_chessboard(PG_FUNCTION_ARGS)
+/*
+Value of the deepest node with one on the path of the first length moves
+of the record, -1 if none. depth is set to the number of moves of that
+node.
+*/
+static int32
+chess_trie_longest(const ChessTrieNode *nodes, const SCL_Record record, uint16 length,
+                   uint16 *depth)
 {
-  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
-  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(1);
+  int32 node = 0;
+  int32 value = nodes[0].value;
 
-  bool result = chessgameContainsChessboard(cg, cb, SCL_recordLength(cg->record));
-  PG_FREE_IF_COPY(cg, 0);
-  PG_FREE_IF_COPY(cb, 1);
+  *depth = 0;
+  for (uint16 i = 0; i < length && nodes[node].childCount > 0; i++)
+  {
+    ChessTrieNode key;
+    ChessTrieNode *child;
 
-  PG_RETURN_BOOL(result);
+    key.move = chess_trie_move(record, i);
+    child = bsearch(&key, nodes + nodes[node].childStart, nodes[node].childCount,
+                    sizeof(ChessTrieNode), chess_trie_node_cmp);
+    if (child == NULL)
+      break;
+
+    node = child - nodes;
+    if (nodes[node].value >= 0)
+    {
+      value = nodes[node].value;
+      *depth = i + 1;
+    }
+  }
+  return value;
 }
 
-/******************************************************************************************/
-// Implementation of the internal function
-static int hasOpening_internal(ChessGame *chessgame1, ChessGame *chessgame2)
-{
+/*********************************Prefix dictionary**************************/
 
-  // Get number of half moves of the 1st chess game
-  uint16_t length1 = SCL_recordLength(chessgame1->record);
+/*
+chessgame_compress stores the id of the longest entry of the
+chess_prefixes table (at least CHESS_PREFIX_MIN_LENGTH half-moves) that
+a game starts with instead of these moves (see CHESSGAME_HAS_PREFIX).
+Only that explicit call looks entries up, never type input. Entries can
+only be added, since stored games refer to them: the triggers of the
+table enforce it, and a game whose entry was removed anyway (e.g. with
+the triggers disabled) raises ERRCODE_DATA_CORRUPTED when read. Each
+backend loads the table on first use and again after it grows (its
+trigger sends a relcache invalidation).
+*/
 
-  // Get number of half moves of the 2nd chess game
-  uint16_t length2 = SCL_recordLength(chessgame2->record);
+#define CHESS_PREFIX_MIN_LENGTH 4 /* shorter prefixes do not save space */
 
-  // :(
+typedef struct
+{
+  MemoryContext context;
+  ChessTrieNode *trie; /* values are entry indexes */
+  int count;
+  int32 *ids;          /* sorted */
+  uint16 *lengths;     /* half-moves of each entry */
+  uint8 **moves;       /* record bytes of each entry */
+} ChessPrefixes;
 
-  return length1 - length2;
+static ChessPrefixes *chess_prefixes = NULL;
+static bool chess_prefixes_valid = false;
+static Oid chess_prefixes_relid = InvalidOid;
+
+#if PG_VERSION_NUM < 160000
+// the schema of an extension (exported by PostgreSQL 16)
+static Oid
+get_extension_schema(Oid ext_oid)
+{
+  Relation rel = table_open(ExtensionRelationId, AccessShareLock);
+  ScanKeyData entry[1];
+  SysScanDesc scandesc;
+  HeapTuple tuple;
+  Oid result = InvalidOid;
+
+  ScanKeyInit(&entry[0], Anum_pg_extension_oid, BTEqualStrategyNumber, F_OIDEQ,
+              ObjectIdGetDatum(ext_oid));
+  scandesc = systable_beginscan(rel, ExtensionOidIndexId, true, NULL, 1, entry);
+  tuple = systable_getnext(scandesc);
+  if (HeapTupleIsValid(tuple))
+    result = ((Form_pg_extension)GETSTRUCT(tuple))->extnamespace;
+  systable_endscan(scandesc);
+  table_close(rel, AccessShareLock);
+  return result;
+}
+#endif
+
+typedef struct
+{
+  int32 id;
+  char *moves;
+} ChessPrefixRow;
+
+static int
+chess_prefix_row_cmp(const void *a, const void *b)
+{
+  int32 id1 = ((const ChessPrefixRow *)a)->id;
+  int32 id2 = ((const ChessPrefixRow *)b)->id;
+
+  return id1 < id2 ? -1 : id1 > id2 ? 1 : 0;
+}
+
+/*
+Load the chess_prefixes table of the schema of the extension. Games are
+decoded by I/O functions, comparators and index support functions, which
+must not run queries: the table is read by a heap scan with the catalog
+snapshot rather than SPI.
+*/
+static ChessPrefixes *
+chess_prefixes_load(void)
+{
+  Oid extensionId = get_extension_oid("chess", false);
+  Oid namespaceId = get_extension_schema(extensionId);
+  AttrNumber idAttnum;
+  AttrNumber movesAttnum;
+  Relation rel;
+  SysScanDesc scan;
+  HeapTuple tuple;
+  ChessPrefixRow *rows;
+  int rowCount = 0;
+  int rowMax = 64;
+  MemoryContext context;
+  MemoryContext oldContext;
+  ChessPrefixes *prefixes;
+  ChessTrieBuilder builder;
+
+  chess_prefixes_relid = get_relname_relid("chess_prefixes", namespaceId);
+  if (!OidIsValid(chess_prefixes_relid))
+    ereport(ERROR,
+            (errcode(ERRCODE_UNDEFINED_TABLE),
+             errmsg("relation \"chess_prefixes\" does not exist")));
+  idAttnum = get_attnum(chess_prefixes_relid, "id");
+  movesAttnum = get_attnum(chess_prefixes_relid, "moves");
+  if (idAttnum == InvalidAttrNumber || movesAttnum == InvalidAttrNumber)
+    elog(ERROR, "chess_prefixes lacks the id or moves column");
+
+  rows = palloc(sizeof(ChessPrefixRow) * rowMax);
+  rel = table_open(chess_prefixes_relid, AccessShareLock);
+  scan = systable_beginscan(rel, InvalidOid, false, NULL, 0, NULL);
+  while (HeapTupleIsValid(tuple = systable_getnext(scan)))
+  {
+    bool idNull, movesNull;
+    Datum idDatum = heap_getattr(tuple, idAttnum, RelationGetDescr(rel), &idNull);
+    Datum movesDatum = heap_getattr(tuple, movesAttnum, RelationGetDescr(rel), &movesNull);
+
+    if (idNull || movesNull)
+      continue;
+    if (rowCount == rowMax)
+    {
+      rowMax *= 2;
+      rows = repalloc(rows, sizeof(ChessPrefixRow) * rowMax);
+    }
+    rows[rowCount].id = DatumGetInt32(idDatum);
+    rows[rowCount].moves = TextDatumGetCString(movesDatum);
+    rowCount++;
+  }
+  systable_endscan(scan);
+  table_close(rel, AccessShareLock);
+
+  // entries are looked up by id, see chess_prefix_moves
+  qsort(rows, rowCount, sizeof(ChessPrefixRow), chess_prefix_row_cmp);
+
+  context = AllocSetContextCreate(TopMemoryContext, "chess prefix dictionary",
+                                  ALLOCSET_DEFAULT_SIZES);
+  oldContext = MemoryContextSwitchTo(context);
+  prefixes = palloc(sizeof(ChessPrefixes));
+  prefixes->context = context;
+  prefixes->count = 0;
+  prefixes->ids = palloc(sizeof(int32) * (rowCount + 1));
+  prefixes->lengths = palloc(sizeof(uint16) * (rowCount + 1));
+  prefixes->moves = palloc(sizeof(uint8 *) * (rowCount + 1));
+  MemoryContextSwitchTo(oldContext);
+
+  chess_trie_builder_init(&builder);
+  for (int row = 0; row < rowCount; row++)
+  {
+    SCL_Record record;
+    uint16 length;
+    int32 *value;
+    int n = prefixes->count;
+
+    SCL_recordFromPGN(record, rows[row].moves);
+    length = SCL_recordLength(record);
+
+    prefixes->ids[n] = rows[row].id;
+    prefixes->lengths[n] = length;
+    prefixes->moves[n] = MemoryContextAlloc(context, Max(length * 2, 1));
+    memcpy(prefixes->moves[n], record, length * 2);
+    prefixes->count++;
+
+    // of entries with the same moves, games refer to the first one
+    value = chess_trie_insert(&builder, record, length);
+    if (*value < 0 && length >= CHESS_PREFIX_MIN_LENGTH)
+      *value = n;
+    pfree(rows[row].moves);
+  }
+  pfree(rows);
+
+  prefixes->trie = chess_trie_compile(&builder, context);
+  return prefixes;
+}
+
+static ChessPrefixes *
+chess_prefixes_get(bool reload)
+{
+  if (reload || !chess_prefixes_valid || chess_prefixes == NULL)
+  {
+    if (chess_prefixes != NULL)
+      MemoryContextDelete(chess_prefixes->context);
+    chess_prefixes = NULL;
+    chess_prefixes_valid = true;
+    chess_prefixes = chess_prefixes_load();
+  }
+  return chess_prefixes;
+}
+
+// longest entry the game starts with, -1 if none
+static int32
+chess_prefix_find(const SCL_Record record, uint16 length, uint16 *prefixLength)
+{
+  ChessPrefixes *prefixes = chess_prefixes_get(false);
+  int32 entry = chess_trie_longest(prefixes->trie, record, length, prefixLength);
+
+  return entry < 0 ? -1 : prefixes->ids[entry];
+}
+
+// copy the moves of the entry id into the record, which must have length of them
+static void
+chess_prefix_moves(int32 id, SCL_Record record, uint16 length)
+{
+  ChessPrefixes *prefixes = chess_prefixes_get(false);
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    int lo = 0, hi = prefixes->count - 1;
+
+    while (lo <= hi)
+    {
+      int mid = lo + (hi - lo) / 2;
+
+      if (prefixes->ids[mid] < id)
+        lo = mid + 1;
+      else if (prefixes->ids[mid] > id)
+        hi = mid - 1;
+      else if (prefixes->lengths[mid] != length)
+        break;
+      else
+      {
+        memcpy(record, prefixes->moves[mid], length * 2);
+        return;
+      }
+    }
+
+    // the entry may have been added since the dictionary was loaded
+    prefixes = chess_prefixes_get(true);
+  }
+
+  ereport(ERROR,
+          (errcode(ERRCODE_DATA_CORRUPTED),
+           errmsg("chessgame refers to missing entry %d of chess_prefixes", id)));
+}
+
+/*
+chess_prefixes_changed() trigger: invalidate the dictionaries of all the
+backends after rows are added, refuse to change or remove rows.
+*/
+
+PG_FUNCTION_INFO_V1(chess_prefixes_changed);
+Datum chess_prefixes_changed(PG_FUNCTION_ARGS)
+{
+  TriggerData *trigdata = (TriggerData *)fcinfo->context;
+
+  if (!CALLED_AS_TRIGGER(fcinfo))
+    elog(ERROR, "chess_prefixes_changed: not called by trigger manager");
+
+  if (!TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+    ereport(ERROR,
+            (errcode(ERRCODE_OBJECT_IN_USE),
+             errmsg("rows of chess_prefixes cannot be changed or removed"),
+             errdetail("Stored games may refer to them.")));
+
+  CacheInvalidateRelcache(trigdata->tg_relation);
+  PG_RETURN_POINTER(NULL);
+}
+
+/*********************************Packed moves*******************************/
+
+/*
+Archival encoding of the moves (chess.storage_format = packed, or
+chessgame_pack): each move is stored as its index in the list of legal
+moves of its position (see chess_legal_moves), in as few bits as that
+list needs, about 6 instead of 16. Decoding replays the game, generating
+the legal moves of every position.
+*/
+
+#define CHESS_PACKED_MAX_MOVES 256 /* more than the legal moves of any position */
+
+/*
+Legal moves of the side to move as the two bytes of their record item
+(from, to | promotion) in canonical order: by origin then target square,
+promotions to queen, rook, bishop then knight. Returns their number.
+*/
+static int
+chess_legal_moves(SCL_Board board, uint16 *moves)
+{
+  bool white = SCL_boardWhitesTurn(board);
+  int count = 0;
+
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; i++)
+  {
+    SCL_SquareSet targets;
+    bool pawn;
+
+    if (board[i] == '.' || SCL_pieceIsWhite(board[i]) != white)
+      continue;
+
+    pawn = board[i] == 'P' || board[i] == 'p';
+    SCL_squareSetClear(targets);
+    SCL_boardGetMoves(board, i, targets);
+
+    SCL_SQUARE_SET_ITERATE_BEGIN(targets)
+      if (pawn && (iteratedSquare / 8 == 0 || iteratedSquare / 8 == 7))
+      {
+        moves[count++] = i | (iteratedSquare | SCL_RECORD_PROM_Q) << 8;
+        moves[count++] = i | (iteratedSquare | SCL_RECORD_PROM_R) << 8;
+        moves[count++] = i | (iteratedSquare | SCL_RECORD_PROM_B) << 8;
+        moves[count++] = i | (iteratedSquare | SCL_RECORD_PROM_N) << 8;
+      }
+      else
+        moves[count++] = i | iteratedSquare << 8;
+    SCL_SQUARE_SET_ITERATE_END
+  }
+  return count;
+}
+
+// bits needed for an index among count moves
+static inline int
+chess_packed_width(int count)
+{
+  return count <= 1 ? 0 : pg_leftmost_one_pos32(count - 1) + 1;
+}
+
+/*
+Pack the first length moves of the record into a bit stream (least
+significant bits first), of which size is set to the number of bytes.
+Returns NULL if a move is not legal in its position.
+*/
+static uint8 *
+chess_moves_pack(const SCL_Record record, uint16 length, Size *size)
+{
+  uint8 *stream = palloc0(length + 1);
+  uint16 moves[CHESS_PACKED_MAX_MOVES];
+  SCL_Board board;
+  uint64 bits = 0;
+
+  SCL_boardInit(board);
+  for (uint16 ply = 0; ply < length; ply++)
+  {
+    uint16 move = CHESS_MOVE_ITEM(record, ply);
+    int count = chess_legal_moves(board, moves);
+    int index = 0;
+    char promotedPiece;
+    uint8_t squareFrom, squareTo;
+
+    while (index < count && moves[index] != move)
+      index++;
+    if (index == count)
+    {
+      pfree(stream);
+      return NULL;
+    }
+
+    for (int bit = 0; bit < chess_packed_width(count); bit++, bits++)
+      if (index & (1 << bit))
+        stream[bits / 8] |= 1 << (bits % 8);
+
+    SCL_recordGetMove(record, ply, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+
+  *size = (bits + 7) / 8;
+  return stream;
+}
+
+// read the index of the move of ply among count legal moves, advancing bits
+static inline int
+chess_packed_index(const uint8 *stream, Size size, uint64 *bits, int count, uint16 ply)
+{
+  int width = chess_packed_width(count);
+  int index = 0;
+
+  if (*bits + width > (uint64)size * 8)
+    index = count;
+  for (int bit = 0; bit < width && index < count; bit++, (*bits)++)
+    if (stream[*bits / 8] & (1 << (*bits % 8)))
+      index |= 1 << bit;
+  if (index >= count)
+    ereport(ERROR,
+            (errcode(ERRCODE_DATA_CORRUPTED),
+             errmsg("invalid packed chessgame move at half-move %d", ply + 1)));
+  return index;
+}
+
+// decode length moves from a packed stream of size bytes into the record
+static void
+chess_moves_unpack(const uint8 *stream, Size size, uint16 length, SCL_Record record)
+{
+  uint16 moves[CHESS_PACKED_MAX_MOVES];
+  SCL_Board board;
+  uint64 bits = 0;
+
+  SCL_boardInit(board);
+  for (uint16 ply = 0; ply < length; ply++)
+  {
+    int count = chess_legal_moves(board, moves);
+    int index = chess_packed_index(stream, size, &bits, count, ply);
+    char promotedPiece;
+    uint8_t squareFrom, squareTo;
+
+    record[ply * 2] = moves[index] & 0xff;
+    record[ply * 2 + 1] = moves[index] >> 8;
+
+    SCL_recordGetMove(record, ply, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+}
+
+/*
+Compare the first length moves of two packed streams as sequences of move
+items. Up to where they differ the games are the same, so both streams are
+read while replaying a single board.
+*/
+static int
+chess_moves_packed_cmp(const uint8 *stream1, Size size1, const uint8 *stream2, Size size2,
+                       uint16 length)
+{
+  uint16 moves[CHESS_PACKED_MAX_MOVES];
+  SCL_Record record;
+  SCL_Board board;
+  uint64 bits1 = 0;
+  uint64 bits2 = 0;
+
+  SCL_boardInit(board);
+  for (uint16 ply = 0; ply < length; ply++)
+  {
+    int count = chess_legal_moves(board, moves);
+    int index1 = chess_packed_index(stream1, size1, &bits1, count, ply);
+    int index2 = chess_packed_index(stream2, size2, &bits2, count, ply);
+    char promotedPiece;
+    uint8_t squareFrom, squareTo;
+
+    if (index1 != index2)
+      return moves[index1] < moves[index2] ? -1 : 1;
+
+    record[ply * 2] = moves[index1] & 0xff;
+    record[ply * 2 + 1] = moves[index1] >> 8;
+    SCL_recordGetMove(record, ply, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+  return 0;
+}
+
+/*********************************Checkpoints********************************/
+
+/*
+With chess.checkpoint_interval = K > 0, games store the board after every
+K half-moves and the final one, so that a position is found by replaying
+fewer than K moves from the snapshot before it (see chessgame_board_at).
+A snapshot keeps the squares as 4 bit piece codes, then the state bytes
+of the board but the terminating zero.
+*/
+
+static const char chess_checkpoint_pieces[] = ".PNBRQKpnbrqk";
+
+static inline uint8
+chess_checkpoint_code(char piece)
+{
+  const char *c = strchr(chess_checkpoint_pieces, piece);
+
+  return (piece != '\0' && c != NULL) ? c - chess_checkpoint_pieces : 0;
+}
+
+static void
+chess_checkpoint_pack(const SCL_Board board, uint8 *out)
+{
+  for (int i = 0; i < SCL_BOARD_SQUARES; i += 2)
+    out[i / 2] = chess_checkpoint_code(board[i]) | chess_checkpoint_code(board[i + 1]) << 4;
+  memcpy(out + SCL_BOARD_SQUARES / 2, board + SCL_BOARD_SQUARES,
+         SCL_BOARD_STATE_SIZE - SCL_BOARD_SQUARES - 1);
+}
+
+static void
+chess_checkpoint_unpack(const uint8 *in, SCL_Board board)
+{
+  for (int i = 0; i < SCL_BOARD_SQUARES; i += 2)
+  {
+    board[i] = chess_checkpoint_pieces[in[i / 2] & 0x0f];
+    board[i + 1] = chess_checkpoint_pieces[in[i / 2] >> 4];
+  }
+  memcpy(board + SCL_BOARD_SQUARES, in + SCL_BOARD_SQUARES / 2,
+         SCL_BOARD_STATE_SIZE - SCL_BOARD_SQUARES - 1);
+  board[SCL_BOARD_STATE_SIZE - 1] = 0;
+}
+
+// interval and snapshots of the first length moves of the record
+static void
+chess_checkpoints_make(const SCL_Record record, uint16 length, uint16 interval, uint8 *out)
+{
+  SCL_Board board;
+  int count = 0;
+
+  out[0] = interval & 0xff;
+  out[1] = interval >> 8;
+  out += 2;
+
+  SCL_boardInit(board);
+  for (uint16 i = 0; i < length; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+    if ((i + 1) % interval == 0 || i + 1 == length)
+      chess_checkpoint_pack(board, out + CHESS_CHECKPOINT_SIZE * count++);
+  }
+}
+
+/*********************************Position filter****************************/
+
+/*
+With chess.position_filter on, games store a Bloom filter of the
+SCL_boardHash32 of their positions, of 4 to 8 bits per position (a power
+of two between CHESS_FILTER_MIN_BYTES and CHESS_FILTER_MAX_BYTES) with
+CHESS_FILTER_HASHES bits set per position, i.e. 3 to 15% false positives
+up to 256 half-moves. @> probes it before replaying the game.
+*/
+
+#define CHESS_FILTER_MIN_BYTES 8
+#define CHESS_FILTER_MAX_BYTES 128
+#define CHESS_FILTER_HASHES 3
+
+// base 2 log of the filter bytes for a game of length half-moves
+static int
+chess_filter_log2(uint16 length)
+{
+  uint32 bytes = pg_nextpower2_32(Max((length + 2) / 2, CHESS_FILTER_MIN_BYTES));
+
+  return pg_leftmost_one_pos32(Min(bytes, CHESS_FILTER_MAX_BYTES));
+}
+
+// the bits of the filter for a position hash, by double hashing
+#define CHESS_FILTER_BIT(hash, step, i, mask) (((hash) + (i) * (step)) & (mask))
+
+static inline uint32
+chess_filter_step(uint32 hash)
+{
+  return murmurhash32(hash) | 1;
+}
+
+// add a position to a filter (its log2 byte first)
+static inline void
+chess_filter_add(uint8 *filter, uint32 hash)
+{
+  uint32 mask = (8u << filter[0]) - 1;
+  uint32 step = chess_filter_step(hash);
+
+  for (int k = 0; k < CHESS_FILTER_HASHES; k++)
+  {
+    uint32 bit = CHESS_FILTER_BIT(hash, step, k, mask);
+
+    filter[1 + bit / 8] |= 1 << (bit % 8);
+  }
+}
+
+// filter of the first length moves of the record, out has 1 + 2^log2 bytes zeroed
+static void
+chess_filter_make(const SCL_Record record, uint16 length, int log2, uint8 *out)
+{
+  SCL_Board board;
+
+  out[0] = log2;
+
+  SCL_boardInit(board);
+  for (uint16 i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    chess_filter_add(out, SCL_boardHash32(board));
+    if (i >= length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+}
+
+// false if no position of the game has this SCL_boardHash32
+static inline bool
+chessgame_may_contain(const ChessGame *cg, uint32 hash)
+{
+  const uint8 *filter;
+  uint32 mask;
+  uint32 step;
+
+  if (!(cg->flags & CHESSGAME_HAS_FILTER))
+    return true;
+
+  filter = CHESSGAME_FILTER(cg);
+  mask = (8u << filter[0]) - 1;
+  step = chess_filter_step(hash);
+  for (int k = 0; k < CHESS_FILTER_HASHES; k++)
+  {
+    uint32 bit = CHESS_FILTER_BIT(hash, step, k, mask);
+
+    if (!(filter[1 + bit / 8] & (1 << (bit % 8))))
+      return false;
+  }
+  return true;
+}
+
+/*****************************************************************************/
+
+// the end flag of the last move of a record mirrors the result
+static inline void
+chess_record_set_end(uint8 *last, uint8 result)
+{
+  *last &= 0x3f;
+  if (result == SCL_GAME_STATE_WHITE_WIN)
+    *last |= SCL_RECORD_W_WIN;
+  else if (result == SCL_GAME_STATE_BLACK_WIN)
+    *last |= SCL_RECORD_B_WIN;
+  else
+    *last |= SCL_RECORD_END;
+}
+
+// create a chessgame datatype out of a game record, its result and
+// optionally a serialized tag dictionary, in the given ChessStorageFormat
+static ChessGame *
+chessgame_make_format(SCL_Record record, uint8 result, const char *tags, Size tagsLength,
+                      int format)
+{
+  uint16_t length = SCL_recordLength(record);
+  uint16 prefixLength = 0;
+  int32 prefixId = -1;
+  uint8 *packed = NULL;
+  Size packedSize = 0;
+  Size movesSize;
+  Size checkpointsSize = 0;
+  int filterLog2 = 0;
+  Size filterSize = 0;
+  Size size;
+  ChessGame *cg;
+
+  if (format == CHESS_STORAGE_PACKED && length > 0)
+    packed = chess_moves_pack(record, length, &packedSize);
+  else if (format == CHESS_STORAGE_PREFIX && length >= CHESS_PREFIX_MIN_LENGTH)
+    prefixId = chess_prefix_find(record, length, &prefixLength);
+
+  if (packed != NULL)
+    movesSize = CHESSGAME_PACKED_HDRSZ + packedSize;
+  else if (prefixId >= 0)
+    movesSize = CHESSGAME_PREFIX_SIZE + (length - prefixLength) * 2;
+  else
+    movesSize = length * 2;
+
+  if (chess_checkpoint_interval > 0 && length > 0)
+    checkpointsSize = 2 + CHESSGAME_CHECKPOINT_COUNT(length, chess_checkpoint_interval) *
+                              CHESS_CHECKPOINT_SIZE;
+
+  if (chess_position_filter)
+  {
+    filterLog2 = chess_filter_log2(length);
+    filterSize = 1 + ((Size)1 << filterLog2);
+  }
+
+  size = CHESSGAME_HDRSZ + movesSize + checkpointsSize + filterSize + tagsLength;
+  cg = palloc0(size);
+  SET_VARSIZE(cg, size);
+  cg->length = length;
+  cg->result = result;
+
+  if (packed != NULL)
+  {
+    cg->flags |= CHESSGAME_PACKED;
+    cg->moves[0] = packedSize & 0xff;
+    cg->moves[1] = packedSize >> 8;
+    memcpy(CHESSGAME_MOVES(cg), packed, packedSize);
+  }
+  else
+  {
+    if (prefixId >= 0)
+    {
+      cg->flags |= CHESSGAME_HAS_PREFIX;
+      CHESSGAME_SET_PREFIX(cg, prefixId, prefixLength);
+    }
+
+    // Copy the used part of the record (after the prefix), the end flag of the
+    // last move mirrors the result
+    memcpy(CHESSGAME_MOVES(cg), record + prefixLength * 2, (length - prefixLength) * 2);
+    if (length > prefixLength)
+      chess_record_set_end(&CHESSGAME_MOVES(cg)[(length - prefixLength - 1) * 2], result);
+  }
+
+  if (checkpointsSize > 0)
+  {
+    cg->flags |= CHESSGAME_HAS_CHECKPOINTS;
+    chess_checkpoints_make(record, length, chess_checkpoint_interval, CHESSGAME_CHECKPOINTS(cg));
+  }
+
+  if (filterSize > 0)
+  {
+    cg->flags |= CHESSGAME_HAS_FILTER;
+    chess_filter_make(record, length, filterLog2, CHESSGAME_FILTER(cg));
+  }
+
+  if (tagsLength > 0)
+  {
+    cg->flags |= CHESSGAME_HAS_TAGS;
+    memcpy(CHESSGAME_TAGS(cg), tags, tagsLength);
+  }
+  return cg;
+}
+
+// a chessgame in the format of chess.storage_format
+static ChessGame *
+chessgame_make(SCL_Record record, uint8 result, const char *tags, Size tagsLength)
+{
+  return chessgame_make_format(record, result, tags, tagsLength, chess_storage_format);
+}
+
+// expand prefix or packed moves, see chessgame_get_record
+static void
+chessgame_expand_record(const ChessGame *cg, SCL_Record record)
+{
+  uint16 prefixLength = CHESSGAME_PREFIX_LENGTH(cg);
+
+  if (cg->flags & CHESSGAME_PACKED)
+  {
+    chess_moves_unpack(CHESSGAME_MOVES(cg), CHESSGAME_PACKED_SIZE(cg), cg->length, record);
+    chess_record_set_end(&record[(cg->length - 1) * 2], cg->result);
+    return;
+  }
+
+  chess_prefix_moves(CHESSGAME_PREFIX_ID(cg), record, prefixLength);
+  record[(prefixLength - 1) * 2] &= 0x3f;
+  memcpy(record + prefixLength * 2, CHESSGAME_MOVES(cg), (cg->length - prefixLength) * 2);
+  if (prefixLength == cg->length)
+    chess_record_set_end(&record[(cg->length - 1) * 2], cg->result);
+}
+
+/*
+Expand the stored moves of a chessgame into a full SCL_Record. Plainly
+stored moves are copied inline, other formats take a call.
+*/
+static inline void
+chessgame_get_record(const ChessGame *cg, SCL_Record record)
+{
+  if (cg->length == 0)
+    SCL_recordInit(record);
+  else if (likely(!(cg->flags & (CHESSGAME_HAS_PREFIX | CHESSGAME_PACKED))))
+    memcpy(record, cg->moves, cg->length * 2);
+  else
+    chessgame_expand_record(cg, record);
+}
+
+/*
+Board after the first ply half-moves of the game (at most its length),
+whose moves are in record, replayed from the nearest snapshot if any.
+*/
+static void
+chessgame_board_at(const ChessGame *cg, const SCL_Record record, uint16 ply, SCL_Board board)
+{
+  uint16 interval = CHESSGAME_CHECKPOINT_INTERVAL(cg);
+  uint16 start = 0;
+
+  if (interval > 0 && ply > 0 && (ply >= interval || ply == cg->length))
+  {
+    int checkpoint = ply == cg->length ? CHESSGAME_CHECKPOINT_COUNT(cg->length, interval) - 1
+                                       : ply / interval - 1;
+
+    chess_checkpoint_unpack(CHESSGAME_CHECKPOINTS(cg) + 2 + checkpoint * CHESS_CHECKPOINT_SIZE,
+                            board);
+    start = Min((checkpoint + 1) * interval, cg->length);
+  }
+  else
+    SCL_boardInit(board);
+
+  for (uint16 i = start; i < ply; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+}
+
+// the tags are read in the same pass, right before the movetext
+static ChessGame *
+chessgame_parse(char *pgn)
+{
+  SCL_Record record;
+  List *tags = NIL;
+  StringInfoData buf;
+  const char *movetext = pgn_read_tags(pgn, chess_store_tags ? &tags : NULL);
+  uint8 result = SCL_recordFromPGN(record, movetext);
+
+  initStringInfo(&buf);
+  chess_tags_serialize(tags, &buf);
+  return chessgame_make(record, result, buf.data, buf.len);
+}
+
+static const char *
+chess_result_to_str(uint8 result)
+{
+  switch (result)
+  {
+  case SCL_GAME_STATE_WHITE_WIN:
+    return "1-0";
+  case SCL_GAME_STATE_BLACK_WIN:
+    return "0-1";
+  case SCL_GAME_STATE_DRAW:
+    return "1/2-1/2";
+  default:
+    return "*";
+  }
+}
+
+static uint8
+chess_result_from_str(const char *str)
+{
+  if (strcmp(str, "1-0") == 0)
+    return SCL_GAME_STATE_WHITE_WIN;
+  if (strcmp(str, "0-1") == 0)
+    return SCL_GAME_STATE_BLACK_WIN;
+  if (strcmp(str, "1/2-1/2") == 0)
+    return SCL_GAME_STATE_DRAW;
+  if (strcmp(str, "*") == 0)
+    return SCL_GAME_STATE_PLAYING;
+
+  ereport(ERROR,
+          (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+           errmsg("invalid game result: \"%s\"", str),
+           errhint("Valid results are \"1-0\", \"0-1\", \"1/2-1/2\" and \"*\".")));
+  return SCL_GAME_STATE_PLAYING; /* keep compiler quiet */
+}
+
+static char *
+chessgame_to_str(const ChessGame *cg)
+{
+  SCL_Record record;
+  char *result = palloc0(sizeof(char) * CHESSGAME_PGN_MAX_LENGTH);
+  size_t len;
+  List *tags;
+
+  chessgame_get_record(cg, record);
+  SCL_printPGN(record, result, 0);
+
+  // SCL_printPGN ends the game with '*' (or '#' on mate), put the known result
+  // there so that it survives a dump and restore
+  if (cg->result != SCL_GAME_STATE_PLAYING)
+  {
+    len = strlen(result);
+    if (len > 0 && result[len - 1] == '*')
+      result[--len] = '\0';
+    if (len > 0)
+      result[len++] = ' ';
+    strcpy(result + len, chess_result_to_str(cg->result));
+  }
+
+  // stored tags are written back as a PGN header
+  tags = chessgame_get_tags(cg);
+  if (tags != NIL)
+  {
+    StringInfoData buf;
+    ListCell *lc;
+
+    initStringInfo(&buf);
+    foreach (lc, tags)
+    {
+      PGNTag *tag = (PGNTag *)lfirst(lc);
+
+      appendStringInfo(&buf, "[%s \"", tag->name);
+      for (const char *c = tag->value; *c; c++)
+      {
+        if (*c == '"' || *c == '\\')
+          appendStringInfoChar(&buf, '\\');
+        appendStringInfoChar(&buf, *c);
+      }
+      appendStringInfoString(&buf, "\"]\n");
+    }
+    appendStringInfoChar(&buf, '\n');
+    appendStringInfoString(&buf, result);
+    result = buf.data;
+  }
+  return result;
+}
+
+/*****************************************************************************/
+
+PG_FUNCTION_INFO_V1(chessgame_constructor_1_1);
+Datum chessgame_constructor_1_1(PG_FUNCTION_ARGS)
+{
+  char *pgn = PG_GETARG_CSTRING(0);
+  PG_RETURN_CHESSGAME_P(chessgame_parse(pgn));
+}
+
+/*********************************INPUT OUTPUT*****************************************/
+
+/* in out cast functions of chessgame */
+
+PG_FUNCTION_INFO_V1(chessgame_in_1_1);
+Datum chessgame_in_1_1(PG_FUNCTION_ARGS)
+{
+  char *str = PG_GETARG_CSTRING(0);
+  return PointerGetDatum(chessgame_parse(str));
+}
+
+PG_FUNCTION_INFO_V1(chessgame_out_1_1);
+Datum chessgame_out_1_1(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  char *result = chessgame_to_str(cg);
+  PG_FREE_IF_COPY(cg, 0);
+
+  PG_RETURN_CSTRING(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_cast_from_text_1_1);
+Datum chessgame_cast_from_text_1_1(PG_FUNCTION_ARGS)
+{
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  PG_RETURN_CHESSGAME_P(chessgame_parse(str));
+}
+
+/*
+chessgame_pack(chessgame) -> chessgame: The game in the packed archival
+format (see chess_moves_pack), e.g. for cold partitions.
+chessgame_compress(chessgame) -> chessgame: The game referring to the
+longest entry of chess_prefixes it starts with, if any (see the prefix
+dictionary), stored plainly otherwise.
+chessgame_unpack(chessgame) -> chessgame: The game with all its moves
+stored plainly, the fastest to decode.
+*/
+
+static ChessGame *
+chessgame_convert(const ChessGame *cg, int format)
+{
+  SCL_Record record;
+
+  chessgame_get_record(cg, record);
+  return chessgame_make_format(record, cg->result, (const char *)CHESSGAME_TAGS(cg),
+                               (cg->flags & CHESSGAME_HAS_TAGS) ? CHESSGAME_TAGS_SIZE(cg) : 0,
+                               format);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_pack);
+Datum chessgame_pack(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessGame *result = chessgame_convert(cg, CHESS_STORAGE_PACKED);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_CHESSGAME_P(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_compress);
+Datum chessgame_compress(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessGame *result = chessgame_convert(cg, CHESS_STORAGE_PREFIX);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_CHESSGAME_P(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_unpack);
+Datum chessgame_unpack(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessGame *result = chessgame_convert(cg, CHESS_STORAGE_PLAIN);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_CHESSGAME_P(result);
+}
+
+/*********************************Appending moves****************************/
+
+/*
+chessgame || text (game_append_move) adds a move, in SAN ("Nf3", "exd5",
+"O-O", "e8=Q+") or coordinates ("g1f3", "e7e8q"), to a game in progress.
+It is checked against the final board, the last of the checkpoints (see
+chessgame_board_at), which appended games always keep: a game without
+checkpoints gets them at chess.checkpoint_interval, or only the final
+board if that is 0. Only this first append replays the game, the others
+copy the stored bytes and add the move, a snapshot and a position to the
+filter (rebuilt only when it doubles). Packed games are encoded again.
+*/
+
+#define CHESS_FINAL_BOARD_INTERVAL PG_UINT16_MAX /* no snapshot but the final board */
+
+/*
+The legal move of the board written str, as the two bytes of its record
+item (see chess_legal_moves). A promotion without a piece is to a queen.
+*/
+static uint16
+chess_move_parse(SCL_Board board, const char *str)
+{
+  uint16 moves[CHESS_PACKED_MAX_MOVES];
+  int count = chess_legal_moves(board, moves);
+  char piece = 'P';
+  int8 fromFile = -1, fromRank = -1, toFile = -1, toRank = -1;
+  uint8 promotion = SCL_RECORD_PROM_Q;
+  int castle = 0;
+  int found = -1;
+  const char *c = str;
+
+  while (isspace((unsigned char)*c))
+    c++;
+
+  // coordinates: from and to squares, then the promotion piece
+  if (c[0] >= 'a' && c[0] <= 'h' && c[1] >= '1' && c[1] <= '8' && c[2] >= 'a' && c[2] <= 'h' &&
+      c[3] >= '1' && c[3] <= '8')
+  {
+    piece = '\0';
+    fromFile = c[0] - 'a';
+    fromRank = c[1] - '1';
+    toFile = c[2] - 'a';
+    toRank = c[3] - '1';
+    c += 4;
+    if (*c != '\0' && strchr("qrbnQRBN", *c) != NULL)
+    {
+      const char *p = strchr("qrbn", tolower((unsigned char)*c++));
+
+      promotion = (p - "qrbn") << 6;
+    }
+  }
+  else
+  {
+    if (*c != '\0' && strchr("KQRBN", *c) != NULL)
+      piece = *c++;
+    for (; *c != '\0' && strchr("+#!? \t\r\n", *c) == NULL; c++)
+    {
+      if (*c == 'O' || *c == '0')
+        castle++;
+      else if (strchr("QRBN", *c) != NULL)
+        promotion = (strchr("QRBN", *c) - "QRBN") << 6;
+      else if (*c >= 'a' && *c <= 'h')
+      {
+        fromFile = toFile;
+        toFile = *c - 'a';
+      }
+      else if (*c >= '1' && *c <= '8')
+      {
+        fromRank = toRank;
+        toRank = *c - '1';
+      }
+      else if (*c != 'x' && *c != '-' && *c != ':' && *c != '=')
+        break;
+    }
+    if (castle > 0)
+    {
+      piece = 'K';
+      fromFile = 4;
+      toFile = castle >= 3 ? 2 : 6;
+      fromRank = toRank = SCL_boardWhitesTurn(board) ? 0 : 7;
+    }
+  }
+  while (*c != '\0' && strchr("+#!? \t\r\n", *c) != NULL)
+    c++;
+
+  if (*c == '\0' && toFile >= 0 && toRank >= 0)
+    for (int i = 0; i < count; i++)
+    {
+      uint8 from = moves[i] & 0x3f;
+      uint8 to = (moves[i] >> 8) & 0x3f;
+      uint8 promoted = (moves[i] >> 8) & 0xc0;
+
+      if (to != toRank * 8 + toFile || (piece != '\0' && toupper(board[from]) != piece) ||
+          (fromFile >= 0 && from % 8 != fromFile) || (fromRank >= 0 && from / 8 != fromRank) ||
+          promoted != ((toupper(board[from]) == 'P' && (to / 8 == 0 || to / 8 == 7)) ? promotion : 0))
+        continue;
+      if (found >= 0)
+        ereport(ERROR,
+                (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+                 errmsg("ambiguous move \"%s\"", str)));
+      found = i;
+    }
+
+  if (found < 0)
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("illegal move \"%s\"", str)));
+  return moves[found];
+}
+
+static ChessGame *
+chessgame_append(const ChessGame *cg, const char *str)
+{
+  uint16 length = cg->length + 1;
+  uint16 interval = CHESSGAME_CHECKPOINT_INTERVAL(cg);
+  bool replayed = interval == 0 || cg->length == 0;
+  SCL_Record record;
+  SCL_Board board;
+  uint8 item[2];
+  uint8_t squareFrom, squareTo;
+  char promotedPiece;
+  uint16 move;
+  Size movesSize = CHESSGAME_MOVES_SIZE(cg);
+  Size checkpointsSize;
+  Size filterSize = CHESSGAME_FILTER_SIZE(cg);
+  Size tagsSize = CHESSGAME_TAGS_SIZE(cg);
+  int filterLog2 = 0;
+  Size size;
+  ChessGame *result;
+  uint8 *out;
+
+  if (cg->result != SCL_GAME_STATE_PLAYING)
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("cannot append a move to a finished game")));
+  if (length > SCL_RECORD_MAX_LENGTH)
+    ereport(ERROR,
+            (errcode(ERRCODE_PROGRAM_LIMIT_EXCEEDED),
+             errmsg("chessgame cannot have more than %d half-moves", SCL_RECORD_MAX_LENGTH)));
+
+  // the final board, replaying the game only if it has no snapshot
+  if (replayed || (cg->flags & CHESSGAME_PACKED))
+  {
+    chessgame_get_record(cg, record);
+    chessgame_board_at(cg, record, cg->length, board);
+  }
+  else
+    chess_checkpoint_unpack(CHESSGAME_CHECKPOINTS(cg) + 2 + (CHESSGAME_CHECKPOINT_COUNT(
+                                                                 cg->length, interval) - 1) *
+                                                                CHESS_CHECKPOINT_SIZE,
+                            board);
+
+  move = chess_move_parse(board, str);
+  item[0] = (move & 0xff) | SCL_RECORD_END;
+  item[1] = move >> 8;
+  squareFrom = item[0] & 0x3f;
+  squareTo = item[1] & 0x3f;
+  promotedPiece = "qrbn"[item[1] >> 6];
+  SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+
+  if (cg->flags & CHESSGAME_PACKED)
+  {
+    SCL_recordAdd(record, squareFrom, squareTo, promotedPiece, SCL_RECORD_CONT);
+    return chessgame_make_format(record, cg->result, (const char *)CHESSGAME_TAGS(cg),
+                                 (cg->flags & CHESSGAME_HAS_TAGS) ? tagsSize : 0,
+                                 CHESS_STORAGE_PACKED);
+  }
+  if (replayed)
+    SCL_recordAdd(record, squareFrom, squareTo, promotedPiece, SCL_RECORD_CONT);
+  if (interval == 0)
+    interval = chess_checkpoint_interval > 0 ? chess_checkpoint_interval
+                                             : CHESS_FINAL_BOARD_INTERVAL;
+  checkpointsSize = 2 + CHESSGAME_CHECKPOINT_COUNT(length, interval) * CHESS_CHECKPOINT_SIZE;
+  if (filterSize > 0)
+  {
+    filterLog2 = chess_filter_log2(length);
+    filterSize = 1 + ((Size)1 << filterLog2);
+  }
+
+  size = CHESSGAME_HDRSZ + movesSize + 2 + checkpointsSize + filterSize + tagsSize;
+  result = palloc0(size);
+  SET_VARSIZE(result, size);
+  result->length = length;
+  result->result = cg->result;
+  result->flags = cg->flags | CHESSGAME_HAS_CHECKPOINTS;
+
+  // the previous last move loses its end flag, unless it is in the prefix entry
+  memcpy(result->moves, cg->moves, movesSize);
+  if (cg->length > CHESSGAME_PREFIX_LENGTH(cg))
+    result->moves[movesSize - 2] &= 0x3f;
+  result->moves[movesSize] = item[0];
+  result->moves[movesSize + 1] = item[1];
+
+  out = CHESSGAME_CHECKPOINTS(result);
+  if (replayed)
+    chess_checkpoints_make(record, length, interval, out);
+  else
+  {
+    int kept = Min(CHESSGAME_CHECKPOINT_COUNT(cg->length, interval), cg->length / interval);
+
+    memcpy(out, CHESSGAME_CHECKPOINTS(cg), 2 + kept * CHESS_CHECKPOINT_SIZE);
+    chess_checkpoint_pack(board, out + 2 + (CHESSGAME_CHECKPOINT_COUNT(length, interval) - 1) *
+                                               CHESS_CHECKPOINT_SIZE);
+  }
+
+  out = CHESSGAME_FILTER(result);
+  if (filterSize > 0 && filterLog2 == CHESSGAME_FILTER(cg)[0])
+  {
+    memcpy(out, CHESSGAME_FILTER(cg), filterSize);
+    chess_filter_add(out, SCL_boardHash32(board));
+  }
+  else if (filterSize > 0)
+  {
+    if (!replayed)
+      chessgame_get_record(result, record);
+    chess_filter_make(record, length, filterLog2, out);
+  }
+
+  memcpy(CHESSGAME_TAGS(result), CHESSGAME_TAGS(cg), tagsSize);
+  return result;
+}
+
+/*
+game_append_move(chessgame, text) -> chessgame, or chessgame || text: The
+game followed by the move, see chessgame_append.
+*/
+PG_FUNCTION_INFO_V1(game_append_move);
+Datum game_append_move(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  ChessGame *result = chessgame_append(cg, str);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_CHESSGAME_P(result);
+}
+
+/*********************************Shared cache*********************************/
+
+/*
+With chess.shared_cache_size > 0 (chess must then be in
+shared_preload_libraries) the backends share two tables in shared memory:
+the boards reached by game prefixes, for getBoard, and the results of
+complete engine searches, for chessboard_eval, chessboard_bestmove and
+game_eval_curve. Both are direct-mapped, an entry replaces whatever was
+in its slot. Slot i of either table is guarded by the LWLock
+i % CHESS_CACHE_PARTITIONS, so that lookups of different positions rarely
+wait for each other.
+*/
+
+#define CHESS_CACHE_PARTITIONS 64
+
+typedef struct
+{
+  uint64 key;   /* chess_cache_board_key, 0 if empty */
+  uint64 check; /* the same with another seed, against collisions of keys */
+  uint16 ply;
+  SCL_Board board;
+} ChessCacheBoard;
+
+typedef struct
+{
+  uint64 key; /* chess_cache_search_key, 0 if empty */
+  int16 score;
+  uint8 squareFrom; /* best move */
+  uint8 squareTo;
+} ChessCacheSearch;
+
+typedef struct
+{
+  uint64 boardMask;  /* number of board entries - 1 */
+  uint64 searchMask; /* number of search entries - 1 */
+} ChessCacheHeader;
+
+/* NULL when there is no shared cache */
+static ChessCacheHeader *chess_cache = NULL;
+static ChessCacheBoard *chess_cache_boards;
+static ChessCacheSearch *chess_cache_searches;
+static LWLockPadded *chess_cache_locks;
+
+// half of chess.shared_cache_size for each table, rounded down to powers of two
+static void
+chess_cache_entries(uint64 *boardEntries, uint64 *searchEntries)
+{
+  Size bytes = (Size)chess_shared_cache_size * 1024 / 2;
+
+  *boardEntries = pg_prevpower2_64(Max(bytes / sizeof(ChessCacheBoard), 1));
+  *searchEntries = pg_prevpower2_64(Max(bytes / sizeof(ChessCacheSearch), 1));
+}
+
+static Size
+chess_cache_shmem_size(void)
+{
+  uint64 boardEntries, searchEntries;
+
+  chess_cache_entries(&boardEntries, &searchEntries);
+  return add_size(MAXALIGN(sizeof(ChessCacheHeader)),
+                  add_size(mul_size(boardEntries, sizeof(ChessCacheBoard)),
+                           mul_size(searchEntries, sizeof(ChessCacheSearch))));
+}
+
+static void
+chess_cache_shmem_request(void)
+{
+#if PG_VERSION_NUM >= 150000
+  if (prev_shmem_request_hook)
+    prev_shmem_request_hook();
+#endif
+
+  RequestAddinShmemSpace(chess_cache_shmem_size());
+  RequestNamedLWLockTranche("chess", CHESS_CACHE_PARTITIONS);
+}
+
+static void
+chess_cache_shmem_startup(void)
+{
+  uint64 boardEntries, searchEntries;
+  bool found;
+
+  if (prev_shmem_startup_hook)
+    prev_shmem_startup_hook();
+
+  chess_cache_entries(&boardEntries, &searchEntries);
+
+  LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+  chess_cache = ShmemInitStruct("chess cache", chess_cache_shmem_size(), &found);
+  chess_cache_boards = (ChessCacheBoard *)((char *)chess_cache +
+                                           MAXALIGN(sizeof(ChessCacheHeader)));
+  chess_cache_searches = (ChessCacheSearch *)(chess_cache_boards + boardEntries);
+  if (!found)
+  {
+    memset(chess_cache, 0, chess_cache_shmem_size());
+    chess_cache->boardMask = boardEntries - 1;
+    chess_cache->searchMask = searchEntries - 1;
+  }
+  chess_cache_locks = GetNamedLWLockTranche("chess");
+  LWLockRelease(AddinShmemInitLock);
+}
+
+static inline LWLock *
+chess_cache_lock(uint64 slot)
+{
+  return &chess_cache_locks[slot % CHESS_CACHE_PARTITIONS].lock;
+}
+
+#define CHESS_CACHE_KEY_SEED 0
+#define CHESS_CACHE_CHECK_SEED UINT64CONST(0x9e3779b97f4a7c15)
+
+/*
+Key of the board after the first ply > 0 moves of a game, computed from
+the stored moves so that a hit decodes nothing. Moves stored plainly are
+hashed up to ply, without the end flags of the last one, so that a game
+and its continuations share the entry. Prefix references and packed
+moves are hashed whole, with the ply.
+*/
+static uint64
+chess_cache_board_key(const ChessGame *cg, uint16 ply, uint64 seed)
+{
+  uint8 format = cg->flags & (CHESSGAME_HAS_PREFIX | CHESSGAME_PACKED);
+  uint64 key;
+
+  if (format == 0)
+  {
+    key = hash_bytes_extended(cg->moves, (ply - 1) * 2, seed + ply);
+    key = hash_combine64(key, (cg->moves[(ply - 1) * 2] & 0x3f) | (cg->moves[ply * 2 - 1] << 8));
+  }
+  else
+  {
+    key = hash_bytes_extended(cg->moves, CHESSGAME_MOVES_SIZE(cg), seed + format);
+    key = hash_combine64(key, ply);
+  }
+  return key != 0 ? key : 1;
+}
+
+/*
+Key of a deterministic search of the board (clocks included) to the given
+depth, by root splitting or iterative deepening, which may pick different
+moves among equally scored ones.
+*/
+static uint64
+chess_cache_search_key(const SCL_Board board, int32 depth, bool rootSplit)
+{
+  uint64 key = hash_bytes_extended((const unsigned char *)board, SCL_BOARD_STATE_SIZE,
+                                   depth | (rootSplit ? 0x100 : 0));
+
+  return key != 0 ? key : 1;
+}
+
+static bool
+chess_cache_get_board(uint64 key, uint64 check, uint16 ply, SCL_Board board)
+{
+  uint64 slot;
+  bool found;
+
+  if (chess_cache == NULL)
+    return false;
+
+  slot = key & chess_cache->boardMask;
+  LWLockAcquire(chess_cache_lock(slot), LW_SHARED);
+  found = chess_cache_boards[slot].key == key && chess_cache_boards[slot].check == check &&
+          chess_cache_boards[slot].ply == ply;
+  if (found)
+    memcpy(board, chess_cache_boards[slot].board, SCL_BOARD_STATE_SIZE);
+  LWLockRelease(chess_cache_lock(slot));
+  return found;
+}
+
+static void
+chess_cache_put_board(uint64 key, uint64 check, uint16 ply, const SCL_Board board)
+{
+  uint64 slot;
+
+  if (chess_cache == NULL)
+    return;
+
+  slot = key & chess_cache->boardMask;
+  LWLockAcquire(chess_cache_lock(slot), LW_EXCLUSIVE);
+  chess_cache_boards[slot].key = key;
+  chess_cache_boards[slot].check = check;
+  chess_cache_boards[slot].ply = ply;
+  memcpy(chess_cache_boards[slot].board, board, SCL_BOARD_STATE_SIZE);
+  LWLockRelease(chess_cache_lock(slot));
+}
+
+static bool
+chess_cache_get_search(uint64 key, uint8_t *squareFrom, uint8_t *squareTo, int16_t *score)
+{
+  uint64 slot;
+  bool found;
+
+  if (chess_cache == NULL)
+    return false;
+
+  slot = key & chess_cache->searchMask;
+  LWLockAcquire(chess_cache_lock(slot), LW_SHARED);
+  found = chess_cache_searches[slot].key == key;
+  if (found)
+  {
+    *squareFrom = chess_cache_searches[slot].squareFrom;
+    *squareTo = chess_cache_searches[slot].squareTo;
+    *score = chess_cache_searches[slot].score;
+  }
+  LWLockRelease(chess_cache_lock(slot));
+  return found;
+}
+
+static void
+chess_cache_put_search(uint64 key, uint8_t squareFrom, uint8_t squareTo, int16_t score)
+{
+  uint64 slot;
+
+  if (chess_cache == NULL)
+    return;
+
+  slot = key & chess_cache->searchMask;
+  LWLockAcquire(chess_cache_lock(slot), LW_EXCLUSIVE);
+  chess_cache_searches[slot].key = key;
+  chess_cache_searches[slot].squareFrom = squareFrom;
+  chess_cache_searches[slot].squareTo = squareTo;
+  chess_cache_searches[slot].score = score;
+  LWLockRelease(chess_cache_lock(slot));
+}
+
+/*********************************Functions*****************************/
+/*
+getBoard(chessgame, integer) -> chessboard: Return the board state
+at a given half-move (A full move is counted only when both players
+have played). The integer parameter indicates the count of half
+moves since the beginning of the game. A 0 value of this parameter
+means the initial board state, i.e.,(
+rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1).
+Games stored with checkpoints are replayed from the nearest one.
+*/
+
+PG_FUNCTION_INFO_V1(getBoard_1_1);
+Datum getBoard_1_1(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  int halfMove = PG_GETARG_INT32(1);
+
+  ChessBoard *cb = palloc0(sizeof(ChessBoard));
+  uint16 ply = Min((uint16)halfMove, cg->length);
+  uint64 key = 0;
+  uint64 check = 0;
+
+  // the moves are only decoded on a miss
+  if (ply > 0 && chess_cache != NULL)
+  {
+    key = chess_cache_board_key(cg, ply, CHESS_CACHE_KEY_SEED);
+    check = chess_cache_board_key(cg, ply, CHESS_CACHE_CHECK_SEED);
+  }
+
+  if (key == 0 || !chess_cache_get_board(key, check, ply, cb->board))
+  {
+    SCL_Record record;
+
+    chessgame_get_record(cg, record);
+    chessgame_board_at(cg, record, ply, cb->board);
+    if (key != 0)
+      chess_cache_put_board(key, check, ply, cb->board);
+  }
+
+  PG_FREE_IF_COPY(cg, 0);
+
+  PG_RETURN_CHESSBOARD_P(cb);
+}
+
+/**
+  getFirstMoves(chessgame, integer) -> chessgame: Returns the
+  chessgame truncated to its first N half-moves. This function may also
+  be called getOpening(...). Again the integer parameter is zero based.
+*/
+
+PG_FUNCTION_INFO_V1(getFirstMoves_1_1);
+Datum getFirstMoves_1_1(PG_FUNCTION_ARGS)
+{
+  ChessGame *originalGame = PG_GETARG_CHESSGAME_P(0);
+  int nOfHalfMoves = PG_GETARG_INT32(1);
+  SCL_Record record;
+  uint8 result = originalGame->result;
+
+  chessgame_get_record(originalGame, record);
+
+  int shouldContinue = 1;
+  uint16_t length = SCL_recordLength(record);
+  for (uint16_t i = 0; i < (length - nOfHalfMoves) && shouldContinue; i++)
+  {
+    shouldContinue = SCL_recordRemoveLast(record);
+    // a truncated game has no result yet
+    result = SCL_GAME_STATE_PLAYING;
+  }
+  PG_FREE_IF_COPY(originalGame, 0);
+
+  PG_RETURN_CHESSGAME_P(chessgame_make(record, result, NULL, 0));
+}
+
+/*
+game_result(chessgame) -> text: Returns the result of the game as
+given by the PGN termination marker: 1-0, 0-1, 1/2-1/2 or * when the
+result is unknown.
+*/
+
+PG_FUNCTION_INFO_V1(game_result);
+Datum game_result(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  const char *result = chess_result_to_str(cg->result);
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_TEXT_P(cstring_to_text(result));
+}
+
+/*
+pgn_tags(text) -> jsonb: Returns the tag pairs of a PGN header as a
+jsonb object, e.g. {"Event": "...", "WhiteElo": "2700"}.
+*/
+
+PG_FUNCTION_INFO_V1(pgn_tags);
+Datum pgn_tags(PG_FUNCTION_ARGS)
+{
+  char *pgn = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  List *tags = NIL;
+
+  pgn_read_tags(pgn, &tags);
+
+  PG_RETURN_JSONB_P(chess_tags_to_jsonb(tags));
+}
+
+/*
+game_tags(chessgame) -> jsonb: Returns the PGN tags stored with the game
+(see chess.store_tags), as pgn_tags does for PGN text.
+*/
+
+PG_FUNCTION_INFO_V1(game_tags);
+Datum game_tags(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  Jsonb *result = chess_tags_to_jsonb(chessgame_get_tags(cg));
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_JSONB_P(result);
+}
+
+/*
+game_tag(chessgame, text) -> text: Returns the value of a single PGN tag
+stored with the game, or NULL when the game has no such tag.
+*/
+
+PG_FUNCTION_INFO_V1(game_tag);
+Datum game_tag(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  char *wanted = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  int wantedLength = strlen(wanted);
+  const uint8 *pos;
+  const uint8 *end;
+  const char *name;
+  const char *value;
+  int nameLength;
+  int valueLength;
+
+  if (cg->flags & CHESSGAME_HAS_TAGS)
+  {
+    // look the tag up directly in the stored dictionary
+    pos = CHESSGAME_TAGS(cg);
+    end = pos + CHESSGAME_TAGS_SIZE(cg);
+    while (chessgame_tags_next(&pos, end, &name, &nameLength, &value, &valueLength))
+    {
+      if (nameLength == wantedLength && memcmp(name, wanted, nameLength) == 0)
+      {
+        text *result = cstring_to_text_with_len(value, valueLength);
+        PG_FREE_IF_COPY(cg, 0);
+        PG_RETURN_TEXT_P(result);
+      }
+    }
+  }
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_NULL();
+}
+
+PG_FUNCTION_INFO_V1(chessgame_has_result);
+Datum chessgame_has_result(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  bool result = cg->result == chess_result_from_str(str);
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(result);
+}
+
+static bool
+chessgameContainsChessboard(ChessGame *cg, ChessBoard *cb, int halfMoves)
+{
+  SCL_Record record;
+  SCL_Board board;
+  uint32_t target = SCL_boardHash32(cb->board);
+
+  if (!chessgame_may_contain(cg, target))
+    return false;
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+
+  if (halfMoves > cg->length)
+    halfMoves = cg->length;
+
+  // replay the game once, checking every position on the way
+  for (uint16_t i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    if (SCL_boardHash32(board) == target)
+      return true;
+    if (i >= halfMoves)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+  return false;
+}
+
+/*
+Two boards hold the same position when the pieces, the player to move, the
+castling rights and a possible en passant capture are the same, whatever
+the ply and 50 move counters say.
+*/
+static inline bool
+chessboard_same_position(const SCL_Board a, const SCL_Board b)
+{
+  return memcmp(a, b, SCL_BOARD_SQUARES) == 0 &&
+         ((uint8)a[SCL_BOARD_PLY_BYTE] % 2) == ((uint8)b[SCL_BOARD_PLY_BYTE] % 2) &&
+         ((uint8)a[SCL_BOARD_ENPASSANT_CASTLE_BYTE] & 0xf0) == ((uint8)b[SCL_BOARD_ENPASSANT_CASTLE_BYTE] & 0xf0) &&
+         SCL_boardEnPassantColumn(a) == SCL_boardEnPassantColumn(b);
+}
+
+static bool
+chessgameReachesChessboard(ChessGame *cg, ChessBoard *cb)
+{
+  SCL_Record record;
+  SCL_Board board;
+  uint64_t target = SCL_boardHash64(cb->board);
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+
+  for (uint16_t i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    if (SCL_boardHash64(board) == target && chessboard_same_position(board, cb->board))
+      return true;
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+  return false;
+}
+
+static bool
+chessgame_contains_chessgame(ChessGame *c1, ChessGame *c2)
+{
+  SCL_Record record1;
+  SCL_Record record2;
+
+  // Get number of half moves of the 1st chess game
+  uint16_t length1 = c1->length;
+
+  // Get number of half moves of the 2nd chess game
+  uint16_t length2 = c2->length;
+
+  if (length2 > length1)
+  {
+    return false;
+  }
+
+  // games stored against the same prefix entry only differ after it
+  if (CHESSGAME_PREFIX_LENGTH(c1) > 0 && CHESSGAME_PREFIX_LENGTH(c2) > 0 &&
+      CHESSGAME_PREFIX_ID(c1) == CHESSGAME_PREFIX_ID(c2))
+  {
+    const uint8 *moves1 = CHESSGAME_MOVES(c1);
+    const uint8 *moves2 = CHESSGAME_MOVES(c2);
+
+    for (uint16_t i = 0; i < length2 - CHESSGAME_PREFIX_LENGTH(c2); i++)
+      if (CHESS_MOVE_ITEM(moves1, i) != CHESS_MOVE_ITEM(moves2, i))
+        return false;
+    return true;
+  }
+
+  chessgame_get_record(c1, record1);
+  chessgame_get_record(c2, record2);
+
+  // Check if the chessgame matches with minLength, promotions included
+  for (uint16_t i = 0; i < length2; i++)
+  {
+    if (CHESS_MOVE_ITEM(record1, i) != CHESS_MOVE_ITEM(record2, i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+Moves of a ~> or ~>> query as CHESS_MOVE_ITEM values: those of a game, or moves
+in coordinates separated by spaces ("h5h7 g8h7 f3g5"), which unlike SAN
+do not need the position they are played from. Returns their number.
+*/
+static int
+chess_sequence_items(Datum query, bool isText, uint16 *items)
+{
+  int count = 0;
+
+  if (!isText)
+  {
+    ChessGame *cg = DatumGetChessGameP(query);
+    SCL_Record record;
+
+    chessgame_get_record(cg, record);
+    for (; count < cg->length; count++)
+      items[count] = CHESS_MOVE_ITEM(record, count);
+    return count;
+  }
+
+  for (const char *c = text_to_cstring(DatumGetTextPP(query));; count++)
+  {
+    while (isspace((unsigned char)*c))
+      c++;
+    if (*c == '\0')
+      break;
+    if (count >= SCL_RECORD_MAX_LENGTH || c[0] < 'a' || c[0] > 'h' || c[1] < '1' || c[1] > '8' ||
+        c[2] < 'a' || c[2] > 'h' || c[3] < '1' || c[3] > '8')
+      ereport(ERROR,
+              (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+               errmsg("invalid move sequence \"%s\"", text_to_cstring(DatumGetTextPP(query))),
+               errhint("Moves are written as their origin and target squares, e.g. \"e2e4 e7e5\".")));
+    items[count] = ((c[0] - 'a') + (c[1] - '1') * 8) | ((c[2] - 'a') + (c[3] - '1') * 8) << 8;
+    c += 4;
+    if (*c != '\0' && strchr("qrbn", tolower((unsigned char)*c)) != NULL)
+      items[count] |= (strchr("qrbn", tolower((unsigned char)*c++)) - "qrbn") << 14;
+  }
+  return count;
+}
+
+// true if the moves are played in a row anywhere in the game
+static bool
+chessgameContainsSequence(const ChessGame *cg, const uint16 *items, int count)
+{
+  SCL_Record record;
+
+  if (count > cg->length)
+    return false;
+  if (count == 0)
+    return true;
+
+  chessgame_get_record(cg, record);
+
+  for (uint16 start = 0; start + count <= cg->length; start++)
+  {
+    int i = 0;
+
+    while (i < count && CHESS_MOVE_ITEM(record, start + i) == items[i])
+      i++;
+    if (i == count)
+      return true;
+  }
+  return false;
+}
+
+PG_FUNCTION_INFO_V1(chessgameContainsChessgame_1_1);
+Datum chessgameContainsChessgame_1_1(PG_FUNCTION_ARGS)
+{
+  ChessGame *c1 = PG_GETARG_CHESSGAME_P(0);
+  ChessGame *c2 = PG_GETARG_CHESSGAME_P(1);
+  bool result = chessgame_contains_chessgame(c1, c2);
+  PG_FREE_IF_COPY(c1, 0);
+  PG_FREE_IF_COPY(c2, 1);
+  PG_RETURN_BOOL(result);
+}
+
+/*
+chessgame_contains_sequence(chessgame, chessgame) -> boolean (~>): True if
+the moves of the second game are played in a row at any point of the
+first one.
+chessgame_contains_moves(chessgame, text) -> boolean (~>>): The same for
+moves in coordinates, e.g. 'h5h7 g8h7 f3g5'.
+*/
+
+PG_FUNCTION_INFO_V1(chessgame_contains_sequence);
+Datum chessgame_contains_sequence(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  uint16 items[SCL_RECORD_MAX_LENGTH];
+  int count = chess_sequence_items(PG_GETARG_DATUM(1), false, items);
+  bool result = chessgameContainsSequence(cg, items, count);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_contains_moves);
+Datum chessgame_contains_moves(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  uint16 items[SCL_RECORD_MAX_LENGTH];
+  int count = chess_sequence_items(PG_GETARG_DATUM(1), true, items);
+  bool result = chessgameContainsSequence(cg, items, count);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(result);
+}
+
+/*********************************Material*************************************/
+
+// position of a non-king piece in the material signature, -1 otherwise
+static inline int
+chess_material_index(char piece)
+{
+  switch (piece)
+  {
+  case 'P': return 0;
+  case 'N': return 1;
+  case 'B': return 2;
+  case 'R': return 3;
+  case 'Q': return 4;
+  case 'p': return 5;
+  case 'n': return 6;
+  case 'b': return 7;
+  case 'r': return 8;
+  case 'q': return 9;
+  default: return -1;
+  }
+}
+
+// material signature of a board, see CHESS_MATERIAL_SHIFT
+static uint64
+chess_material_signature(SCL_Board board)
+{
+  uint8_t counts[10] = {0};
+  uint64 signature = 0;
+
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i)
+  {
+    int piece = chess_material_index(board[i]);
+    if (piece >= 0 && counts[piece] < 15)
+      counts[piece]++;
+  }
+  for (int i = 0; i < 10; i++)
+    signature |= (uint64)counts[i] << CHESS_MATERIAL_SHIFT(i);
+  return signature;
+}
+
+/*
+Parse a material balance: either both sides separated by 'v' or "vs",
+white first ("KRPvKR", "KRP vs KR"), or case-sensitive pieces ("KRPkr").
+Kings are optional and ignored.
+*/
+static uint64
+chess_material_parse(const char *str)
+{
+  uint8_t counts[10] = {0};
+  uint64 signature = 0;
+  bool sides = strchr(str, 'v') != NULL || strchr(str, 'V') != NULL;
+  bool black = false;
+
+  for (const char *p = str; *p != '\0'; p++)
+  {
+    char c = *p;
+    int piece;
+
+    if (isspace((unsigned char)c))
+      continue;
+    if (sides && (c == 'v' || c == 'V'))
+    {
+      if (black)
+        goto bad;
+      black = true;
+      if (p[1] == 's' || p[1] == 'S')
+        p++;
+      continue;
+    }
+    if (sides)
+      c = black ? tolower((unsigned char)c) : toupper((unsigned char)c);
+    if (c == 'K' || c == 'k')
+      continue;
+
+    piece = chess_material_index(c);
+    if (piece < 0 || counts[piece] == 15)
+      goto bad;
+    counts[piece]++;
+  }
+
+  for (int i = 0; i < 10; i++)
+    signature |= (uint64)counts[i] << CHESS_MATERIAL_SHIFT(i);
+  return signature;
+
+bad:
+  ereport(ERROR,
+          (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+           errmsg("invalid material balance: \"%s\"", str),
+           errhint("Use pieces of both sides, such as \"KRPvKR\" or \"KRPkr\".")));
+  return 0; /* keep compiler quiet */
+}
+
+/*********************************Move tokens**********************************/
+
+/*
+A move is summarized by a token (see CHESS_MOVE_TOKEN) matched by
+patterns in SAN with wildcards: a piece letter ('*' for any, none for a
+pawn), an optional origin file, rank or square, 'x' if the move has to
+capture, the target square, '=' and a promotion piece, then '+' or '#'
+if it has to give check or mate. '?' stands for any file, rank or
+promotion piece, e.g. 'Bxh7+', 'Q??' (any queen move), '*xf7', 'e8=?' or
+'O-O-O'. Without 'x', '+' or '#' the move may capture or give check.
+*/
+
+static const char chess_move_pieces[] = "PNBRQK";
+
+typedef struct
+{
+  int8 piece;     /* index in chess_move_pieces, -1 for any */
+  int8 fromFile;  /* -1 for any, as the other squares */
+  int8 fromRank;
+  int8 toFile;
+  int8 toRank;
+  int8 promotion; /* 1 to 4 for QRBN, -1 for any or none, -2 for any */
+  uint8 flags;    /* CHESS_MOVE_* flags the move must have */
+} ChessMovePattern;
+
+// token of the move, then made on the board
+static uint32
+chess_move_token_make(SCL_Board board, uint8 squareFrom, uint8 squareTo, char promotedPiece)
+{
+  char piece = toupper((unsigned char)board[squareFrom]);
+  uint8 promotion = 0;
+  uint8 flags = 0;
+
+  if (board[squareTo] != '.' || (piece == 'P' && squareFrom % 8 != squareTo % 8))
+    flags |= CHESS_MOVE_CAPTURE;
+  if (piece == 'P' && (squareTo / 8 == 0 || squareTo / 8 == 7))
+    promotion = strchr("qrbn", tolower((unsigned char)promotedPiece)) - "qrbn" + 1;
+
+  SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  if (SCL_boardCheck(board, SCL_boardWhitesTurn(board)))
+  {
+    flags |= CHESS_MOVE_CHECK;
+    if (!SCL_boardMovePossible(board))
+      flags |= CHESS_MOVE_MATE;
+  }
+
+  return CHESS_MOVE_TOKEN(strchr(chess_move_pieces, piece) - chess_move_pieces, squareFrom,
+                          squareTo, promotion, flags);
+}
+
+static void
+chess_move_pattern_parse(const char *str, ChessMovePattern *pattern)
+{
+  const char *c = str;
+  char squares[4];
+  int count = 0;
+
+  pattern->piece = 0;
+  pattern->fromFile = pattern->fromRank = pattern->toFile = pattern->toRank = -1;
+  pattern->promotion = -1;
+  pattern->flags = 0;
+
+  while (isspace((unsigned char)*c))
+    c++;
+
+  if (strncmp(c, "O-O", 3) == 0 || strncmp(c, "0-0", 3) == 0)
+  {
+    pattern->piece = strchr(chess_move_pieces, 'K') - chess_move_pieces;
+    pattern->fromFile = 4;
+    pattern->toFile = strncmp(c + 3, "-O", 2) == 0 || strncmp(c + 3, "-0", 2) == 0 ? 2 : 6;
+    c += pattern->toFile == 2 ? 5 : 3;
+  }
+  else
+  {
+    if (*c == '*')
+      pattern->piece = -1;
+    else if (*c != '\0' && strchr("NBRQK", *c) != NULL)
+      pattern->piece = strchr(chess_move_pieces, *c) - chess_move_pieces;
+    if (pattern->piece != 0 || *c == 'P')
+      c++;
+
+    // origin and target squares: files, ranks and wildcards
+    for (; *c != '\0' && strchr("abcdefgh12345678?x-", *c) != NULL; c++)
+    {
+      if (*c == 'x')
+        pattern->flags |= CHESS_MOVE_CAPTURE;
+      else if (*c != '-' && count < 4)
+        squares[count++] = *c;
+      else if (*c != '-')
+        count = 5;
+    }
+    if (count < 2 || count > 4 || strchr("abcdefgh?", squares[count - 2]) == NULL ||
+        strchr("12345678?", squares[count - 1]) == NULL)
+      ereport(ERROR,
+              (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+               errmsg("invalid move pattern \"%s\"", str)));
+    if (squares[count - 2] != '?')
+      pattern->toFile = squares[count - 2] - 'a';
+    if (squares[count - 1] != '?')
+      pattern->toRank = squares[count - 1] - '1';
+    for (int i = 0; i < count - 2; i++)
+      if (squares[i] >= 'a' && squares[i] <= 'h')
+        pattern->fromFile = squares[i] - 'a';
+      else if (squares[i] >= '1' && squares[i] <= '8')
+        pattern->fromRank = squares[i] - '1';
+
+    if (*c == '=' && c[1] != '\0' && strchr("QRBN?", c[1]) != NULL)
+    {
+      pattern->promotion = c[1] == '?' ? -2 : strchr("QRBN", c[1]) - "QRBN" + 1;
+      c += 2;
+    }
+  }
+
+  if (*c == '+')
+    pattern->flags |= CHESS_MOVE_CHECK;
+  else if (*c == '#')
+    pattern->flags |= CHESS_MOVE_CHECK | CHESS_MOVE_MATE;
+  if (*c == '+' || *c == '#')
+    c++;
+  while (isspace((unsigned char)*c))
+    c++;
+  if (*c != '\0')
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("invalid move pattern \"%s\"", str)));
+}
+
+static bool
+chess_move_pattern_match(const ChessMovePattern *pattern, uint32 token)
+{
+  uint8 from = CHESS_MOVE_TOKEN_FROM(token);
+  uint8 to = CHESS_MOVE_TOKEN_TO(token);
+  uint8 promotion = CHESS_MOVE_TOKEN_PROMOTION(token);
+
+  return (pattern->piece < 0 || CHESS_MOVE_TOKEN_PIECE(token) == pattern->piece) &&
+         (pattern->fromFile < 0 || from % 8 == pattern->fromFile) &&
+         (pattern->fromRank < 0 || from / 8 == pattern->fromRank) &&
+         (pattern->toFile < 0 || to % 8 == pattern->toFile) &&
+         (pattern->toRank < 0 || to / 8 == pattern->toRank) &&
+         (pattern->promotion == -1 || (pattern->promotion == -2 ? promotion != 0
+                                                                : promotion == pattern->promotion)) &&
+         (CHESS_MOVE_TOKEN_FLAGS(token) & pattern->flags) == pattern->flags;
+}
+
+/*
+Smallest token that can match the pattern and the mask of its bits that
+all the matching tokens share: the piece, then the target and origin
+squares, as long as they are fully given.
+*/
+static uint32
+chess_move_pattern_prefix(const ChessMovePattern *pattern, uint32 *mask)
+{
+  uint32 token = 0;
+
+  *mask = 0;
+  if (pattern->piece < 0)
+    return token;
+  token |= CHESS_MOVE_TOKEN(pattern->piece, 0, 0, 0, 0);
+  *mask |= CHESS_MOVE_TOKEN(0x07, 0, 0, 0, 0);
+  if (pattern->toFile < 0 || pattern->toRank < 0)
+    return token;
+  token |= CHESS_MOVE_TOKEN(0, 0, pattern->toRank * 8 + pattern->toFile, 0, 0);
+  *mask |= CHESS_MOVE_TOKEN(0, 0, 0x3f, 0, 0);
+  if (pattern->fromFile < 0 || pattern->fromRank < 0)
+    return token;
+  token |= CHESS_MOVE_TOKEN(0, pattern->fromRank * 8 + pattern->fromFile, 0, 0, 0);
+  *mask |= CHESS_MOVE_TOKEN(0, 0x3f, 0, 0, 0);
+  return token;
+}
+
+/*
+game_has_move(chessgame, text) -> boolean (@!): True if a move of the game
+matches the pattern, e.g. 'Bxh7+'.
+*/
+PG_FUNCTION_INFO_V1(game_has_move);
+Datum game_has_move(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  ChessMovePattern pattern;
+  SCL_Record record;
+  SCL_Board board;
+  bool result = false;
+
+  chess_move_pattern_parse(str, &pattern);
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+
+  for (uint16 i = 0; i < cg->length && !result; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    result = chess_move_pattern_match(
+        &pattern, chess_move_token_make(board, squareFrom, squareTo, promotedPiece));
+  }
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(result);
+}
+
+/*********************************GIN*****************************************/
+
+/*
+chessboard_gin_ops indexes every position reached in a game, both by its
+SCL_boardHash32 (@>) and by its clock-free SCL_boardHash64 (@~), plus the
+game result and the material signatures reached (@#). chessgame_move_gin_ops
+indexes the move tokens (@!) and the move trigrams (~>, ~>>) instead, in an
+index of its own so that position searches do not pay for them. Keys are
+int8 values tagged with their kind (see CHESS_GIN_KEY), and both opclasses
+share the query functions. Position keys are lossy because of hash
+collisions, and a sequence needs all its trigrams but has to be rechecked,
+the others are exact. Move patterns, and sequences of one or two moves, are
+partial matches over the keys that share their prefix.
+*/
+
+PG_FUNCTION_INFO_V1(chessgame_gin_extract_value_1_1);
+Datum chessgame_gin_extract_value_1_1(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
+  bool **nullFlags = (bool **)PG_GETARG_POINTER(2);
+  Datum *entries = NULL;
+  SCL_Record record;
+  SCL_Board board;
+  uint64 lastMaterial = PG_UINT64_MAX;
+  int n = 0;
+  uint16_t length = cg->length;
+
+  *nullFlags = NULL; // Assume all keys are non-null
+  chessgame_get_record(cg, record);
+
+  // two keys per position (initial one included), exact and clock-free,
+  // one per material change and one for the result
+  entries = (Datum *)palloc(sizeof(Datum) * (3 * (length + 1) + 1));
+
+  SCL_boardInit(board);
+  for (uint16_t i = 0;; ++i)
+  {
+    uint64 material = chess_material_signature(board);
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    entries[n++] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_BOARD, SCL_boardHash32(board)));
+    entries[n++] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_POSITION, SCL_boardHash64(board)));
+    // material only changes on captures and promotions
+    if (material != lastMaterial)
+    {
+      entries[n++] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_MATERIAL, material));
+      lastMaterial = material;
+    }
+    if (i >= length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+  entries[n++] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_RESULT, cg->result));
+
+  *nkeys = n;
+  PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_move_gin_extract_value);
+Datum chessgame_move_gin_extract_value(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
+  bool **nullFlags = (bool **)PG_GETARG_POINTER(2);
+  Datum *entries = NULL;
+  SCL_Record record;
+  SCL_Board board;
+  int n = 0;
+  uint16_t length = cg->length;
+
+  *nullFlags = NULL; // Assume all keys are non-null
+  chessgame_get_record(cg, record);
+
+  // a token and a trigram per move, chess_move_token_make() replays it
+  entries = (Datum *)palloc(sizeof(Datum) * (2 * length + 1));
+
+  SCL_boardInit(board);
+  for (uint16_t i = 0; i < length; ++i)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    entries[n++] = Int64GetDatum(CHESS_GIN_KEY(
+        CHESS_GIN_KEY_MOVE, chess_move_token_make(board, squareFrom, squareTo, promotedPiece)));
+    entries[n++] = Int64GetDatum(CHESS_GIN_KEY(
+        CHESS_GIN_KEY_TRIGRAM,
+        CHESS_MOVE_TRIGRAM(CHESS_MOVE_ITEM(record, i),
+                           i + 1 < length ? CHESS_MOVE_ITEM(record, i + 1) : CHESS_MOVE_NONE,
+                           i + 2 < length ? CHESS_MOVE_ITEM(record, i + 2) : CHESS_MOVE_NONE)));
+  }
+
+  *nkeys = n;
+  PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gin_extract_query_1_1);
+Datum chessgame_gin_extract_query_1_1(PG_FUNCTION_ARGS)
+{
+  Datum query = PG_GETARG_DATUM(0);
+  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
+  StrategyNumber strategy = PG_GETARG_UINT16(2);
+  bool **nullFlags = (bool **)PG_GETARG_POINTER(5);
+  int32 *searchMode = (int32 *)PG_GETARG_POINTER(6);
+  Datum *entries = (Datum *)palloc(sizeof(Datum));
+
+  *nullFlags = NULL; // Assume all keys are non-null
+  *searchMode = GIN_SEARCH_MODE_DEFAULT;
+  *nkeys = 1;
+
+  switch (strategy)
+  {
+  case CHESS_STRATEGY_BOARD:
+  {
+    ChessBoard *cb = DatumGetChessBoardP(query);
+    entries[0] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_BOARD, SCL_boardHash32(cb->board)));
+  }
+  break;
+  case CHESS_STRATEGY_POSITION:
+  {
+    ChessBoard *cb = DatumGetChessBoardP(query);
+    entries[0] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_POSITION, SCL_boardHash64(cb->board)));
+  }
+  break;
+  case CHESS_STRATEGY_RESULT:
+  {
+    char *str = text_to_cstring(DatumGetTextPP(query));
+    entries[0] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_RESULT, chess_result_from_str(str)));
+  }
+  break;
+  case CHESS_STRATEGY_MATERIAL:
+  {
+    char *str = text_to_cstring(DatumGetTextPP(query));
+    entries[0] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_MATERIAL, chess_material_parse(str)));
+  }
+  break;
+  case CHESS_STRATEGY_MOVE:
+  {
+    char *str = text_to_cstring(DatumGetTextPP(query));
+    bool **partialMatch = (bool **)PG_GETARG_POINTER(3);
+    Pointer **extraData = (Pointer **)PG_GETARG_POINTER(4);
+    ChessMovePattern *pattern = palloc(sizeof(ChessMovePattern));
+    uint32 mask;
+
+    chess_move_pattern_parse(str, pattern);
+    entries[0] = Int64GetDatum(CHESS_GIN_KEY(CHESS_GIN_KEY_MOVE,
+                                             chess_move_pattern_prefix(pattern, &mask)));
+    *partialMatch = palloc(sizeof(bool));
+    (*partialMatch)[0] = true;
+    *extraData = palloc(sizeof(Pointer));
+    (*extraData)[0] = (Pointer)pattern;
+  }
+  break;
+  case CHESS_STRATEGY_SEQUENCE:
+  case CHESS_STRATEGY_MOVES:
+  {
+    uint16 items[SCL_RECORD_MAX_LENGTH];
+    int count = chess_sequence_items(query, strategy == CHESS_STRATEGY_MOVES, items);
+
+    if (count == 0)
+    {
+      // every game contains the empty sequence
+      *nkeys = 0;
+      *searchMode = GIN_SEARCH_MODE_ALL;
+    }
+    else if (count < 3)
+    {
+      // the trigrams starting with the moves
+      bool **partialMatch = (bool **)PG_GETARG_POINTER(3);
+
+      entries[0] = Int64GetDatum(CHESS_GIN_KEY(
+          CHESS_GIN_KEY_TRIGRAM, CHESS_MOVE_TRIGRAM(items[0], count > 1 ? items[1] : 0, 0)));
+      *partialMatch = palloc(sizeof(bool));
+      (*partialMatch)[0] = true;
+    }
+    else
+    {
+      *nkeys = count - 2;
+      entries = repalloc(entries, sizeof(Datum) * *nkeys);
+      for (int i = 0; i < *nkeys; i++)
+        entries[i] = Int64GetDatum(CHESS_GIN_KEY(
+            CHESS_GIN_KEY_TRIGRAM, CHESS_MOVE_TRIGRAM(items[i], items[i + 1], items[i + 2])));
+    }
+  }
+  break;
+  default:
+    elog(ERROR, "chessgame_gin_extract_query: unknown strategy number: %d", strategy);
+  }
+
+  PG_RETURN_POINTER(entries);
+}
+
+/*
+Scan the keys from the prefix of a move pattern up to the last one sharing
+it, or the trigrams starting with the one or two moves of a sequence (the
+others moves of the query key are zero).
+*/
+PG_FUNCTION_INFO_V1(chessgame_gin_compare_partial);
+Datum chessgame_gin_compare_partial(PG_FUNCTION_ARGS)
+{
+  int64 partialKey = PG_GETARG_INT64(0);
+  int64 key = PG_GETARG_INT64(1);
+  StrategyNumber strategy = PG_GETARG_UINT16(2);
+  ChessMovePattern *pattern;
+  uint32 token = (uint32)key;
+  uint32 mask;
+
+  if (strategy == CHESS_STRATEGY_SEQUENCE || strategy == CHESS_STRATEGY_MOVES)
+  {
+    uint64 trigramMask = (partialKey & 0xffff0000) ? ~UINT64CONST(0xffff) : ~UINT64CONST(0xffffffff);
+
+    PG_RETURN_INT32((key & trigramMask) == (partialKey & trigramMask) ? 0 : 1);
+  }
+
+  pattern = (ChessMovePattern *)PG_GETARG_POINTER(3);
+  chess_move_pattern_prefix(pattern, &mask);
+  if ((uint64)key >> 56 != CHESS_GIN_KEY_MOVE || (token & mask) != ((uint32)partialKey & mask))
+    PG_RETURN_INT32(1);
+  PG_RETURN_INT32(chess_move_pattern_match(pattern, token) ? 0 : -1);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gin_triconsistent_1_1);
+Datum chessgame_gin_triconsistent_1_1(PG_FUNCTION_ARGS)
+{
+  GinTernaryValue *check = (GinTernaryValue *)PG_GETARG_POINTER(0);
+  StrategyNumber strategy = PG_GETARG_UINT16(1);
+  int32 nkeys = PG_GETARG_INT32(3);
+  GinTernaryValue result = GIN_TRUE;
+
+  // all the query keys have to be present
+  for (int32 i = 0; i < nkeys; i++)
+  {
+    if (check[i] == GIN_FALSE)
+      PG_RETURN_GIN_TERNARY_VALUE(GIN_FALSE);
+    if (check[i] == GIN_MAYBE)
+      result = GIN_MAYBE;
+  }
+
+  // position hashes may collide, trigrams may be apart: the heap tuple has
+  // to be rechecked
+  if (strategy == CHESS_STRATEGY_BOARD || strategy == CHESS_STRATEGY_POSITION ||
+      ((strategy == CHESS_STRATEGY_SEQUENCE || strategy == CHESS_STRATEGY_MOVES) && nkeys > 1))
+    result = GIN_MAYBE;
+
+  PG_RETURN_GIN_TERNARY_VALUE(result);
+}
+
+static int
+evaluateBoard(SCL_Board board)
+{
+  const char *p = board;
+  int total = 0;
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i, ++p)
+  {
+    char s = *p;
+
+    if (s != '.')
+    {
+      total += SCL_pieceValue(s);
+    }
+  }
+  return total;
+}
+
+PG_FUNCTION_INFO_V1(chessgame_compare);
+Datum chessgame_compare(PG_FUNCTION_ARGS)
+{
+  ChessBoard *a = PG_GETARG_CHESSBOARD_P(0);
+  ChessBoard *b = PG_GETARG_CHESSBOARD_P(1);
+
+  int16_t result = evaluateBoard(a->board) - evaluateBoard(b->board);
+
+  PG_FREE_IF_COPY(a, 0);
+  PG_FREE_IF_COPY(b, 1);
+  PG_RETURN_INT16(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_contains_chessboard_1_1);
+Datum chessgame_contains_chessboard_1_1(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(1);
+
+  bool result = chessgameContainsChessboard(cg, cb, cg->length);
+  PG_FREE_IF_COPY(cg, 0);
+  PG_FREE_IF_COPY(cb, 1);
+
+  PG_RETURN_BOOL(result);
+}
+
+/*
+chessgame_contains_chessboard_within(chessgame, chessboard, integer) ->
+boolean: True if the board is one of the positions of the game up to the
+given half-move, for hasBoard.
+*/
+
+PG_FUNCTION_INFO_V1(chessgame_contains_chessboard_within);
+Datum chessgame_contains_chessboard_within(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(1);
+  int32 halfMoves = PG_GETARG_INT32(2);
+
+  bool result = chessgameContainsChessboard(cg, cb, Max(halfMoves, 0));
+  PG_FREE_IF_COPY(cg, 0);
+
+  PG_RETURN_BOOL(result);
+}
+
+/*
+chessgame_reaches_chessboard(chessgame, chessboard) -> boolean (@~): True
+if the position of the board occurs in the game, whatever the move order
+and move clocks (see chessboard_same_position).
+*/
+
+PG_FUNCTION_INFO_V1(chessgame_reaches_chessboard);
+Datum chessgame_reaches_chessboard(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(1);
+
+  bool result = chessgameReachesChessboard(cg, cb);
+  PG_FREE_IF_COPY(cg, 0);
+  PG_FREE_IF_COPY(cb, 1);
+
+  PG_RETURN_BOOL(result);
+}
+
+/*
+reaches_material(chessgame, text) -> boolean (@#): True if some position
+of the game has exactly the given material, e.g. 'KRPvKR'.
+*/
+
+PG_FUNCTION_INFO_V1(reaches_material);
+Datum reaches_material(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(1));
+  uint64 material = chess_material_parse(str);
+  SCL_Record record;
+  SCL_Board board;
+  bool result = false;
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+
+  for (uint16_t i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    if (chess_material_signature(board) == material)
+    {
+      result = true;
+      break;
+    }
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(result);
+}
+
+/*********************************Engine***************************************/
+
+/*
+chessboard_eval and chessboard_bestmove run the alpha-beta search of
+smallchesslib with its static evaluation. Searched positions are kept in
+a per-backend transposition table of chess.tt_size kB (see
+chess_search.h), so repeated and overlapping searches over many positions
+reuse subtrees. With chess.search_workers > 0 the root moves are searched
+by that many threads sharing the table. Results of deterministic searches
+(within no node limit) are also kept in the shared cache, if any, for all
+the backends: other results depend on the contents of the table, hence on
+previous searches and chess.tt_size.
+*/
+
+#define CHESS_SEARCH_MAX_DEPTH 8
+#define CHESS_SEARCH_EXTENSION_DEPTH 3 /* capture and check extensions */
+
+static int chess_tt_allocated_size = 0;
+
+// (re)allocate the transposition table for the current chess.tt_size
+static void
+chess_engine_prepare(void)
+{
+  if (chess_tt_allocated_size == chess_tt_size)
+    return;
+
+  if (chess_search_tt.entries != NULL)
+    pfree(chess_search_tt.entries);
+  chess_search_tt.entries = NULL;
+  chess_search_tt.mask = 0;
+  chess_tt_allocated_size = 0;
+
+  if (chess_tt_size > 0)
+  {
+    uint64 entries = pg_prevpower2_64((uint64)chess_tt_size * 1024 / sizeof(ChessTTEntry));
+
+    chess_search_tt.entries = MemoryContextAllocExtended(TopMemoryContext,
+                                                         entries * sizeof(ChessTTEntry),
+                                                         MCXT_ALLOC_HUGE | MCXT_ALLOC_ZERO);
+    chess_search_tt.mask = entries - 1;
+  }
+  chess_tt_allocated_size = chess_tt_size;
+}
+
+/*
+Wait for the workers started by chess_search_spawn. The backend only
+waits: on an interrupt it stops and joins the workers before serving it,
+so that no worker is left running when CHECK_FOR_INTERRUPTS raises an
+error and the memory of the job is released. Returns true if they were
+stopped but the interrupt was not an error, the work then has to be done
+again.
+*/
+static bool
+chess_search_wait(pthread_t *threads, int started, atomic_int *running)
+{
+  bool stopped = false;
+
+  while (atomic_load(running) > 0)
+  {
+    if (InterruptPending)
+    {
+      atomic_store(&chess_search_stop, true);
+      stopped = true;
+      break;
+    }
+    pg_usleep(1000L);
+  }
+  chess_search_join(threads, started);
+  atomic_store(&chess_search_stop, false);
+
+  if (stopped)
+    CHECK_FOR_INTERRUPTS();
+  return stopped;
+}
+
+// search the root moves of the job with chess.search_workers threads
+static void
+chess_search_parallel(ChessSearchJob *job)
+{
+  pthread_t threads[CHESS_SEARCH_MAX_WORKERS];
+  int started = chess_search_start(job, threads, Min(chess_search_workers, job->moveCount));
+
+  // no thread could be started, or they were stopped
+  if (started == 0 || chess_search_wait(threads, started, &job->running))
+  {
+    chess_search_job_reset(job);
+    chess_search_run(job);
+  }
+}
+
+static void
+chess_check_search_depth(int32 depth)
+{
+  if (depth < 1 || depth > CHESS_SEARCH_MAX_DEPTH)
+    ereport(ERROR,
+            (errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+             errmsg("search depth must be between 1 and %d", CHESS_SEARCH_MAX_DEPTH)));
+}
+
+/*
+chessboard_eval(chessboard, depth) -> int: Score of the position searched
+to the given depth in centipawns, positive when white is better.
+*/
+
+/*
+Search the board to the given depth: by root splitting with
+chess.search_workers threads, or in the backend with iterative deepening
+within chess.search_node_limit and chess.search_time_limit (the time
+limit is ignored by deterministic searches), unless the shared cache
+already has the result. Returns false if the side to move has no legal
+move.
+*/
+static bool
+chess_engine_search(SCL_Board board, int32 depth, uint8_t *squareFrom, uint8_t *squareTo,
+                    int16_t *score)
+{
+  bool useCache = chess_deterministic_search && chess_search_node_limit == 0 &&
+                  chess_cache != NULL;
+  uint64 key = 0;
+
+  chess_check_search_depth(depth);
+
+  if (SCL_boardGetPosition(board) != SCL_POSITION_NORMAL &&
+      SCL_boardGetPosition(board) != SCL_POSITION_CHECK)
+    return false;
+
+  if (useCache)
+  {
+    key = chess_cache_search_key(board, depth, chess_search_workers > 0);
+    if (chess_cache_get_search(key, squareFrom, squareTo, score))
+      return true;
+  }
+
+  chess_engine_prepare();
+
+  if (chess_search_workers > 0)
+  {
+    ChessSearchJob *job = palloc(sizeof(ChessSearchJob));
+    int best;
+
+    /* the moves searched within a node limit depend on the scheduling */
+    chess_search_job_init(job, board, depth, CHESS_SEARCH_EXTENSION_DEPTH,
+                          !chess_deterministic_search,
+                          chess_deterministic_search ? 0 : chess_search_node_limit,
+                          chess_search_clock,
+                          chess_deterministic_search ? 0 : chess_search_time_limit);
+    chess_search_parallel(job);
+    best = chess_search_best(job);
+    *squareFrom = job->from[best];
+    *squareTo = job->to[best];
+    *score = job->scores[best];
+    pfree(job);
+  }
+  else
+  {
+    char promotedPiece;
+
+    chess_search_use_tt(!chess_deterministic_search);
+    *score = SCL_getAIMoveIterative(board, depth, CHESS_SEARCH_EXTENSION_DEPTH,
+                                    SCL_boardEvaluateStatic, chess_search_node_limit,
+                                    chess_search_clock,
+                                    chess_deterministic_search ? 0 : chess_search_time_limit,
+                                    squareFrom, squareTo, &promotedPiece, NULL);
+  }
+
+  if (useCache)
+    chess_cache_put_search(key, *squareFrom, *squareTo, *score);
+  return true;
+}
+
+/*
+chessboard_eval(chessboard, depth) -> int: Score of the best move found by
+a search to the given depth in centipawns, positive when white is better.
+Positions without a legal move get their static score.
+*/
+
+PG_FUNCTION_INFO_V1(chessboard_eval);
+Datum chessboard_eval(PG_FUNCTION_ARGS)
+{
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(0);
+  int32 depth = PG_GETARG_INT32(1);
+  SCL_Board board;
+  uint8_t squareFrom, squareTo;
+  int16_t score;
+
+  memcpy(board, cb->board, SCL_BOARD_STATE_SIZE);
+  if (!chess_engine_search(board, depth, &squareFrom, &squareTo, &score))
+    score = SCL_boardEvaluateDynamic(board, 0, 0, SCL_boardEvaluateStatic);
+
+  PG_RETURN_INT32((int32)score * 100 / SCL_VALUE_PAWN);
+}
+
+/*
+chessboard_bestmove(chessboard, depth) -> text: Best move found by a
+search to the given depth, in coordinate notation (e.g. 'e2e4', 'e7e8q').
+NULL if the side to move has no legal move.
+*/
+
+PG_FUNCTION_INFO_V1(chessboard_bestmove);
+Datum chessboard_bestmove(PG_FUNCTION_ARGS)
+{
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(0);
+  int32 depth = PG_GETARG_INT32(1);
+  SCL_Board board;
+  uint8_t squareFrom, squareTo;
+  int16_t score;
+  char move[8];
+
+  memcpy(board, cb->board, SCL_BOARD_STATE_SIZE);
+  if (!chess_engine_search(board, depth, &squareFrom, &squareTo, &score))
+    PG_RETURN_NULL();
+
+  PG_RETURN_TEXT_P(cstring_to_text(SCL_moveToString(board, squareFrom, squareTo, 'q', move)));
+}
+
+#define CHESS_SEARCH_NO_MOVE 255 /* square of a move that does not exist */
+
+/*
+Score (as for an evaluation function) of the best move found by an
+iterative deepening search of the board, or the static score if the side
+to move has no legal move (the move is then CHESS_SEARCH_NO_MOVE).
+*/
+static int16_t
+chess_search_evaluate(SCL_Board board, uint8_t depth, uint8_t extension, uint32_t maxNodes,
+                      SCL_TimeFunction timeFunc, uint32_t maxTime, uint8_t *squareFrom,
+                      uint8_t *squareTo)
+{
+  char promotedPiece;
+
+  if (SCL_boardGetPosition(board) != SCL_POSITION_NORMAL &&
+      SCL_boardGetPosition(board) != SCL_POSITION_CHECK)
+  {
+    *squareFrom = *squareTo = CHESS_SEARCH_NO_MOVE;
+    return SCL_boardEvaluateDynamic(board, 0, 0, SCL_boardEvaluateStatic);
+  }
+
+  return SCL_getAIMoveIterative(board, depth, extension, SCL_boardEvaluateStatic, maxNodes,
+                                timeFunc, maxTime, squareFrom, squareTo, &promotedPiece, 0);
+}
+
+/*
+Evaluation of a list of positions (e.g. the successive positions of a
+game), each by the next free worker. Positions are taken in order, so
+that neighbouring positions, which share most of their subtrees, are
+searched at about the same time through the transposition table.
+*/
+typedef struct
+{
+  int count;
+  SCL_Board *boards;
+  int16_t *scores;
+  uint8_t *from; /* best moves, see chess_search_evaluate */
+  uint8_t *to;
+  uint8_t depth;
+  uint8_t extension;
+  bool useTT;
+  uint32_t maxNodes;
+  SCL_TimeFunction timeFunc;
+  uint32_t maxTime;
+  atomic_int next;    /* next position to evaluate */
+  atomic_int running; /* started workers that have not finished */
+} ChessEvalJob;
+
+// evaluate positions until there are none left, in any thread
+static void
+chess_eval_run(ChessEvalJob *job)
+{
+  SCL_Board board;
+
+  chess_search_use_tt(job->useTT);
+  for (;;)
+  {
+    int i = atomic_fetch_add(&job->next, 1);
+
+    if (i >= job->count || SCL_SEARCH_STOP)
+      break;
+
+    memcpy(board, job->boards[i], SCL_BOARD_STATE_SIZE);
+    job->scores[i] = chess_search_evaluate(board, job->depth, job->extension, job->maxNodes,
+                                           job->timeFunc, job->maxTime, &job->from[i],
+                                           &job->to[i]);
+  }
+}
+
+static void *
+chess_eval_thread(void *arg)
+{
+  ChessEvalJob *job = arg;
+
+  chess_search_in_worker = true;
+  chess_eval_run(job);
+  atomic_fetch_sub(&job->running, 1);
+  return NULL;
+}
+
+/*
+game_eval_curve(chessgame, depth) -> int[]: chessboard_eval of every
+position of the game, the initial one included, from a single replay.
+Successive positions share most of their subtrees, which the
+transposition table keeps between plies. With chess.search_workers > 0
+the positions are evaluated by that many threads. Positions found in the
+shared cache are not searched; the workers do not access it themselves.
+*/
+
+PG_FUNCTION_INFO_V1(game_eval_curve);
+Datum game_eval_curve(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  int32 depth = PG_GETARG_INT32(1);
+  int count = cg->length + 1;
+  bool useCache = chess_deterministic_search && chess_search_node_limit == 0 &&
+                  chess_cache != NULL;
+  ChessEvalJob *job = palloc(sizeof(ChessEvalJob));
+  Datum *values = palloc(sizeof(Datum) * count);
+  int16_t *scores = palloc(sizeof(int16_t) * count);
+  int *plies = palloc(sizeof(int) * count); /* ply of each position of the job */
+  uint64 *keys = palloc(sizeof(uint64) * count);
+  SCL_Record record;
+  SCL_Board board;
+
+  chess_check_search_depth(depth);
+  chess_engine_prepare();
+
+  job->count = 0;
+  job->boards = palloc(sizeof(SCL_Board) * count);
+  job->scores = palloc(sizeof(int16_t) * count);
+  job->from = palloc(count);
+  job->to = palloc(count);
+  job->depth = depth;
+  job->extension = CHESS_SEARCH_EXTENSION_DEPTH;
+  job->useTT = !chess_deterministic_search;
+  job->maxNodes = chess_search_node_limit;
+  job->timeFunc = chess_search_clock;
+  job->maxTime = chess_deterministic_search ? 0 : chess_search_time_limit;
+  atomic_init(&job->next, 0);
+  atomic_init(&job->running, 0);
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+  for (uint16_t i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    if (useCache)
+      keys[i] = chess_cache_search_key(board, depth, false);
+    if (!useCache || !chess_cache_get_search(keys[i], &squareFrom, &squareTo, &scores[i]))
+    {
+      memcpy(job->boards[job->count], board, SCL_BOARD_STATE_SIZE);
+      plies[job->count++] = i;
+    }
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+
+  if (chess_search_workers > 0 && job->count > 0)
+  {
+    pthread_t threads[CHESS_SEARCH_MAX_WORKERS];
+    int started = chess_search_spawn(threads, Min(chess_search_workers, job->count),
+                                     chess_eval_thread, job, &job->running);
+
+    if (started == 0 || chess_search_wait(threads, started, &job->running))
+    {
+      atomic_store(&job->next, 0);
+      chess_eval_run(job);
+    }
+  }
+  else
+    chess_eval_run(job);
+
+  // only searches of positions with a legal move are shared
+  for (int i = 0; i < job->count; i++)
+  {
+    scores[plies[i]] = job->scores[i];
+    if (useCache && job->from[i] != CHESS_SEARCH_NO_MOVE)
+      chess_cache_put_search(keys[plies[i]], job->from[i], job->to[i], job->scores[i]);
+  }
+
+  for (int i = 0; i < count; i++)
+    values[i] = Int32GetDatum((int32)scores[i] * 100 / SCL_VALUE_PAWN);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_ARRAYTYPE_P(construct_array(values, count, INT4OID, sizeof(int32), true,
+                                        TYPALIGN_INT));
+}
+
+/*********************************Stored positions*****************************/
+
+#if PG_VERSION_NUM < 160000
+// a tuplestore for the result rows (a PostgreSQL 16 helper, flags unused)
+static void
+InitMaterializedSRF(FunctionCallInfo fcinfo, bits32 flags)
+{
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  MemoryContext oldContext;
+  TupleDesc tupdesc;
+
+  if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("set-valued function called in context that cannot accept a set")));
+  if (!(rsinfo->allowedModes & SFRM_Materialize))
+    ereport(ERROR, (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+                    errmsg("materialize mode required, but it is not allowed in this context")));
+
+  oldContext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+  if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+    elog(ERROR, "return type must be a row type");
+  rsinfo->returnMode = SFRM_Materialize;
+  rsinfo->setResult = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random, false,
+                                            work_mem);
+  rsinfo->setDesc = CreateTupleDescCopy(tupdesc);
+  MemoryContextSwitchTo(oldContext);
+}
+#endif
+
+/*
+chessgame_positions(chessgame) -> setof (ply, board_hash, board): Every
+position of the game, the initial one included, obtained by a single
+replay of the moves. This feeds the chess_positions side table.
+*/
+
+PG_FUNCTION_INFO_V1(chessgame_positions);
+Datum chessgame_positions(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ReturnSetInfo *rsinfo = (ReturnSetInfo *)fcinfo->resultinfo;
+  SCL_Record record;
+  SCL_Board board;
+  Datum values[3];
+  bool nulls[3] = {false, false, false};
+
+  InitMaterializedSRF(fcinfo, 0);
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+
+  for (uint16_t i = 0;; i++)
+  {
+    ChessBoard *cb = palloc(sizeof(ChessBoard));
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    SCL_boardCopy(board, cb->board);
+    values[0] = Int32GetDatum(i);
+    values[1] = Int32GetDatum((int32)SCL_boardHash32(board));
+    values[2] = ChessBoardPGetDatum(cb);
+    tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+
+  return (Datum)0;
+}
+
+/*********************************Openings***********************************/
+
+/*
+eco_classify looks games up in a move trie (see chess_trie_compile) of
+the chess_openings table, built once per backend and rebuilt after the
+table changes (its trigger sends a relcache invalidation), so a game is
+classified with one binary search per ply of its opening.
+*/
+
+typedef struct
+{
+  MemoryContext context;
+  ChessTrieNode *nodes; /* values are offsets in ecos */
+  char *ecos;           /* NUL terminated codes */
+} ChessOpenings;
+
+static ChessOpenings *chess_openings = NULL;
+static bool chess_openings_valid = false;
+static Oid chess_openings_relid = InvalidOid;
+
+// relcache callback: reload the opening trie or prefix dictionary if changed
+static void
+chess_tables_invalidate(Datum arg, Oid relid)
+{
+  if (relid == InvalidOid || relid == chess_openings_relid)
+    chess_openings_valid = false;
+  if (relid == InvalidOid || relid == chess_prefixes_relid)
+    chess_prefixes_valid = false;
+}
+
+/*
+Build the trie from the chess_openings table of the schema of the
+extension (that of the function fnOid). When several openings have the
+same moves the first ECO code wins.
+*/
+static ChessOpenings *
+chess_openings_load(Oid fnOid)
+{
+  Oid namespaceId = get_func_namespace(fnOid);
+  char *query;
+  MemoryContext context;
+  MemoryContext oldContext;
+  ChessOpenings *openings;
+  ChessTrieBuilder builder;
+  StringInfoData ecos;
+
+  chess_openings_relid = get_relname_relid("chess_openings", namespaceId);
+  if (!OidIsValid(chess_openings_relid))
+    ereport(ERROR,
+            (errcode(ERRCODE_UNDEFINED_TABLE),
+             errmsg("relation \"chess_openings\" does not exist")));
+
+  context = AllocSetContextCreate(TopMemoryContext, "chess openings trie",
+                                  ALLOCSET_DEFAULT_SIZES);
+  oldContext = MemoryContextSwitchTo(context);
+  openings = palloc(sizeof(ChessOpenings));
+  openings->context = context;
+  initStringInfo(&ecos);
+  MemoryContextSwitchTo(oldContext);
+
+  chess_trie_builder_init(&builder);
+
+  query = psprintf("SELECT eco, moves FROM %s ORDER BY eco, name",
+                   quote_qualified_identifier(get_namespace_name(namespaceId),
+                                              "chess_openings"));
+
+  SPI_connect();
+  if (SPI_execute(query, true, 0) != SPI_OK_SELECT)
+    elog(ERROR, "SPI_execute failed: %s", query);
+
+  for (uint64 row = 0; row < SPI_processed; row++)
+  {
+    HeapTuple tuple = SPI_tuptable->vals[row];
+    TupleDesc desc = SPI_tuptable->tupdesc;
+    bool ecoNull, movesNull;
+    Datum ecoDatum = SPI_getbinval(tuple, desc, 1, &ecoNull);
+    Datum movesDatum = SPI_getbinval(tuple, desc, 2, &movesNull);
+    ChessGame *cg;
+    SCL_Record record;
+    int32 *value;
+
+    if (ecoNull || movesNull)
+      continue;
+
+    cg = DatumGetChessGameP(movesDatum);
+    chessgame_get_record(cg, record);
+
+    value = chess_trie_insert(&builder, record, cg->length);
+    if (*value < 0)
+    {
+      char *eco = TextDatumGetCString(ecoDatum);
+
+      oldContext = MemoryContextSwitchTo(context);
+      *value = ecos.len;
+      appendBinaryStringInfo(&ecos, eco, strlen(eco) + 1);
+      MemoryContextSwitchTo(oldContext);
+    }
+  }
+  SPI_finish();
+
+  openings->nodes = chess_trie_compile(&builder, context);
+  openings->ecos = ecos.data;
+  return openings;
+}
+
+/*
+eco_classify(chessgame) -> text: ECO code of the longest opening of the
+chess_openings table that the game starts with, NULL if none.
+*/
+
+PG_FUNCTION_INFO_V1(eco_classify);
+Datum eco_classify(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  SCL_Record record;
+  uint16 depth;
+  int32 eco;
+
+  if (!chess_openings_valid || chess_openings == NULL)
+  {
+    if (chess_openings != NULL)
+      MemoryContextDelete(chess_openings->context);
+    chess_openings = NULL;
+    chess_openings_valid = true;
+    chess_openings = chess_openings_load(fcinfo->flinfo->fn_oid);
+  }
+
+  chessgame_get_record(cg, record);
+  eco = chess_trie_longest(chess_openings->nodes, record, cg->length, &depth);
+
+  PG_FREE_IF_COPY(cg, 0);
+  if (eco < 0)
+    PG_RETURN_NULL();
+  PG_RETURN_TEXT_P(cstring_to_text(chess_openings->ecos + eco));
+}
+
+/*
+chess_openings_changed() trigger: invalidate the tries of all the backends
+after the chess_openings table changes.
+*/
+
+PG_FUNCTION_INFO_V1(chess_openings_changed);
+Datum chess_openings_changed(PG_FUNCTION_ARGS)
+{
+  TriggerData *trigdata = (TriggerData *)fcinfo->context;
+
+  if (!CALLED_AS_TRIGGER(fcinfo))
+    elog(ERROR, "chess_openings_changed: not called by trigger manager");
+
+  CacheInvalidateRelcache(trigdata->tg_relation);
+  PG_RETURN_POINTER(NULL);
+}
+
+/*********************************Patterns***********************************/
+
+static const char chess_pieces[CHESS_PIECE_KINDS + 1] = "PNBRQKpnbrqk";
+
+// index of a piece in chess_pieces (and ChessSignature), -1 if not a piece
+static inline int
+chess_piece_index(char piece)
+{
+  switch (piece)
+  {
+  case 'P': return 0;
+  case 'N': return 1;
+  case 'B': return 2;
+  case 'R': return 3;
+  case 'Q': return 4;
+  case 'K': return 5;
+  case 'p': return 6;
+  case 'n': return 7;
+  case 'b': return 8;
+  case 'r': return 9;
+  case 'q': return 10;
+  case 'k': return 11;
+  default: return -1;
+  }
+}
+
+// add the pieces of a board to a signature
+static inline void
+chess_signature_add_board(ChessSignature *sig, const SCL_Board board)
+{
+  for (int i = 0; i < SCL_BOARD_SQUARES; i++)
+  {
+    int piece = chess_piece_index(board[i]);
+    if (piece >= 0)
+      sig->bitboards[piece] |= UINT64CONST(1) << i;
+  }
+}
+
+/*
+chesspattern input is a list of square constraints such as
+'Ne5 kg8 .f7': a piece (or '.' for an empty square) followed by the
+square. Squares that are not listed can hold anything.
+*/
+static ChessPattern *
+chesspattern_parse(const char *str)
+{
+  ChessPattern *cp = palloc(sizeof(ChessPattern));
+  const char *p = str;
+
+  memset(cp->squares, CHESS_PATTERN_ANY, SCL_BOARD_SQUARES);
+
+  for (;;)
+  {
+    while (isspace((unsigned char)*p) || *p == ',')
+      p++;
+    if (*p == '\0')
+      break;
+
+    if ((chess_piece_index(p[0]) < 0 && p[0] != '.') ||
+        p[1] < 'a' || p[1] > 'h' || p[2] < '1' || p[2] > '8' ||
+        (p[3] != '\0' && p[3] != ',' && !isspace((unsigned char)p[3])))
+      ereport(ERROR,
+              (errcode(ERRCODE_INVALID_TEXT_REPRESENTATION),
+               errmsg("invalid input syntax for type %s: \"%s\"", "chesspattern", str),
+               errdetail("Expected square constraints such as \"Ne5 kg8 .f7\".")));
+
+    cp->squares[SCL_SQUARE(p[1], p[2] - '0')] = p[0];
+    p += 3;
+  }
+  return cp;
+}
+
+static char *
+chesspattern_to_str(const ChessPattern *cp)
+{
+  StringInfoData buf;
+
+  initStringInfo(&buf);
+  for (int i = 0; i < SCL_BOARD_SQUARES; i++)
+  {
+    if (cp->squares[i] == CHESS_PATTERN_ANY)
+      continue;
+    if (buf.len > 0)
+      appendStringInfoChar(&buf, ' ');
+    appendStringInfo(&buf, "%c%c%c", cp->squares[i], 'a' + i % 8, '1' + i / 8);
+  }
+  return buf.data;
+}
+
+PG_FUNCTION_INFO_V1(chesspattern_in);
+Datum chesspattern_in(PG_FUNCTION_ARGS)
+{
+  char *str = PG_GETARG_CSTRING(0);
+  PG_RETURN_POINTER(chesspattern_parse(str));
+}
+
+PG_FUNCTION_INFO_V1(chesspattern_out);
+Datum chesspattern_out(PG_FUNCTION_ARGS)
+{
+  ChessPattern *cp = PG_GETARG_CHESSPATTERN_P(0);
+  PG_RETURN_CSTRING(chesspattern_to_str(cp));
+}
+
+PG_FUNCTION_INFO_V1(chesspattern_cast_from_text);
+Datum chesspattern_cast_from_text(PG_FUNCTION_ARGS)
+{
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  PG_RETURN_POINTER(chesspattern_parse(str));
+}
+
+static inline bool
+chessboard_matches_pattern_internal(const SCL_Board board, const ChessPattern *cp)
+{
+  for (int i = 0; i < SCL_BOARD_SQUARES; i++)
+    if (cp->squares[i] != CHESS_PATTERN_ANY && cp->squares[i] != board[i])
+      return false;
+  return true;
+}
+
+/*
+chessboard @> chesspattern: True if the board satisfies every square
+constraint of the pattern.
+*/
+
+PG_FUNCTION_INFO_V1(chessboard_matches_pattern);
+Datum chessboard_matches_pattern(PG_FUNCTION_ARGS)
+{
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(0);
+  ChessPattern *cp = PG_GETARG_CHESSPATTERN_P(1);
+  PG_RETURN_BOOL(chessboard_matches_pattern_internal(cb->board, cp));
+}
+
+/*
+chessgame @> chesspattern: True if some position of the game satisfies
+the pattern.
+*/
+
+PG_FUNCTION_INFO_V1(chessgame_matches_pattern);
+Datum chessgame_matches_pattern(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  ChessPattern *cp = PG_GETARG_CHESSPATTERN_P(1);
+  SCL_Record record;
+  SCL_Board board;
+  bool result = false;
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+
+  for (uint16_t i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    if (chessboard_matches_pattern_internal(board, cp))
+    {
+      result = true;
+      break;
+    }
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_BOOL(result);
+}
+
+/*********************************GiST*****************************************/
+
+/*
+GiST keys are ChessSignature bitboards. A game is summarized by the union
+of the (piece, square) occurrences of all its positions, a board by its
+own, inner keys by the union of their children. A pattern can only match
+under a key that has all the pieces the pattern asks for on the right
+squares, so the index prunes but every match has to be rechecked.
+For <-> (see chessboard_distance), a board is at least as far from the
+query as the query occurrences missing from the key of its subtree.
+*/
+
+PG_FUNCTION_INFO_V1(chesssignature_in);
+Datum chesssignature_in(PG_FUNCTION_ARGS)
+{
+  ereport(ERROR,
+          (errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+           errmsg("cannot accept a value of type %s", "chesssignature")));
+  PG_RETURN_VOID(); /* keep compiler quiet */
+}
+
+PG_FUNCTION_INFO_V1(chesssignature_out);
+Datum chesssignature_out(PG_FUNCTION_ARGS)
+{
+  ChessSignature *sig = DatumGetChessSignatureP(PG_GETARG_DATUM(0));
+  StringInfoData buf;
+
+  initStringInfo(&buf);
+  for (int i = 0; i < CHESS_PIECE_KINDS; i++)
+    appendStringInfo(&buf, "%s%c:%016" INT64_MODIFIER "x", i > 0 ? " " : "",
+                     chess_pieces[i], sig->bitboards[i]);
+  PG_RETURN_CSTRING(buf.data);
+}
+
+static inline int
+chess_signature_popcount(const ChessSignature *sig)
+{
+  int count = 0;
+  for (int i = 0; i < CHESS_PIECE_KINDS; i++)
+    count += pg_popcount64(sig->bitboards[i]);
+  return count;
+}
+
+// number of bits that would be added to a by merging b into it
+static inline int
+chess_signature_growth(const ChessSignature *a, const ChessSignature *b)
+{
+  int count = 0;
+  for (int i = 0; i < CHESS_PIECE_KINDS; i++)
+    count += pg_popcount64(b->bitboards[i] & ~a->bitboards[i]);
+  return count;
+}
+
+static inline void
+chess_signature_union(ChessSignature *a, const ChessSignature *b)
+{
+  for (int i = 0; i < CHESS_PIECE_KINDS; i++)
+    a->bitboards[i] |= b->bitboards[i];
+}
+
+static inline int
+chess_signature_hamming(const ChessSignature *a, const ChessSignature *b)
+{
+  int count = 0;
+  for (int i = 0; i < CHESS_PIECE_KINDS; i++)
+    count += pg_popcount64(a->bitboards[i] ^ b->bitboards[i]);
+  return count;
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gist_compress);
+Datum chessgame_gist_compress(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry = (GISTENTRY *)PG_GETARG_POINTER(0);
+  GISTENTRY *retval;
+  ChessGame *cg;
+  ChessSignature *sig;
+  SCL_Record record;
+  SCL_Board board;
+
+  if (!entry->leafkey)
+    PG_RETURN_POINTER(entry);
+
+  cg = DatumGetChessGameP(entry->key);
+  sig = palloc0(sizeof(ChessSignature));
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+  for (uint16_t i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    chess_signature_add_board(sig, board);
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+  }
+
+  retval = palloc(sizeof(GISTENTRY));
+  gistentryinit(*retval, PointerGetDatum(sig), entry->rel, entry->page, entry->offset, false);
+  PG_RETURN_POINTER(retval);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gist_consistent);
+Datum chessgame_gist_consistent(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry = (GISTENTRY *)PG_GETARG_POINTER(0);
+  ChessPattern *cp = PG_GETARG_CHESSPATTERN_P(1);
+  bool *recheck = (bool *)PG_GETARG_POINTER(4);
+  ChessSignature *key = DatumGetChessSignatureP(entry->key);
+
+  *recheck = true;
+
+  // every piece the pattern asks for has to occur on its square
+  for (int i = 0; i < SCL_BOARD_SQUARES; i++)
+  {
+    int piece = chess_piece_index(cp->squares[i]);
+    if (piece >= 0 && !(key->bitboards[piece] & (UINT64CONST(1) << i)))
+      PG_RETURN_BOOL(false);
+  }
+  PG_RETURN_BOOL(true);
+}
+
+/*
+chessboard_distance(chessboard, chessboard) -> integer (<->): The number of
+(piece, square) occurrences of either board that the other one does not
+have, e.g. 2 for a piece moved to an empty square.
+*/
+PG_FUNCTION_INFO_V1(chessboard_distance);
+Datum chessboard_distance(PG_FUNCTION_ARGS)
+{
+  ChessBoard *a = PG_GETARG_CHESSBOARD_P(0);
+  ChessBoard *b = PG_GETARG_CHESSBOARD_P(1);
+  ChessSignature sigA = {0};
+  ChessSignature sigB = {0};
+
+  chess_signature_add_board(&sigA, a->board);
+  chess_signature_add_board(&sigB, b->board);
+  PG_RETURN_INT32(chess_signature_hamming(&sigA, &sigB));
+}
+
+PG_FUNCTION_INFO_V1(chessboard_gist_compress);
+Datum chessboard_gist_compress(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry = (GISTENTRY *)PG_GETARG_POINTER(0);
+  GISTENTRY *retval;
+  ChessSignature *sig;
+
+  if (!entry->leafkey)
+    PG_RETURN_POINTER(entry);
+
+  sig = palloc0(sizeof(ChessSignature));
+  chess_signature_add_board(sig, DatumGetChessBoardP(entry->key)->board);
+
+  retval = palloc(sizeof(GISTENTRY));
+  gistentryinit(*retval, PointerGetDatum(sig), entry->rel, entry->page, entry->offset, false);
+  PG_RETURN_POINTER(retval);
+}
+
+// exact distance to a leaf, its lower bound under an inner key
+PG_FUNCTION_INFO_V1(chessboard_gist_distance);
+Datum chessboard_gist_distance(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *entry = (GISTENTRY *)PG_GETARG_POINTER(0);
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(1);
+  bool *recheck = (bool *)PG_GETARG_POINTER(4);
+  ChessSignature *key = DatumGetChessSignatureP(entry->key);
+  ChessSignature query = {0};
+
+  *recheck = false;
+  chess_signature_add_board(&query, cb->board);
+  if (GIST_LEAF(entry))
+    PG_RETURN_FLOAT8(chess_signature_hamming(key, &query));
+  PG_RETURN_FLOAT8(chess_signature_growth(key, &query));
+}
+
+PG_FUNCTION_INFO_V1(chess_gist_union);
+Datum chess_gist_union(PG_FUNCTION_ARGS)
+{
+  GistEntryVector *entryvec = (GistEntryVector *)PG_GETARG_POINTER(0);
+  int *size = (int *)PG_GETARG_POINTER(1);
+  ChessSignature *result = palloc0(sizeof(ChessSignature));
+
+  for (int i = 0; i < entryvec->n; i++)
+    chess_signature_union(result, DatumGetChessSignatureP(entryvec->vector[i].key));
+
+  *size = sizeof(ChessSignature);
+  PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(chess_gist_penalty);
+Datum chess_gist_penalty(PG_FUNCTION_ARGS)
+{
+  GISTENTRY *origentry = (GISTENTRY *)PG_GETARG_POINTER(0);
+  GISTENTRY *newentry = (GISTENTRY *)PG_GETARG_POINTER(1);
+  float *penalty = (float *)PG_GETARG_POINTER(2);
+
+  *penalty = chess_signature_growth(DatumGetChessSignatureP(origentry->key),
+                                    DatumGetChessSignatureP(newentry->key));
+  PG_RETURN_POINTER(penalty);
+}
+
+typedef struct
+{
+  OffsetNumber offset;
+  int cost; /* how much more one side grows than the other */
+} ChessSplitCost;
+
+static int
+chess_split_cost_cmp(const void *a, const void *b)
+{
+  return ((const ChessSplitCost *)b)->cost - ((const ChessSplitCost *)a)->cost;
+}
+
+// the key of entryvec farthest from the key at offset from
+static OffsetNumber
+chess_gist_farthest(GistEntryVector *entryvec, OffsetNumber from)
+{
+  ChessSignature *key = DatumGetChessSignatureP(entryvec->vector[from].key);
+  OffsetNumber farthest = from;
+  int maxDistance = -1;
+
+  for (OffsetNumber i = FirstOffsetNumber; i < entryvec->n; i = OffsetNumberNext(i))
+  {
+    int distance = chess_signature_hamming(key, DatumGetChessSignatureP(entryvec->vector[i].key));
+
+    if (i != from && distance > maxDistance)
+    {
+      maxDistance = distance;
+      farthest = i;
+    }
+  }
+  return farthest;
+}
+
+/*
+Linear split: the seeds are the key farthest from the first one and the
+key farthest from that, then the other keys go to the side that grows the
+least, those that favour a side the most first (as gtsvector_picksplit).
+*/
+PG_FUNCTION_INFO_V1(chess_gist_picksplit);
+Datum chess_gist_picksplit(PG_FUNCTION_ARGS)
+{
+  GistEntryVector *entryvec = (GistEntryVector *)PG_GETARG_POINTER(0);
+  GIST_SPLITVEC *v = (GIST_SPLITVEC *)PG_GETARG_POINTER(1);
+  OffsetNumber maxoff = entryvec->n - 1;
+  OffsetNumber seed1 = chess_gist_farthest(entryvec, FirstOffsetNumber);
+  OffsetNumber seed2 = chess_gist_farthest(entryvec, seed1);
+  ChessSignature *left = palloc(sizeof(ChessSignature));
+  ChessSignature *right = palloc(sizeof(ChessSignature));
+  ChessSplitCost *costs = palloc(sizeof(ChessSplitCost) * maxoff);
+  int count = 0;
+
+  v->spl_left = (OffsetNumber *)palloc(sizeof(OffsetNumber) * (maxoff + 1));
+  v->spl_right = (OffsetNumber *)palloc(sizeof(OffsetNumber) * (maxoff + 1));
+  v->spl_nleft = 0;
+  v->spl_nright = 0;
+
+  memcpy(left, DatumGetChessSignatureP(entryvec->vector[seed1].key), sizeof(ChessSignature));
+  memcpy(right, DatumGetChessSignatureP(entryvec->vector[seed2].key), sizeof(ChessSignature));
+  v->spl_left[v->spl_nleft++] = seed1;
+  v->spl_right[v->spl_nright++] = seed2;
+
+  for (OffsetNumber i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+  {
+    ChessSignature *sig = DatumGetChessSignatureP(entryvec->vector[i].key);
+
+    if (i == seed1 || i == seed2)
+      continue;
+    costs[count].offset = i;
+    costs[count].cost = abs(chess_signature_growth(left, sig) - chess_signature_growth(right, sig));
+    count++;
+  }
+  qsort(costs, count, sizeof(ChessSplitCost), chess_split_cost_cmp);
+
+  for (int k = 0; k < count; k++)
+  {
+    OffsetNumber i = costs[k].offset;
+    ChessSignature *sig = DatumGetChessSignatureP(entryvec->vector[i].key);
+    int growLeft = chess_signature_growth(left, sig);
+    int growRight = chess_signature_growth(right, sig);
+
+    if (growLeft < growRight || (growLeft == growRight && v->spl_nleft <= v->spl_nright))
+    {
+      chess_signature_union(left, sig);
+      v->spl_left[v->spl_nleft++] = i;
+    }
+    else
+    {
+      chess_signature_union(right, sig);
+      v->spl_right[v->spl_nright++] = i;
+    }
+  }
+
+  v->spl_ldatum = PointerGetDatum(left);
+  v->spl_rdatum = PointerGetDatum(right);
+  PG_RETURN_POINTER(v);
+}
+
+PG_FUNCTION_INFO_V1(chess_gist_same);
+Datum chess_gist_same(PG_FUNCTION_ARGS)
+{
+  ChessSignature *a = DatumGetChessSignatureP(PG_GETARG_DATUM(0));
+  ChessSignature *b = DatumGetChessSignatureP(PG_GETARG_DATUM(1));
+  bool *result = (bool *)PG_GETARG_POINTER(2);
+
+  *result = memcmp(a, b, sizeof(ChessSignature)) == 0;
+  PG_RETURN_POINTER(result);
+}
+
+/*********************************BRIN*****************************************/
+
+/*
+chessgame_bloom_ops summarizes each block range with a Bloom filter (a
+bytea of filter_size bytes, CHESS_BRIN_HASHES bits set per element) of
+the SCL_boardHash32 of the positions of its games, as @> compares them,
+and of the hashes of their first 1 to CHESS_BRIN_PREFIX_PLIES moves for
+^@. Ranges are skipped when a key is missing, every match is rechecked.
+A range should hold no more positions than about the bits of the filter,
+hence a small pages_per_range.
+*/
+
+#define CHESS_BRIN_HASHES 4
+#define CHESS_BRIN_PREFIX_PLIES 16
+#define CHESS_BRIN_DEFAULT_SIZE 4096
+#define CHESS_BRIN_MIN_SIZE 64
+#define CHESS_BRIN_MAX_SIZE 6144 /* an index tuple has to fit in a page */
+
+typedef struct
+{
+  int32 vl_len_; /* varlena header (do not touch directly!) */
+  int filterSize;
+} ChessBrinOptions;
+
+// hash of the first plies moves, from and to squares only as ^@ compares them
+static inline uint32
+chess_brin_prefix_hash(uint32 previous, uint8 squareFrom, uint8 squareTo)
+{
+  return murmurhash32(hash_combine(previous, squareFrom | squareTo << 6));
+}
+
+// true if some bit was not set yet
+static bool
+chess_brin_add(bytea *filter, uint32 hash)
+{
+  uint8 *bits = (uint8 *)VARDATA(filter);
+  uint32 nbits = (VARSIZE(filter) - VARHDRSZ) * 8;
+  uint32 step = chess_filter_step(hash);
+  bool updated = false;
+
+  for (int k = 0; k < CHESS_BRIN_HASHES; k++)
+  {
+    uint32 bit = (hash + k * step) % nbits;
+
+    updated |= !(bits[bit / 8] & (1 << (bit % 8)));
+    bits[bit / 8] |= 1 << (bit % 8);
+  }
+  return updated;
+}
+
+static bool
+chess_brin_may_contain(const bytea *filter, uint32 hash)
+{
+  const uint8 *bits = (const uint8 *)VARDATA_ANY(filter);
+  uint32 nbits = VARSIZE_ANY_EXHDR(filter) * 8;
+  uint32 step = chess_filter_step(hash);
+
+  for (int k = 0; k < CHESS_BRIN_HASHES; k++)
+  {
+    uint32 bit = (hash + k * step) % nbits;
+
+    if (!(bits[bit / 8] & (1 << (bit % 8))))
+      return false;
+  }
+  return true;
+}
+
+PG_FUNCTION_INFO_V1(chessgame_brin_bloom_opcinfo);
+Datum chessgame_brin_bloom_opcinfo(PG_FUNCTION_ARGS)
+{
+  BrinOpcInfo *result = palloc0(SizeofBrinOpcInfo(1));
+
+  result->oi_nstored = 1;
+  result->oi_regular_nulls = true;
+  result->oi_typcache[0] = lookup_type_cache(BYTEAOID, 0);
+  PG_RETURN_POINTER(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_brin_bloom_options);
+Datum chessgame_brin_bloom_options(PG_FUNCTION_ARGS)
+{
+  local_relopts *relopts = (local_relopts *)PG_GETARG_POINTER(0);
+
+  init_local_reloptions(relopts, sizeof(ChessBrinOptions));
+  add_local_int_reloption(relopts, "filter_size",
+                          "size in bytes of the Bloom filter of a block range",
+                          CHESS_BRIN_DEFAULT_SIZE, CHESS_BRIN_MIN_SIZE, CHESS_BRIN_MAX_SIZE,
+                          offsetof(ChessBrinOptions, filterSize));
+  PG_RETURN_VOID();
+}
+
+PG_FUNCTION_INFO_V1(chessgame_brin_bloom_add_value);
+Datum chessgame_brin_bloom_add_value(PG_FUNCTION_ARGS)
+{
+  BrinValues *column = (BrinValues *)PG_GETARG_POINTER(1);
+  ChessGame *cg = DatumGetChessGameP(PG_GETARG_DATUM(2));
+  SCL_Record record;
+  SCL_Board board;
+  bytea *filter;
+  uint32 prefix = 0;
+  bool updated = false;
+
+  if (column->bv_allnulls)
+  {
+    ChessBrinOptions *options = (ChessBrinOptions *)PG_GET_OPCLASS_OPTIONS();
+    int size = options != NULL ? options->filterSize : CHESS_BRIN_DEFAULT_SIZE;
+
+    filter = palloc0(VARHDRSZ + size);
+    SET_VARSIZE(filter, VARHDRSZ + size);
+    column->bv_allnulls = false;
+    updated = true;
+  }
+  else
+    filter = PG_DETOAST_DATUM(column->bv_values[0]);
+
+  chessgame_get_record(cg, record);
+  SCL_boardInit(board);
+  for (uint16 i = 0;; i++)
+  {
+    uint8_t squareFrom, squareTo;
+    char promotedPiece;
+
+    updated |= chess_brin_add(filter, SCL_boardHash32(board));
+    if (i >= cg->length)
+      break;
+
+    SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+    SCL_boardMakeMove(board, squareFrom, squareTo, promotedPiece);
+    if (i < CHESS_BRIN_PREFIX_PLIES)
+    {
+      prefix = chess_brin_prefix_hash(prefix, squareFrom, squareTo);
+      updated |= chess_brin_add(filter, prefix);
+    }
+  }
+
+  column->bv_values[0] = PointerGetDatum(filter);
+  PG_RETURN_BOOL(updated);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_brin_bloom_consistent);
+Datum chessgame_brin_bloom_consistent(PG_FUNCTION_ARGS)
+{
+  BrinValues *column = (BrinValues *)PG_GETARG_POINTER(1);
+  ScanKey key = (ScanKey)PG_GETARG_POINTER(2);
+  bytea *filter = PG_DETOAST_DATUM(column->bv_values[0]);
+
+  switch (key->sk_strategy)
+  {
+  case RTContainsStrategyNumber:
+  {
+    ChessBoard *cb = DatumGetChessBoardP(key->sk_argument);
+
+    PG_RETURN_BOOL(chess_brin_may_contain(filter, SCL_boardHash32(cb->board)));
+  }
+  case RTPrefixStrategyNumber:
+  {
+    ChessGame *opening = DatumGetChessGameP(key->sk_argument);
+    SCL_Record record;
+    uint32 prefix = 0;
+    uint16 plies = Min(opening->length, CHESS_BRIN_PREFIX_PLIES);
+
+    if (plies == 0)
+      PG_RETURN_BOOL(true);
+
+    chessgame_get_record(opening, record);
+    for (uint16 i = 0; i < plies; i++)
+    {
+      uint8_t squareFrom, squareTo;
+      char promotedPiece;
+
+      SCL_recordGetMove(record, i, &squareFrom, &squareTo, &promotedPiece);
+      prefix = chess_brin_prefix_hash(prefix, squareFrom, squareTo);
+    }
+    PG_RETURN_BOOL(chess_brin_may_contain(filter, prefix));
+  }
+  default:
+    elog(ERROR, "unrecognized strategy number: %d", key->sk_strategy);
+  }
+  PG_RETURN_BOOL(true); /* keep compiler quiet */
+}
+
+PG_FUNCTION_INFO_V1(chessgame_brin_bloom_union);
+Datum chessgame_brin_bloom_union(PG_FUNCTION_ARGS)
+{
+  BrinValues *a = (BrinValues *)PG_GETARG_POINTER(1);
+  BrinValues *b = (BrinValues *)PG_GETARG_POINTER(2);
+  bytea *filterA = PG_DETOAST_DATUM(a->bv_values[0]);
+  bytea *filterB = PG_DETOAST_DATUM(b->bv_values[0]);
+  uint8 *bitsA = (uint8 *)VARDATA(filterA);
+  const uint8 *bitsB = (const uint8 *)VARDATA(filterB);
+
+  // every filter of the index has the size of its filter_size option
+  Assert(VARSIZE(filterA) == VARSIZE(filterB));
+  for (Size i = 0; i < VARSIZE(filterA) - VARHDRSZ; i++)
+    bitsA[i] |= bitsB[i];
+
+  a->bv_values[0] = PointerGetDatum(filterA);
+  PG_RETURN_VOID();
+}
+
+/******************************************************************************************/
+// moves of the game as items, in place if stored plainly, else expanded into record
+static inline const uint8 *
+chessgame_items(const ChessGame *cg, SCL_Record record)
+{
+  if (likely(!(cg->flags & (CHESSGAME_HAS_PREFIX | CHESSGAME_PACKED))))
+    return cg->moves;
+  chessgame_expand_record(cg, record);
+  return record;
+}
+
+/*
+Games are ordered by length, then by their moves (promotions included),
+then by result, so that = is the equality of the games (tags aside) and a
+game sorts after its openings. The moves are only compared for games of
+equal length.
+*/
+static int
+chessgame_cmp_internal(const ChessGame *c1, const ChessGame *c2)
+{
+  SCL_Record record1;
+  SCL_Record record2;
+  const uint8 *items1 = NULL;
+  const uint8 *items2 = NULL;
+  uint16 count = c1->length;
+
+  if (c1->length != c2->length)
+    return c1->length < c2->length ? -1 : 1;
+
+  // games stored against the same prefix entry only differ after it
+  if (CHESSGAME_PREFIX_LENGTH(c1) > 0 && CHESSGAME_PREFIX_LENGTH(c2) > 0 &&
+      CHESSGAME_PREFIX_ID(c1) == CHESSGAME_PREFIX_ID(c2))
+  {
+    items1 = CHESSGAME_MOVES(c1);
+    items2 = CHESSGAME_MOVES(c2);
+    count -= CHESSGAME_PREFIX_LENGTH(c1);
+  }
+  // the packed stream of a game only depends on its moves, duplicates need no replay
+  else if (c1->flags & c2->flags & CHESSGAME_PACKED)
+  {
+    Size size = CHESSGAME_PACKED_SIZE(c1);
+    int result = 0;
+
+    if (size != CHESSGAME_PACKED_SIZE(c2) ||
+        memcmp(CHESSGAME_MOVES(c1), CHESSGAME_MOVES(c2), size) != 0)
+      result = chess_moves_packed_cmp(CHESSGAME_MOVES(c1), size, CHESSGAME_MOVES(c2),
+                                      CHESSGAME_PACKED_SIZE(c2), count);
+    if (result != 0)
+      return result;
+    count = 0;
+  }
+  else
+  {
+    items1 = chessgame_items(c1, record1);
+    items2 = chessgame_items(c2, record2);
+  }
+
+  for (uint16 i = 0; i < count; i++)
+  {
+    uint16 item1 = CHESS_MOVE_ITEM(items1, i);
+    uint16 item2 = CHESS_MOVE_ITEM(items2, i);
+
+    if (item1 != item2)
+      return item1 < item2 ? -1 : 1;
+  }
+
+  if (c1->result != c2->result)
+    return c1->result < c2->result ? -1 : 1;
+  return 0;
+}
+
+// only the headers are needed for games of different lengths,
+// see PG_GETARG_CHESSGAME_HEADER_P
+static int
+hasOpening_internal(FunctionCallInfo fcinfo)
+{
+  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_HEADER_P(0);
+  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_HEADER_P(1);
+  int result;
+
+  if (chessgame1->length != chessgame2->length)
+    result = chessgame1->length < chessgame2->length ? -1 : 1;
+  else
+  {
+    ChessGame *full1 = PG_GETARG_CHESSGAME_P(0);
+    ChessGame *full2 = PG_GETARG_CHESSGAME_P(1);
+
+    result = chessgame_cmp_internal(full1, full2);
+    PG_FREE_IF_COPY(full1, 0);
+    PG_FREE_IF_COPY(full2, 1);
+  }
+  PG_FREE_IF_COPY(chessgame1, 0);
+  PG_FREE_IF_COPY(chessgame2, 1);
+  return result;
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_eq_1_1);
+Datum hasOpening_eq_1_1(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(hasOpening_internal(fcinfo) == 0);
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_lt_1_1);
+Datum hasOpening_lt_1_1(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(hasOpening_internal(fcinfo) < 0);
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_le_1_1);
+Datum hasOpening_le_1_1(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(hasOpening_internal(fcinfo) <= 0);
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_gt_1_1);
+Datum hasOpening_gt_1_1(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(hasOpening_internal(fcinfo) > 0);
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_ge_1_1);
+Datum hasOpening_ge_1_1(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_BOOL(hasOpening_internal(fcinfo) >= 0);
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_cmp_1_1);
+Datum hasOpening_cmp_1_1(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_INT32(hasOpening_internal(fcinfo));
+}
+
+/*
+Sort support: the abbreviated key of a game is its length followed by its
+first moves (as many as fit in a Datum), in the order of
+chessgame_cmp_internal, so most comparisons of a sort are integer
+comparisons and only games that share their length and first moves are
+detoasted again.
+*/
+#define CHESSGAME_ABBREV_MOVES (SIZEOF_DATUM / 2 - 1)
+
+static int
+chessgame_fastcmp(Datum x, Datum y, SortSupport ssup)
+{
+  ChessGame *c1 = DatumGetChessGameP(x);
+  ChessGame *c2 = DatumGetChessGameP(y);
+  int result = chessgame_cmp_internal(c1, c2);
+
+  if ((Pointer)c1 != DatumGetPointer(x))
+    pfree(c1);
+  if ((Pointer)c2 != DatumGetPointer(y))
+    pfree(c2);
+  return result;
+}
+
+static Datum
+chessgame_abbrev_convert(Datum original, SortSupport ssup)
+{
+  ChessGame *cg = DatumGetChessGameP(original);
+  uint16 count = Min(cg->length, CHESSGAME_ABBREV_MOVES);
+  SCL_Record record;
+  const uint8 *items = record;
+  Datum key = (Datum)cg->length;
+
+  // unpacking replays the game, stop after the moves of the key
+  if (cg->flags & CHESSGAME_PACKED)
+    chess_moves_unpack(CHESSGAME_MOVES(cg), CHESSGAME_PACKED_SIZE(cg), count, record);
+  else
+    items = chessgame_items(cg, record);
+
+  for (int i = 0; i < CHESSGAME_ABBREV_MOVES; i++)
+    key = key << 16 | (i < count ? CHESS_MOVE_ITEM(items, i) : 0);
+
+  if ((Pointer)cg != DatumGetPointer(original))
+    pfree(cg);
+  return key;
+}
+
+// lengths alone already tell most games apart, abbreviation always pays
+static bool
+chessgame_abbrev_abort(int memtupcount, SortSupport ssup)
+{
+  return false;
+}
+
+PG_FUNCTION_INFO_V1(hasOpening_sortsupport);
+Datum hasOpening_sortsupport(PG_FUNCTION_ARGS)
+{
+  SortSupport ssup = (SortSupport)PG_GETARG_POINTER(0);
+
+  ssup->comparator = chessgame_fastcmp;
+  if (ssup->abbreviate)
+  {
+    ssup->comparator = ssup_datum_unsigned_cmp;
+    ssup->abbrev_converter = chessgame_abbrev_convert;
+    ssup->abbrev_abort = chessgame_abbrev_abort;
+    ssup->abbrev_full_comparator = chessgame_fastcmp;
+  }
+  PG_RETURN_VOID();
+}
+
+/*
+Hash of a game for the hash opclass, consistent with =: the move items
+(whatever the storage format) followed by the result, tags aside.
+*/
+static uint64
+chessgame_hash_internal(const ChessGame *cg, uint64 seed)
+{
+  // the record, and a byte for the result after its SCL_RECORD_MAX_LENGTH moves
+  uint8 record[SCL_RECORD_MAX_SIZE + 1];
+  uint16 length = cg->length;
+
+  chessgame_get_record(cg, record);
+  if (length > 0)
+    record[(length - 1) * 2] &= 0x3f;
+  record[length * 2] = cg->result;
+  return hash_bytes_extended(record, length * 2 + 1, seed);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_hash);
+Datum chessgame_hash(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  uint32 result = (uint32)chessgame_hash_internal(cg, 0);
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_INT32((int32)result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_hash_extended);
+Datum chessgame_hash_extended(PG_FUNCTION_ARGS)
+{
+  ChessGame *cg = PG_GETARG_CHESSGAME_P(0);
+  uint64 result = chessgame_hash_internal(cg, (uint64)PG_GETARG_INT64(1));
+
+  PG_FREE_IF_COPY(cg, 0);
+  PG_RETURN_INT64((int64)result);
+}
+
+/*********************************Batched position scan************************/
+
+/*
+A custom scan of the heap that evaluates @> (chessgame, chessboard) and the
+half-move bound of hasBoard() (chessgame_contains_chessboard_within) on
+batches of tuples instead of one fmgr call per tuple. The games of a batch
+are first checked against their Bloom filter, the moves of the others are
+decoded into a buffer with one row per ply, then all the games are
+replayed together ply by ply, the position hash being updated from the
+squares a move changed rather than computed again (see
+chess_hash32_update). Matches are the same as with the operators, with a
+parallel-aware variant sharing the heap scan among workers.
+*/
+
+#define CHESS_BATCH_SIZE 256
+
+/* a batch evaluation saves about this fraction of the cost of its clauses */
+#define CHESS_BATCH_COST_SAVING 0.5
+
+static set_rel_pathlist_hook_type prev_set_rel_pathlist_hook = NULL;
+
+typedef struct
+{
+  AttrNumber attno;     /* chessgame column */
+  ExprState *board;     /* target board */
+  ExprState *halfMoves; /* half-move bound of hasBoard(), NULL for @> */
+  ChessBoard target;    /* value of board for the current scan */
+  uint32 hash;          /* SCL_boardHash32 of target */
+  int32 bound;          /* value of halfMoves, else PG_INT32_MAX */
+  bool isnull;          /* target or bound is NULL: nothing matches */
+} ChessBatchClause;
+
+typedef struct
+{
+  CustomScanState css;
+  List *clauses;            /* ChessBatchClause */
+  ExprState *recheck;       /* the clauses, for EvalPlanQual */
+  bool targetsReady;        /* targets evaluated since the last (re)scan */
+  bool done;                /* the heap scan returned its last tuple */
+  ParallelTableScanDesc pscan; /* shared heap scan, NULL if not parallel */
+  MemoryContext batchContext; /* detoasted games of the current batch */
+  TupleTableSlot *slots[CHESS_BATCH_SIZE];
+  bool matches[CHESS_BATCH_SIZE];
+  int count;                /* tuples in the batch */
+  int next;                 /* next tuple of the batch to return */
+  uint16 *items;            /* item of ply p of game g at p * CHESS_BATCH_SIZE + g */
+  SCL_Board *boards;        /* board of each game being replayed */
+} ChessBatchScanState;
+
+/* the terms of the pieces in SCL_boardHash32, times (square + 1) */
+#define CHESS_HASH32_PRIME(piece, prime) [piece] = prime,
+static const uint32 chess_hash32_primes[128] = {SCL_BOARD_HASH32_PRIMES(CHESS_HASH32_PRIME)};
+#undef CHESS_HASH32_PRIME
+
+#define CHESS_HASH32_TERM(square, piece) \
+  (((uint32)(square) + 1) * chess_hash32_primes[(uint8)(piece) & 0x7f])
+
+// the pieces part of SCL_boardHash32
+static inline uint32
+chess_hash32_pieces(const SCL_Board board)
+{
+  uint32 pieces = 0;
+
+  for (int i = 0; i < SCL_BOARD_SQUARES; i++)
+    pieces ^= CHESS_HASH32_TERM(i, board[i]);
+  return pieces;
+}
+
+// SCL_boardHash32 of a board whose pieces part is known
+static inline uint32
+chess_hash32_finish(const SCL_Board board, uint32 pieces)
+{
+  uint32 result = (board[SCL_BOARD_PLY_BYTE] & 0x01) +
+                  (((uint32)((uint8)board[SCL_BOARD_ENPASSANT_CASTLE_BYTE])) << 24) +
+                  board[SCL_BOARD_MOVE_COUNT_BYTE];
+
+  result ^= pieces;
+  return (result >> 16) | (result << 16);
+}
+
+// the pieces part after a move, from the squares it changed (8 at a time)
+static inline uint32
+chess_hash32_update(uint32 pieces, const char *before, const char *after)
+{
+  for (int word = 0; word < SCL_BOARD_SQUARES; word += 8)
+  {
+    uint64 a;
+    uint64 b;
+
+    memcpy(&a, before + word, 8);
+    memcpy(&b, after + word, 8);
+    if (a == b)
+      continue;
+    for (int i = word; i < word + 8; i++)
+      if (before[i] != after[i])
+        pieces ^= CHESS_HASH32_TERM(i, before[i]) ^ CHESS_HASH32_TERM(i, after[i]);
+  }
+  return pieces;
+}
+
+/* the operator and functions of the scan in the schema of the extension */
+static Oid chess_batch_contains_opno = InvalidOid;
+static Oid chess_batch_contains_funcid = InvalidOid;
+static Oid chess_batch_within_funcid = InvalidOid;
+static bool chess_batch_oids_valid = false;
+
+// syscache callback: look the operator and functions up again if changed
+static void
+chess_batch_oids_invalidate(Datum arg, int cacheid, uint32 hashvalue)
+{
+  chess_batch_oids_valid = false;
+}
+
+static void
+chess_batch_oids_lookup(void)
+{
+  Oid extensionId;
+  Oid namespaceId;
+  char *schemaName;
+  Oid argtypes[3];
+
+  if (chess_batch_oids_valid)
+    return;
+  chess_batch_contains_opno = InvalidOid;
+  chess_batch_contains_funcid = InvalidOid;
+  chess_batch_within_funcid = InvalidOid;
+  chess_batch_oids_valid = true;
+
+  extensionId = get_extension_oid("chess", true);
+  if (!OidIsValid(extensionId))
+    return;
+  namespaceId = get_extension_schema(extensionId);
+  schemaName = get_namespace_name(namespaceId);
+  argtypes[0] = GetSysCacheOid2(TYPENAMENSP, Anum_pg_type_oid, CStringGetDatum("chessgame"),
+                                ObjectIdGetDatum(namespaceId));
+  argtypes[1] = GetSysCacheOid2(TYPENAMENSP, Anum_pg_type_oid, CStringGetDatum("chessboard"),
+                                ObjectIdGetDatum(namespaceId));
+  argtypes[2] = INT4OID;
+  // the catalog of 1.0 (not updated yet) stores games in the fixed-size format
+  // of its own functions, which the scan does not decode
+  if (!OidIsValid(argtypes[0]) || !OidIsValid(argtypes[1]) || get_typlen(argtypes[0]) != -1)
+    return;
+
+  chess_batch_contains_opno =
+      OpernameGetOprid(list_make2(makeString(schemaName), makeString("@>")), argtypes[0], argtypes[1]);
+  chess_batch_contains_funcid =
+      LookupFuncName(list_make2(makeString(schemaName), makeString("chessgame_contains_chessboard")),
+                     2, argtypes, true);
+  chess_batch_within_funcid =
+      LookupFuncName(list_make2(makeString(schemaName),
+                                makeString("chessgame_contains_chessboard_within")),
+                     3, argtypes, true);
+}
+
+/*
+The kind of a clause the scan evaluates: 2 for chessgame_contains_chessboard
+(@>), 3 for chessgame_contains_chessboard_within, 0 for another one. The
+operator and functions are those of the schema of the extension, compared
+by OID. The game has to be a column of the relation and the other
+arguments must not depend on the tuple.
+*/
+static int
+chess_batch_clause_kind(Expr *clause, Index relid)
+{
+  int kind;
+  List *args;
+  Var *var;
+  ListCell *lc;
+
+  chess_batch_oids_lookup();
+  if (IsA(clause, OpExpr) && ((OpExpr *)clause)->opno == chess_batch_contains_opno)
+    args = ((OpExpr *)clause)->args;
+  else if (IsA(clause, FuncExpr) && (((FuncExpr *)clause)->funcid == chess_batch_contains_funcid ||
+                                      ((FuncExpr *)clause)->funcid == chess_batch_within_funcid))
+    args = ((FuncExpr *)clause)->args;
+  else
+    return 0;
+  kind = list_length(args);
+  if (kind != 2 && kind != 3)
+    return 0;
+
+  if (!IsA(linitial(args), Var))
+    return 0;
+  var = linitial_node(Var, args);
+  if (var->varno != relid || var->varlevelsup != 0 || var->varattno <= 0)
+    return 0;
+  for_each_from(lc, args, 1)
+    if (contain_var_clause(lfirst(lc)) || contain_volatile_functions(lfirst(lc)))
+      return 0;
+  return kind;
+}
+
+/*
+The clauses of restrictinfos the scan evaluates in batches, before the
+other ones: only those whose security level is not above that of any other
+clause, so that the clauses of a security barrier view or row-level
+security policy still come first (see order_qual_clauses).
+*/
+static List *
+chess_batch_clauses(List *restrictinfos, Index relid)
+{
+  List *candidates = NIL;
+  List *clauses = NIL;
+  Index minSecurity = UINT_MAX;
+  ListCell *lc;
+
+  foreach (lc, restrictinfos)
+  {
+    RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+
+    if (rinfo->pseudoconstant)
+      continue;
+    if (chess_batch_clause_kind(rinfo->clause, relid) != 0)
+      candidates = lappend(candidates, rinfo);
+    else
+      minSecurity = Min(minSecurity, rinfo->security_level);
+  }
+
+  foreach (lc, candidates)
+  {
+    RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+
+    if (rinfo->security_level <= minSecurity)
+      clauses = lappend(clauses, rinfo);
+  }
+  list_free(candidates);
+  return clauses;
+}
+
+// copy of cost_seqscan, with the clauses the scan evaluates in batches discounted
+static void
+chess_batch_path_cost(PlannerInfo *root, RelOptInfo *rel, CustomPath *cpath, List *clauses)
+{
+  Path *path = &cpath->path;
+  double spcSeqPageCost;
+  QualCost batchCost;
+  Cost cpuPerTuple;
+  Cost cpuRunCost;
+
+  get_tablespace_page_costs(rel->reltablespace, NULL, &spcSeqPageCost);
+  cost_qual_eval(&batchCost, clauses, root);
+
+  path->startup_cost = rel->baserestrictcost.startup;
+  if (!enable_seqscan)
+    path->startup_cost += disable_cost;
+  cpuPerTuple = cpu_tuple_cost + rel->baserestrictcost.per_tuple -
+                CHESS_BATCH_COST_SAVING * batchCost.per_tuple;
+  cpuRunCost = cpuPerTuple * rel->tuples;
+  path->rows = rel->rows;
+
+  if (path->parallel_workers > 0)
+  {
+    // as get_parallel_divisor()
+    double divisor = path->parallel_workers;
+
+    if (parallel_leader_participation)
+    {
+      double leaderContribution = 1.0 - (0.3 * path->parallel_workers);
+
+      if (leaderContribution > 0)
+        divisor += leaderContribution;
+    }
+    cpuRunCost /= divisor;
+    path->rows = clamp_row_est(path->rows / divisor);
+  }
+
+  path->startup_cost += path->pathtarget->cost.startup;
+  cpuRunCost += path->pathtarget->cost.per_tuple * path->rows;
+  path->total_cost = path->startup_cost + cpuRunCost + spcSeqPageCost * rel->pages;
+}
+
+static CustomPathMethods chess_batch_path_methods;
+
+static CustomPath *
+chess_batch_path_create(PlannerInfo *root, RelOptInfo *rel, List *clauses, int workers)
+{
+  CustomPath *cpath = makeNode(CustomPath);
+
+  cpath->path.pathtype = T_CustomScan;
+  cpath->path.parent = rel;
+  cpath->path.pathtarget = rel->reltarget;
+  cpath->path.param_info = NULL;
+  cpath->path.parallel_aware = workers > 0;
+  cpath->path.parallel_safe = rel->consider_parallel;
+  cpath->path.parallel_workers = workers;
+  cpath->path.pathkeys = NIL;
+#if PG_VERSION_NUM >= 150000
+  cpath->flags = CUSTOMPATH_SUPPORT_PROJECTION;
+#endif
+  cpath->methods = &chess_batch_path_methods;
+  chess_batch_path_cost(root, rel, cpath, clauses);
+  return cpath;
+}
+
+static void
+chess_batch_set_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, Index rti, RangeTblEntry *rte)
+{
+  List *clauses;
+  Relation relation;
+  bool heap;
+
+  if (prev_set_rel_pathlist_hook)
+    prev_set_rel_pathlist_hook(root, rel, rti, rte);
+
+  // plain scans of heap tables only, not parameterized by lateral references
+  if (!chess_enable_batch_scan || rel->rtekind != RTE_RELATION || rte->inh || rte->tablesample != NULL ||
+      (rte->relkind != RELKIND_RELATION && rte->relkind != RELKIND_MATVIEW) ||
+      !bms_is_empty(rel->lateral_relids))
+    return;
+
+  clauses = chess_batch_clauses(rel->baserestrictinfo, rel->relid);
+  if (clauses == NIL)
+    return;
+
+  relation = table_open(rte->relid, NoLock);
+  heap = table_slot_callbacks(relation) == &TTSOpsBufferHeapTuple;
+  table_close(relation, NoLock);
+  if (!heap)
+    return;
+
+  add_path(rel, &chess_batch_path_create(root, rel, clauses, 0)->path);
+
+  if (rel->consider_parallel)
+  {
+    int workers = compute_parallel_worker(rel, rel->pages, -1, max_parallel_workers_per_gather);
+
+    if (workers > 0)
+      add_partial_path(rel, &chess_batch_path_create(root, rel, clauses, workers)->path);
+  }
+}
+
+static CustomScanMethods chess_batch_scan_methods;
+
+// the clauses of the scan go to custom_exprs, the others stay quals
+static Plan *
+chess_batch_plan_path(PlannerInfo *root, RelOptInfo *rel, CustomPath *best_path, List *tlist,
+                      List *clauses, List *custom_plans)
+{
+  CustomScan *cscan = makeNode(CustomScan);
+  List *batchRinfos = chess_batch_clauses(clauses, rel->relid);
+  List *batchClauses = NIL;
+  List *quals = NIL;
+  ListCell *lc;
+
+  // in the order of order_qual_clauses, the batch going first
+  foreach (lc, clauses)
+  {
+    RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+
+    if (rinfo->pseudoconstant)
+      continue;
+    if (list_member_ptr(batchRinfos, rinfo))
+      batchClauses = lappend(batchClauses, rinfo->clause);
+    else
+      quals = lappend(quals, rinfo->clause);
+  }
+
+  cscan->scan.plan.targetlist = tlist;
+  cscan->scan.plan.qual = quals;
+  cscan->scan.scanrelid = rel->relid;
+  cscan->flags = best_path->flags;
+  cscan->custom_exprs = batchClauses;
+  cscan->methods = &chess_batch_scan_methods;
+  return &cscan->scan.plan;
+}
+
+static CustomExecMethods chess_batch_exec_methods;
+
+static Node *
+chess_batch_create_state(CustomScan *cscan)
+{
+  ChessBatchScanState *state = palloc0(sizeof(ChessBatchScanState));
+
+  NodeSetTag(state, T_CustomScanState);
+  state->css.flags = cscan->flags;
+  state->css.methods = &chess_batch_exec_methods;
+  // heap tables only, see chess_batch_set_rel_pathlist
+  state->css.slotOps = &TTSOpsBufferHeapTuple;
+  return (Node *)state;
+}
+
+static void
+chess_batch_begin(CustomScanState *node, EState *estate, int eflags)
+{
+  ChessBatchScanState *state = (ChessBatchScanState *)node;
+  CustomScan *cscan = (CustomScan *)node->ss.ps.plan;
+  ListCell *lc;
+
+  foreach (lc, cscan->custom_exprs)
+  {
+    Expr *clause = lfirst(lc);
+    List *args = IsA(clause, OpExpr) ? ((OpExpr *)clause)->args : ((FuncExpr *)clause)->args;
+    ChessBatchClause *batchClause = palloc0(sizeof(ChessBatchClause));
+
+    batchClause->attno = linitial_node(Var, args)->varattno;
+    batchClause->board = ExecInitExpr(lsecond(args), &node->ss.ps);
+    if (list_length(args) == 3)
+      batchClause->halfMoves = ExecInitExpr(lthird(args), &node->ss.ps);
+    state->clauses = lappend(state->clauses, batchClause);
+  }
+  state->recheck = ExecInitQual(cscan->custom_exprs, &node->ss.ps);
+
+  if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
+    return;
+
+  for (int i = 0; i < CHESS_BATCH_SIZE; i++)
+    state->slots[i] = table_slot_create(node->ss.ss_currentRelation, &estate->es_tupleTable);
+  state->batchContext = AllocSetContextCreate(estate->es_query_cxt, "chess batch scan",
+                                              ALLOCSET_DEFAULT_SIZES);
+  state->items = palloc(sizeof(uint16) * SCL_RECORD_MAX_LENGTH * CHESS_BATCH_SIZE);
+  state->boards = palloc(sizeof(SCL_Board) * CHESS_BATCH_SIZE);
+}
+
+// evaluate the targets and bounds of the clauses, once per scan
+static void
+chess_batch_targets(ChessBatchScanState *state)
+{
+  ExprContext *econtext = state->css.ss.ps.ps_ExprContext;
+  ListCell *lc;
+
+  ResetExprContext(econtext);
+  foreach (lc, state->clauses)
+  {
+    ChessBatchClause *clause = lfirst(lc);
+    Datum value = ExecEvalExprSwitchContext(clause->board, econtext, &clause->isnull);
+
+    if (clause->isnull)
+      continue;
+    memcpy(&clause->target, DatumGetChessBoardP(value), sizeof(ChessBoard));
+    clause->hash = SCL_boardHash32(clause->target.board);
+    clause->bound = PG_INT32_MAX;
+    if (clause->halfMoves != NULL)
+    {
+      value = ExecEvalExprSwitchContext(clause->halfMoves, econtext, &clause->isnull);
+      clause->bound = clause->isnull ? 0 : Max(DatumGetInt32(value), 0);
+    }
+  }
+  state->targetsReady = true;
+}
+
+// read the next tuples of the heap into the batch, returns their number
+static int
+chess_batch_fill(ChessBatchScanState *state)
+{
+  ScanState *ss = &state->css.ss;
+  TableScanDesc scan = ss->ss_currentScanDesc;
+  int count = 0;
+
+  // a heap scan that is called again after its end starts over
+  if (state->done)
+    return 0;
+  if (scan == NULL)
+  {
+    if (state->pscan != NULL)
+      scan = table_beginscan_parallel(ss->ss_currentRelation, state->pscan);
+    else
+      scan = table_beginscan(ss->ss_currentRelation, ss->ps.state->es_snapshot, 0, NULL);
+    ss->ss_currentScanDesc = scan;
+  }
+
+  // the slot of a heap tuple points to the header kept by the scan, which
+  // the next tuple overwrites: batched tuples are copied
+  while (count < CHESS_BATCH_SIZE &&
+         table_scan_getnextslot(scan, ForwardScanDirection, state->slots[count]))
+    ExecMaterializeSlot(state->slots[count++]);
+  state->done = count < CHESS_BATCH_SIZE;
+  state->count = count;
+  state->next = 0;
+  return count;
+}
+
+/*
+Clear the matches of the batch that do not satisfy the clause: games whose
+filter rejects the target are dropped, the others are replayed together,
+each until it reaches the target or its bound.
+*/
+static void
+chess_batch_match_clause(ChessBatchScanState *state, ChessBatchClause *clause)
+{
+  int games[CHESS_BATCH_SIZE];   /* tuple of each replayed game */
+  uint16 bounds[CHESS_BATCH_SIZE];
+  uint32 pieces[CHESS_BATCH_SIZE];
+  int active[CHESS_BATCH_SIZE];  /* games still replayed */
+  int count = 0;
+  int activeCount;
+  SCL_Board initial;
+  uint32 initialPieces;
+
+  for (int i = 0; i < state->count; i++)
+  {
+    bool isnull;
+    Datum value;
+    ChessGame *cg;
+    uint16 bound;
+    SCL_Record record;
+
+    if (!state->matches[i])
+      continue;
+    state->matches[i] = false;
+    if (clause->isnull)
+      continue;
+
+    value = slot_getattr(state->slots[i], clause->attno, &isnull);
+    if (isnull)
+      continue;
+    cg = DatumGetChessGameP(value);
+    if (!chessgame_may_contain(cg, clause->hash))
+      continue;
+
+    bound = Min(cg->length, clause->bound);
+    if (bound > 0 && (cg->flags & CHESSGAME_PACKED))
+      chess_moves_unpack(CHESSGAME_MOVES(cg), CHESSGAME_PACKED_SIZE(cg), bound, record);
+    else
+      chessgame_get_record(cg, record);
+    for (uint16 ply = 0; ply < bound; ply++)
+      state->items[ply * CHESS_BATCH_SIZE + count] = CHESS_MOVE_ITEM(record, ply);
+
+    games[count] = i;
+    bounds[count] = bound;
+    count++;
+  }
+
+  SCL_boardInit(initial);
+  initialPieces = chess_hash32_pieces(initial);
+  for (int g = 0; g < count; g++)
+  {
+    memcpy(state->boards[g], initial, SCL_BOARD_STATE_SIZE);
+    pieces[g] = initialPieces;
+    active[g] = g;
+  }
+
+  activeCount = count;
+  for (uint16 ply = 0; activeCount > 0; ply++)
+  {
+    const uint16 *items = state->items + ply * CHESS_BATCH_SIZE;
+    int kept = 0;
+
+    for (int k = 0; k < activeCount; k++)
+    {
+      int g = active[k];
+      char *board = state->boards[g];
+      char before[SCL_BOARD_SQUARES];
+      uint16 item;
+
+      Assert(chess_hash32_finish(board, pieces[g]) == SCL_boardHash32(board));
+      if (chess_hash32_finish(board, pieces[g]) == clause->hash)
+      {
+        state->matches[games[g]] = true;
+        continue;
+      }
+      if (ply >= bounds[g])
+        continue;
+
+      item = items[g];
+      memcpy(before, board, SCL_BOARD_SQUARES);
+      SCL_boardMakeMove(board, item & 0x3f, (item >> 8) & 0x3f, "qrbn"[item >> 14]);
+      pieces[g] = chess_hash32_update(pieces[g], before, board);
+      active[kept++] = g;
+    }
+    activeCount = kept;
+  }
+}
+
+static TupleTableSlot *
+chess_batch_next(ScanState *node)
+{
+  ChessBatchScanState *state = (ChessBatchScanState *)node;
+
+  if (!state->targetsReady)
+    chess_batch_targets(state);
+
+  for (;;)
+  {
+    ListCell *lc;
+    MemoryContext oldContext;
+
+    while (state->next < state->count)
+    {
+      int i = state->next++;
+
+      if (state->matches[i])
+        return state->slots[i];
+    }
+
+    CHECK_FOR_INTERRUPTS();
+    if (chess_batch_fill(state) == 0)
+      return ExecClearTuple(node->ss_ScanTupleSlot);
+
+    MemoryContextReset(state->batchContext);
+    oldContext = MemoryContextSwitchTo(state->batchContext);
+    memset(state->matches, true, sizeof(bool) * state->count);
+    foreach (lc, state->clauses)
+      chess_batch_match_clause(state, lfirst(lc));
+    MemoryContextSwitchTo(oldContext);
+  }
+}
+
+static bool
+chess_batch_recheck(ScanState *node, TupleTableSlot *slot)
+{
+  ChessBatchScanState *state = (ChessBatchScanState *)node;
+  ExprContext *econtext = node->ps.ps_ExprContext;
+
+  ResetExprContext(econtext);
+  econtext->ecxt_scantuple = slot;
+  return ExecQual(state->recheck, econtext);
+}
+
+static TupleTableSlot *
+chess_batch_exec(CustomScanState *node)
+{
+  return ExecScan(&node->ss, chess_batch_next, chess_batch_recheck);
+}
+
+static void
+chess_batch_end(CustomScanState *node)
+{
+  ChessBatchScanState *state = (ChessBatchScanState *)node;
+
+  // release the buffer pins of the batch
+  for (int i = 0; i < CHESS_BATCH_SIZE; i++)
+    if (state->slots[i] != NULL)
+      ExecClearTuple(state->slots[i]);
+  if (node->ss.ss_currentScanDesc != NULL)
+    table_endscan(node->ss.ss_currentScanDesc);
+}
+
+static void
+chess_batch_rescan(CustomScanState *node)
+{
+  ChessBatchScanState *state = (ChessBatchScanState *)node;
+
+  if (node->ss.ss_currentScanDesc != NULL)
+    table_rescan(node->ss.ss_currentScanDesc, NULL);
+  state->count = state->next = 0;
+  state->targetsReady = false;
+  state->done = false;
+  ExecScanReScan(&node->ss);
+}
+
+static Size
+chess_batch_estimate_dsm(CustomScanState *node, ParallelContext *pcxt)
+{
+  return table_parallelscan_estimate(node->ss.ss_currentRelation,
+                                     node->ss.ps.state->es_snapshot);
+}
+
+static void
+chess_batch_initialize_dsm(CustomScanState *node, ParallelContext *pcxt, void *coordinate)
+{
+  ChessBatchScanState *state = (ChessBatchScanState *)node;
+
+  state->pscan = (ParallelTableScanDesc)coordinate;
+  table_parallelscan_initialize(node->ss.ss_currentRelation, state->pscan,
+                                node->ss.ps.state->es_snapshot);
+}
+
+static void
+chess_batch_reinitialize_dsm(CustomScanState *node, ParallelContext *pcxt, void *coordinate)
+{
+  table_parallelscan_reinitialize(node->ss.ss_currentRelation,
+                                  (ParallelTableScanDesc)coordinate);
+}
+
+static void
+chess_batch_initialize_worker(CustomScanState *node, shm_toc *toc, void *coordinate)
+{
+  ((ChessBatchScanState *)node)->pscan = (ParallelTableScanDesc)coordinate;
+}
+
+static void
+chess_batch_explain(CustomScanState *node, List *ancestors, ExplainState *es)
+{
+  CustomScan *cscan = (CustomScan *)node->ss.ps.plan;
+  List *context = set_deparse_context_plan(es->deparse_cxt, &cscan->scan.plan, ancestors);
+
+  ExplainPropertyText("Batch Filter",
+                      deparse_expression((Node *)make_ands_explicit(cscan->custom_exprs),
+                                         context, list_length(es->rtable) > 1, false),
+                      es);
+}
+
+static CustomPathMethods chess_batch_path_methods = {
+    .CustomName = "ChessBatchScan",
+    .PlanCustomPath = chess_batch_plan_path,
+};
+
+static CustomScanMethods chess_batch_scan_methods = {
+    .CustomName = "ChessBatchScan",
+    .CreateCustomScanState = chess_batch_create_state,
+};
+
+static CustomExecMethods chess_batch_exec_methods = {
+    .CustomName = "ChessBatchScan",
+    .BeginCustomScan = chess_batch_begin,
+    .ExecCustomScan = chess_batch_exec,
+    .EndCustomScan = chess_batch_end,
+    .ReScanCustomScan = chess_batch_rescan,
+    .EstimateDSMCustomScan = chess_batch_estimate_dsm,
+    .InitializeDSMCustomScan = chess_batch_initialize_dsm,
+    .ReInitializeDSMCustomScan = chess_batch_reinitialize_dsm,
+    .InitializeWorkerCustomScan = chess_batch_initialize_worker,
+    .ExplainCustomScan = chess_batch_explain,
+};
+
+static void
+chess_batch_scan_register(void)
+{
+  RegisterCustomScanMethods(&chess_batch_scan_methods);
+  CacheRegisterSyscacheCallback(PROCOID, chess_batch_oids_invalidate, (Datum)0);
+  CacheRegisterSyscacheCallback(OPEROID, chess_batch_oids_invalidate, (Datum)0);
+  prev_set_rel_pathlist_hook = set_rel_pathlist_hook;
+  set_rel_pathlist_hook = chess_batch_set_rel_pathlist;
+}
+
+/*********************************Version 1.0********************************/
+
+/*
+The functions of version 1.0 of the extension, whose chessgame is a whole
+SCL_Record (ChessGame10). A catalog of 1.0 calls them until ALTER EXTENSION
+chess UPDATE, which renames its chessgame type to chessgame_1_0, keeps only
+its input and output and adds the cast to chessgame (chessgame_from_1_0).
+They behave as in 1.0: games are ordered by length only and openings
+compare the squares of the moves.
+*/
+
+static ChessGame10 *
+chessgame_1_0_parse(char *pgn)
+{
+  ChessGame10 *cg = palloc0(sizeof(ChessGame10));
+
+  SCL_recordFromPGN(cg->record, pgn);
+  return cg;
+}
+
+PG_FUNCTION_INFO_V1(chessgame_constructor);
+Datum chessgame_constructor(PG_FUNCTION_ARGS)
+{
+  char *pgn = PG_GETARG_CSTRING(0);
+  PG_RETURN_CHESSGAME10_P(chessgame_1_0_parse(pgn));
+}
+
+PG_FUNCTION_INFO_V1(chessgame_in);
+Datum chessgame_in(PG_FUNCTION_ARGS)
+{
+  char *str = PG_GETARG_CSTRING(0);
+  PG_RETURN_CHESSGAME10_P(chessgame_1_0_parse(str));
+}
+
+PG_FUNCTION_INFO_V1(chessgame_out);
+Datum chessgame_out(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *cg = PG_GETARG_CHESSGAME10_P(0);
+  char *result = palloc0(sizeof(char) * CHESSGAME_PGN_MAX_LENGTH);
+
+  SCL_printPGN(cg->record, result, 0);
+  PG_RETURN_CSTRING(result);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_cast_from_text);
+Datum chessgame_cast_from_text(PG_FUNCTION_ARGS)
+{
+  char *str = text_to_cstring(PG_GETARG_TEXT_PP(0));
+  PG_RETURN_CHESSGAME10_P(chessgame_1_0_parse(str));
+}
+
+/*
+chessgame(chessgame_1_0) -> chessgame: The game of a column of 1.0 in the
+current format, e.g. ALTER TABLE games ALTER COLUMN game TYPE chessgame.
+Version 1.0 kept a decisive result in the end flag of the last move only.
+*/
+PG_FUNCTION_INFO_V1(chessgame_from_1_0);
+Datum chessgame_from_1_0(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *old = PG_GETARG_CHESSGAME10_P(0);
+  SCL_Record record;
+  uint16 length;
+  uint8 result = SCL_GAME_STATE_PLAYING;
+
+  memcpy(record, old->record, sizeof(SCL_Record));
+  length = SCL_recordLength(record);
+  if (length > 0)
+  {
+    uint8 end = record[(length - 1) * 2] & 0xc0;
+
+    if (end == SCL_RECORD_W_WIN)
+      result = SCL_GAME_STATE_WHITE_WIN;
+    else if (end == SCL_RECORD_B_WIN)
+      result = SCL_GAME_STATE_BLACK_WIN;
+  }
+  PG_RETURN_CHESSGAME_P(chessgame_make(record, result, NULL, 0));
+}
+
+PG_FUNCTION_INFO_V1(getBoard);
+Datum getBoard(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *cg = PG_GETARG_CHESSGAME10_P(0);
+  int halfMove = PG_GETARG_INT32(1);
+  ChessBoard *cb = palloc0(sizeof(ChessBoard));
+
+  SCL_recordApply(cg->record, cb->board, halfMove);
+  PG_RETURN_CHESSBOARD_P(cb);
+}
+
+PG_FUNCTION_INFO_V1(getFirstMoves);
+Datum getFirstMoves(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *originalGame = PG_GETARG_CHESSGAME10_P(0);
+  int nOfHalfMoves = PG_GETARG_INT32(1);
+  ChessGame10 *cg = palloc0(sizeof(ChessGame10));
+  int shouldContinue = 1;
+  uint16_t length;
+
+  SCL_recordCopy(originalGame->record, cg->record);
+  length = SCL_recordLength(cg->record);
+  for (uint16_t i = 0; i < (length - nOfHalfMoves) && shouldContinue; i++)
+    shouldContinue = SCL_recordRemoveLast(cg->record);
+
+  PG_RETURN_CHESSGAME10_P(cg);
+}
+
+PG_FUNCTION_INFO_V1(chessgameContainsChessgame);
+Datum chessgameContainsChessgame(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *c1 = PG_GETARG_CHESSGAME10_P(0);
+  ChessGame10 *c2 = PG_GETARG_CHESSGAME10_P(1);
+  uint16_t length1 = SCL_recordLength(c1->record);
+  uint16_t length2 = SCL_recordLength(c2->record);
+
+  if (length2 > length1)
+    PG_RETURN_BOOL(false);
+  for (uint16_t i = 0; i < length2; i++)
+  {
+    uint8_t squareFrom1, squareTo1, squareFrom2, squareTo2;
+    char promotedPiece;
+
+    SCL_recordGetMove(c1->record, i, &squareFrom1, &squareTo1, &promotedPiece);
+    SCL_recordGetMove(c2->record, i, &squareFrom2, &squareTo2, &promotedPiece);
+    if ((squareFrom1 != squareFrom2) || (squareTo1 != squareTo2))
+      PG_RETURN_BOOL(false);
+  }
+  PG_RETURN_BOOL(true);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_contains_chessboard);
+Datum chessgame_contains_chessboard(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *cg = PG_GETARG_CHESSGAME10_P(0);
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(1);
+  uint16_t length = SCL_recordLength(cg->record);
+  uint32_t hash = SCL_boardHash32(cb->board);
+  SCL_Board board;
+
+  for (uint16_t i = 0; i <= length; i++)
+  {
+    SCL_recordApply(cg->record, board, i);
+    if (SCL_boardHash32(board) == hash)
+      PG_RETURN_BOOL(true);
+  }
+  PG_RETURN_BOOL(false);
+}
+
+/*
+The GIN keys of 1.0 are the boards of the game, of the key type of the
+opclass (chessgame): each takes sizeof(ChessGame10) bytes, the board at
+their start, so that the index copies them whole. They are compared by
+material (chessgame_compare), hence the recheck.
+*/
+static Datum
+chessgame_1_0_gin_key(const SCL_Board board)
+{
+  ChessBoard *key = palloc0(sizeof(ChessGame10));
+
+  SCL_boardCopy(board, key->board);
+  return PointerGetDatum(key);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gin_extract_value);
+Datum chessgame_gin_extract_value(PG_FUNCTION_ARGS)
+{
+  ChessGame10 *cg = PG_GETARG_CHESSGAME10_P(0);
+  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
+  uint16_t length = SCL_recordLength(cg->record);
+  Datum *entries = palloc(sizeof(Datum) * (length + 1));
+  SCL_Board board;
+
+  for (uint16_t i = 0; i <= length; ++i)
+  {
+    SCL_recordApply(cg->record, board, i);
+    entries[i] = chessgame_1_0_gin_key(board);
+  }
+  *nkeys = length + 1;
+  PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gin_extract_query);
+Datum chessgame_gin_extract_query(PG_FUNCTION_ARGS)
+{
+  ChessBoard *cb = PG_GETARG_CHESSBOARD_P(0);
+  int32 *nkeys = (int32 *)PG_GETARG_POINTER(1);
+  StrategyNumber strategy = PG_GETARG_UINT16(2);
+  Datum *entries;
+
+  if (strategy != RTContainsStrategyNumber)
+    elog(ERROR, "chessgame_gin_extract_query: unknown strategy number: %d", strategy);
+
+  entries = palloc(sizeof(Datum));
+  entries[0] = chessgame_1_0_gin_key(cb->board);
+  *nkeys = 1;
+  PG_RETURN_POINTER(entries);
+}
+
+PG_FUNCTION_INFO_V1(chessgame_gin_triconsistent);
+Datum chessgame_gin_triconsistent(PG_FUNCTION_ARGS)
+{
+  PG_RETURN_GIN_TERNARY_VALUE(GIN_MAYBE);
+}
+
+// games by length only
+static int
+hasOpening_1_0_internal(FunctionCallInfo fcinfo)
+{
+  ChessGame10 *chessgame1 = PG_GETARG_CHESSGAME10_P(0);
+  ChessGame10 *chessgame2 = PG_GETARG_CHESSGAME10_P(1);
+
+  return SCL_recordLength(chessgame1->record) - SCL_recordLength(chessgame2->record);
 }
 
 PG_FUNCTION_INFO_V1(hasOpening_eq);
 Datum hasOpening_eq(PG_FUNCTION_ARGS)
 {
-  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_P(1);
-  bool result = hasOpening_internal(chessgame1, chessgame2) == 0;
-  PG_FREE_IF_COPY(chessgame1, 0);
-  PG_FREE_IF_COPY(chessgame2, 1);
-  PG_RETURN_BOOL(result);
+  PG_RETURN_BOOL(hasOpening_1_0_internal(fcinfo) == 0);
 }
 
 PG_FUNCTION_INFO_V1(hasOpening_lt);
 Datum hasOpening_lt(PG_FUNCTION_ARGS)
 {
-  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_P(1);
-  bool result = hasOpening_internal(chessgame1, chessgame2) < 0;
-  PG_FREE_IF_COPY(chessgame1, 0);
-  PG_FREE_IF_COPY(chessgame2, 1);
-  PG_RETURN_BOOL(result);
+  PG_RETURN_BOOL(hasOpening_1_0_internal(fcinfo) < 0);
 }
 
 PG_FUNCTION_INFO_V1(hasOpening_le);
 Datum hasOpening_le(PG_FUNCTION_ARGS)
 {
-  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_P(1);
-  bool result = hasOpening_internal(chessgame1, chessgame2) <= 0;
-  PG_FREE_IF_COPY(chessgame1, 0);
-  PG_FREE_IF_COPY(chessgame2, 1);
-  PG_RETURN_BOOL(result);
+  PG_RETURN_BOOL(hasOpening_1_0_internal(fcinfo) <= 0);
 }
 
 PG_FUNCTION_INFO_V1(hasOpening_gt);
 Datum hasOpening_gt(PG_FUNCTION_ARGS)
 {
-  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_P(1);
-  bool result = hasOpening_internal(chessgame1, chessgame2) > 0;
-  PG_FREE_IF_COPY(chessgame1, 0);
-  PG_FREE_IF_COPY(chessgame2, 1);
-  PG_RETURN_BOOL(result);
+  PG_RETURN_BOOL(hasOpening_1_0_internal(fcinfo) > 0);
 }
 
 PG_FUNCTION_INFO_V1(hasOpening_ge);
 Datum hasOpening_ge(PG_FUNCTION_ARGS)
 {
-  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_P(1);
-  bool result = hasOpening_internal(chessgame1, chessgame2) >= 0;
-  PG_FREE_IF_COPY(chessgame1, 0);
-  PG_FREE_IF_COPY(chessgame2, 1);
-  PG_RETURN_BOOL(result);
+  PG_RETURN_BOOL(hasOpening_1_0_internal(fcinfo) >= 0);
 }
 
 PG_FUNCTION_INFO_V1(hasOpening_cmp);
 Datum hasOpening_cmp(PG_FUNCTION_ARGS)
 {
-  ChessGame *chessgame1 = PG_GETARG_CHESSGAME_P(0);
-  ChessGame *chessgame2 = PG_GETARG_CHESSGAME_P(1);
-  int result = hasOpening_internal(chessgame1, chessgame2);
-  PG_FREE_IF_COPY(chessgame1, 0);
-  PG_FREE_IF_COPY(chessgame2, 1);
-  PG_RETURN_INT32(result);
-}
\ No newline at end of file
+  PG_RETURN_INT32(hasOpening_1_0_internal(fcinfo));
+}
@@ -11,13 +11,215 @@ typedef struct
 
 } ChessBoard;
 
+/*
+ * A chesspattern constrains squares of a board: each square holds a piece
+ * (PNBRQKpnbrqk), '.' for a square that must be empty or '?' for any.
+ */
 typedef struct
 {
 
-  SCL_Record record;
+  char squares[SCL_BOARD_SQUARES];
+
+} ChessPattern;
+
+#define CHESS_PATTERN_ANY '?'
+
+/*
+ * GiST key: for each of the 12 pieces, the bitboard of the squares it
+ * occupies (in a board) or has ever occupied (in a game or a subtree).
+ */
+#define CHESS_PIECE_KINDS 12
+
+typedef struct
+{
+
+  uint64 bitboards[CHESS_PIECE_KINDS];
+
+} ChessSignature;
+
+/*
+ * A chessgame is stored as a varlena: a small header followed by the used part
+ * of the SCL_Record (2 bytes per half-move, see smallchesslib.h). The result
+ * is kept in the header so that it can be read without decoding the moves.
+ */
+typedef struct
+{
+
+  int32 vl_len_;  /* varlena header (do not touch directly!) */
+  uint16 length;  /* number of half-moves */
+  uint8 result;   /* SCL_GAME_STATE_* parsed from the PGN result token */
+  uint8 flags;    /* CHESSGAME_HAS_* */
+  uint8 moves[FLEXIBLE_ARRAY_MEMBER];
 
 } ChessGame;
 
+#define CHESSGAME_HDRSZ offsetof(ChessGame, moves)
+
+/* the PGN tag dictionary (see chessgame_tags_next) follows the moves */
+#define CHESSGAME_HAS_TAGS 0x01
+
+/*
+ * The first moves are those of an entry of the chess_prefixes table: the
+ * moves start with the entry id (4 bytes) and its number of half-moves
+ * (2 bytes), little-endian, followed by the other moves only.
+ */
+#define CHESSGAME_HAS_PREFIX 0x02
+
+#define CHESSGAME_PREFIX_SIZE 6
+
+#define CHESSGAME_PREFIX_ID(cg)                                   \
+  ((int32)((uint32)(cg)->moves[0] | (uint32)(cg)->moves[1] << 8 | \
+           (uint32)(cg)->moves[2] << 16 | (uint32)(cg)->moves[3] << 24))
+
+#define CHESSGAME_PREFIX_LENGTH(cg)                                                \
+  (((cg)->flags & CHESSGAME_HAS_PREFIX) ? (uint16)((cg)->moves[4] | (cg)->moves[5] << 8) : 0)
+
+#define CHESSGAME_SET_PREFIX(cg, id, length)       \
+  do                                               \
+  {                                                \
+    (cg)->moves[0] = (uint32)(id) & 0xff;          \
+    (cg)->moves[1] = ((uint32)(id) >> 8) & 0xff;   \
+    (cg)->moves[2] = ((uint32)(id) >> 16) & 0xff;  \
+    (cg)->moves[3] = ((uint32)(id) >> 24) & 0xff;  \
+    (cg)->moves[4] = (length) & 0xff;              \
+    (cg)->moves[5] = ((length) >> 8) & 0xff;       \
+  } while (0)
+
+/*
+ * The moves are a bit stream of legal move indexes (see chess_moves_pack),
+ * preceded by its size in bytes (2 bytes, little-endian).
+ */
+#define CHESSGAME_PACKED 0x04
+
+#define CHESSGAME_PACKED_HDRSZ 2
+#define CHESSGAME_PACKED_SIZE(cg) ((Size)((cg)->moves[0] | (cg)->moves[1] << 8))
+
+/* the stored moves, after the prefix reference or packed size if any */
+#define CHESSGAME_MOVES(cg)                                                     \
+  ((cg)->moves + (((cg)->flags & CHESSGAME_HAS_PREFIX)  ? CHESSGAME_PREFIX_SIZE \
+                  : ((cg)->flags & CHESSGAME_PACKED) ? CHESSGAME_PACKED_HDRSZ   \
+                                                     : 0))
+
+/* bytes taken by the moves, up to the tags */
+#define CHESSGAME_MOVES_SIZE(cg)                                             \
+  (((cg)->flags & CHESSGAME_PACKED)                                          \
+       ? CHESSGAME_PACKED_HDRSZ + CHESSGAME_PACKED_SIZE(cg)                  \
+       : (CHESSGAME_MOVES(cg) - (cg)->moves) + ((cg)->length - CHESSGAME_PREFIX_LENGTH(cg)) * 2)
+
+/*
+ * Board snapshots follow the moves: the interval K (2 bytes, little-endian),
+ * then the boards after K, 2K, ... half-moves and after the last one, each
+ * packed in CHESS_CHECKPOINT_SIZE bytes (see chess_checkpoint_pack).
+ */
+#define CHESSGAME_HAS_CHECKPOINTS 0x08
+
+#define CHESS_CHECKPOINT_SIZE 36 /* 4 bits per square, then the state bytes */
+
+#define CHESSGAME_CHECKPOINTS(cg) ((cg)->moves + CHESSGAME_MOVES_SIZE(cg))
+#define CHESSGAME_CHECKPOINT_INTERVAL(cg)                                             \
+  (((cg)->flags & CHESSGAME_HAS_CHECKPOINTS)                                          \
+       ? (uint16)(CHESSGAME_CHECKPOINTS(cg)[0] | CHESSGAME_CHECKPOINTS(cg)[1] << 8) \
+       : 0)
+#define CHESSGAME_CHECKPOINT_COUNT(length, interval) (((length) + (interval) - 1) / (interval))
+#define CHESSGAME_CHECKPOINTS_SIZE(cg)                                     \
+  (((cg)->flags & CHESSGAME_HAS_CHECKPOINTS)                               \
+       ? 2 + CHESSGAME_CHECKPOINT_COUNT((cg)->length, CHESSGAME_CHECKPOINT_INTERVAL(cg)) * \
+                 CHESS_CHECKPOINT_SIZE                                     \
+       : 0)
+
+/*
+ * A Bloom filter of the SCL_boardHash32 of the positions of the game
+ * follows: the base 2 log of its size in bytes (1 byte), then the bits
+ * (see chessgame_may_contain).
+ */
+#define CHESSGAME_HAS_FILTER 0x10
+
+#define CHESSGAME_FILTER(cg) (CHESSGAME_CHECKPOINTS(cg) + CHESSGAME_CHECKPOINTS_SIZE(cg))
+#define CHESSGAME_FILTER_SIZE(cg) \
+  (((cg)->flags & CHESSGAME_HAS_FILTER) ? 1 + ((Size)1 << CHESSGAME_FILTER(cg)[0]) : 0)
+
+#define CHESSGAME_TAGS(cg) (CHESSGAME_FILTER(cg) + CHESSGAME_FILTER_SIZE(cg))
+#define CHESSGAME_TAGS_SIZE(cg) (VARSIZE(cg) - (CHESSGAME_TAGS(cg) - (const uint8 *)(cg)))
+
+/*
+ * The chessgame of version 1.0 of the extension (chessgame_1_0 once the
+ * extension is updated): a whole SCL_Record, of fixed size.
+ */
+typedef struct
+{
+
+  SCL_Record record;
+
+} ChessGame10;
+
+/* storage formats of the moves, see chess.storage_format and chessgame_compress */
+typedef enum
+{
+  CHESS_STORAGE_PLAIN, /* all the moves in the chessgame */
+  CHESS_STORAGE_PREFIX, /* shared first moves in chess_prefixes */
+  CHESS_STORAGE_PACKED  /* legal move indexes */
+} ChessStorageFormat;
+
+/* upper bound of the PGN text produced for a chessgame */
+#define CHESSGAME_PGN_MAX_LENGTH (SCL_RECORD_MAX_LENGTH * 12)
+
+/* GIN keys are int8 values, the top byte tells what the key represents */
+
+#define CHESS_GIN_KEY_BOARD 0x01  /* SCL_boardHash32 of a position */
+#define CHESS_GIN_KEY_RESULT 0x02 /* game result */
+#define CHESS_GIN_KEY_POSITION 0x03 /* SCL_boardHash64, clocks excluded */
+#define CHESS_GIN_KEY_MATERIAL 0x04 /* material signature of a position */
+#define CHESS_GIN_KEY_MOVE 0x05     /* move token, see CHESS_MOVE_TOKEN */
+#define CHESS_GIN_KEY_TRIGRAM 0x06  /* three moves, see CHESS_MOVE_TRIGRAM */
+
+#define CHESS_GIN_KEY(kind, value) \
+  ((int64)(((uint64)(kind) << 56) | ((uint64)(value) & UINT64CONST(0x00ffffffffffffff))))
+
+/* GIN strategy numbers */
+
+#define CHESS_STRATEGY_BOARD RTContainsStrategyNumber /* @> */
+#define CHESS_STRATEGY_RESULT 8                       /* @@ */
+#define CHESS_STRATEGY_POSITION 9                     /* @~ */
+#define CHESS_STRATEGY_MATERIAL 10                    /* @# */
+#define CHESS_STRATEGY_MOVE 11                        /* @! */
+#define CHESS_STRATEGY_SEQUENCE 12                    /* ~> */
+#define CHESS_STRATEGY_MOVES 13                       /* ~>> */
+
+/*
+ * Move token: the piece (index in "PNBRQK"), target and origin squares,
+ * promotion (0 for none, 1 to 4 for QRBN) and flags, from the high to the
+ * low bits so that the GIN keys of a piece, then of a target, are
+ * contiguous.
+ */
+#define CHESS_MOVE_CAPTURE 0x01
+#define CHESS_MOVE_CHECK 0x02
+#define CHESS_MOVE_MATE 0x04
+
+#define CHESS_MOVE_TOKEN(piece, from, to, promotion, flags)                      \
+  ((uint32)(piece) << 20 | (uint32)(to) << 14 | (uint32)(from) << 8 |            \
+   (uint32)(promotion) << 3 | (uint32)(flags))
+#define CHESS_MOVE_TOKEN_PIECE(token) ((token) >> 20)
+#define CHESS_MOVE_TOKEN_TO(token) (((token) >> 14) & 0x3f)
+#define CHESS_MOVE_TOKEN_FROM(token) (((token) >> 8) & 0x3f)
+#define CHESS_MOVE_TOKEN_PROMOTION(token) (((token) >> 3) & 0x07)
+#define CHESS_MOVE_TOKEN_FLAGS(token) ((token) & 0x07)
+
+/*
+ * Move trigram: three consecutive record items without their end flags
+ * (see CHESS_MOVE_ITEM), the first in the high bits. The last two moves
+ * of a game also start trigrams, padded with CHESS_MOVE_NONE.
+ */
+#define CHESS_MOVE_ITEM(record, i) \
+  ((uint16)(((record)[(i) * 2] & 0x3f) | (record)[(i) * 2 + 1] << 8))
+#define CHESS_MOVE_NONE 0xffff
+#define CHESS_MOVE_TRIGRAM(a, b, c) ((uint64)(a) << 32 | (uint64)(b) << 16 | (uint64)(c))
+
+/*
+ * Material signature: the count of each non-king piece of both sides, 4
+ * bits per piece in the order PNBRQpnbrq (white pawns in the low bits).
+ */
+#define CHESS_MATERIAL_SHIFT(pieceIndex) ((pieceIndex) * 4)
+
 /* fmgr macros chessboard type */
 
 #define ChessBoardPGetDatum(X) PointerGetDatum(X)
@@ -35,7 +237,29 @@ typedef struct
 
 #define PG_RETURN_CHESSGAME_P(x) return ChessGamePGetDatum(x)
 
-#define DatumGetChessGameP(X) ((ChessGame *)DatumGetPointer(X))
+#define DatumGetChessGameP(X) ((ChessGame *)PG_DETOAST_DATUM(X))
 
 #define PG_GETARG_CHESSGAME_P(n) DatumGetChessGameP(PG_GETARG_DATUM(n))
+
+/* only the header fields (length, result, flags), without detoasting the moves */
+#define PG_GETARG_CHESSGAME_HEADER_P(n) \
+  ((ChessGame *)PG_DETOAST_DATUM_SLICE(PG_GETARG_DATUM(n), 0, CHESSGAME_HDRSZ - VARHDRSZ))
+/*****************************************************************************/
+
+/* fmgr macros chesspattern type */
+
+#define DatumGetChessPatternP(X) ((ChessPattern *)DatumGetPointer(X))
+
+#define PG_GETARG_CHESSPATTERN_P(n) DatumGetChessPatternP(PG_GETARG_DATUM(n))
+
+#define DatumGetChessSignatureP(X) ((ChessSignature *)DatumGetPointer(X))
+/*****************************************************************************/
+
+/* fmgr macros chessgame type of version 1.0 */
+
+#define PG_RETURN_CHESSGAME10_P(x) return PointerGetDatum(x)
+
+#define DatumGetChessGame10P(X) ((ChessGame10 *)DatumGetPointer(X))
+
+#define PG_GETARG_CHESSGAME10_P(n) DatumGetChessGame10P(PG_GETARG_DATUM(n))
 /*****************************************************************************/
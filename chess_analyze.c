@@ -0,0 +1,187 @@
+/*
+ * chess_analyze.c
+ *
+ * Standalone analysis with the engine of the extension: prints the best
+ * move and the score (centipawns, positive when white is better) of each
+ * FEN given as argument or read from stdin, one per line.
+ *
+ * usage: chess-analyze [-d depth] [-j workers] [-n nodes] [-t ms] [-m tt_mb] [-D]
+ *                      [FEN...]
+ *
+ * Build with: make chess-analyze
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess_search.h"
+
+#define ANALYZE_EXTENSION_DEPTH 3 /* same as the extension */
+
+static int depth = 4;
+static int workers = 1;
+static long maxNodes = 0;
+static long maxTime = 0;
+static bool deterministic = false;
+
+static void
+usage(const char *progname)
+{
+  fprintf(stderr,
+          "usage: %s [-d depth] [-j workers] [-n nodes] [-t ms] [-m tt_mb] [-D] [FEN...]\n"
+          "  -d  search depth in plies (default 4)\n"
+          "  -j  number of search threads (default 1)\n"
+          "  -n  stop deepening (with several threads, stop searching more root\n"
+          "      moves) after this many positions\n"
+          "  -t  stop deepening (or searching more root moves) after this many\n"
+          "      milliseconds\n"
+          "  -m  transposition table size in MB (default 64, 0 for none)\n"
+          "  -D  deterministic search, without the transposition table\n",
+          progname);
+  exit(1);
+}
+
+// one thread: iterative deepening within the node and time budget
+static int
+analyze_iterative(const char *fen, SCL_Board board)
+{
+  uint8_t squareFrom, squareTo, reached;
+  char promotedPiece;
+  char move[8];
+  int16_t score;
+
+  if (SCL_boardGetPosition(board) != SCL_POSITION_NORMAL &&
+      SCL_boardGetPosition(board) != SCL_POSITION_CHECK)
+  {
+    printf("%s\t(none)\n", fen);
+    return 1;
+  }
+
+  chess_search_use_tt(!deterministic);
+  score = SCL_getAIMoveIterative(board, depth, ANALYZE_EXTENSION_DEPTH, SCL_boardEvaluateStatic,
+                                 maxNodes, chess_search_clock, maxTime, &squareFrom,
+                                 &squareTo, &promotedPiece, &reached);
+  printf("%s\t%s\t%d\tdepth %d\n", fen,
+         SCL_moveToString(board, squareFrom, squareTo, 'q', move),
+         score * 100 / SCL_VALUE_PAWN, reached);
+  return 1;
+}
+
+static int
+analyze(const char *fen)
+{
+  SCL_Board board;
+  ChessSearchJob *job;
+  pthread_t threads[CHESS_SEARCH_MAX_WORKERS];
+  char move[8];
+  int started;
+  int best;
+
+  if (!SCL_boardFromFEN(board, fen))
+  {
+    fprintf(stderr, "invalid FEN: %s\n", fen);
+    return 0;
+  }
+
+  if (workers == 1)
+    return analyze_iterative(fen, board);
+
+  job = malloc(sizeof(ChessSearchJob));
+  if (job == NULL)
+  {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  chess_search_job_init(job, board, depth, ANALYZE_EXTENSION_DEPTH, !deterministic, maxNodes,
+                        chess_search_clock, maxTime);
+  started = chess_search_start(job, threads, workers);
+  if (started == 0)
+    chess_search_run(job);
+  chess_search_join(threads, started);
+
+  best = chess_search_best(job);
+  if (best < 0)
+    printf("%s\t(none)\n", fen);
+  else
+    printf("%s\t%s\t%d\n", fen,
+           SCL_moveToString(board, job->from[best], job->to[best], 'q', move),
+           job->scores[best] * 100 / SCL_VALUE_PAWN);
+
+  free(job);
+  return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+  long ttMegabytes = 64;
+  int ok = 1;
+  int c;
+
+  while ((c = getopt(argc, argv, "d:j:n:t:m:D")) != -1)
+  {
+    switch (c)
+    {
+    case 'd':
+      depth = atoi(optarg);
+      break;
+    case 'j':
+      workers = atoi(optarg);
+      break;
+    case 'n':
+      maxNodes = atol(optarg);
+      break;
+    case 't':
+      maxTime = atol(optarg);
+      break;
+    case 'm':
+      ttMegabytes = atol(optarg);
+      break;
+    case 'D':
+      deterministic = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (depth < 1 || depth > 16 || workers < 1 || workers > CHESS_SEARCH_MAX_WORKERS ||
+      maxNodes < 0 || maxTime < 0 || ttMegabytes < 0)
+    usage(argv[0]);
+
+  if (ttMegabytes > 0 && !deterministic)
+  {
+    uint64_t entries = 1;
+
+    while (entries * 2 * sizeof(ChessTTEntry) <= (uint64_t)ttMegabytes * 1024 * 1024)
+      entries *= 2;
+    chess_search_tt.entries = calloc(entries, sizeof(ChessTTEntry));
+    if (chess_search_tt.entries == NULL)
+    {
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+    chess_search_tt.mask = entries - 1;
+  }
+
+  if (optind < argc)
+  {
+    for (int i = optind; i < argc; i++)
+      ok &= analyze(argv[i]);
+  }
+  else
+  {
+    char line[SCL_FEN_MAX_LENGTH + 32];
+
+    while (fgets(line, sizeof(line), stdin) != NULL)
+    {
+      line[strcspn(line, "\r\n")] = '\0';
+      if (line[0] != '\0')
+        ok &= analyze(line);
+    }
+  }
+
+  free(chess_search_tt.entries);
+  return ok ? 0 : 1;
+}
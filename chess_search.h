@@ -0,0 +1,335 @@
+/*
+ * chess_search.h
+ *
+ * Engine search shared by the extension and the chess-analyze tool: a
+ * lock-free transposition table for smallchesslib and a root-splitting
+ * parallel search on POSIX threads. Include it instead of smallchesslib.h
+ * (define SCL_CALL_WDT_RESET and wdt_reset() before, if needed).
+ *
+ * Worker threads only run the engine on memory set up by the thread that
+ * started them. In a backend that thread does all the palloc, elog/ereport
+ * and CHECK_FOR_INTERRUPTS calls: none of these is thread-safe, hooks
+ * called by the search (wdt_reset(), time functions) must not use them in
+ * a worker (see chess_search_in_worker). Workers run with the signals of
+ * the process blocked, so that its handlers only run in the thread that
+ * started them.
+ */
+#ifndef CHESS_SEARCH_H
+#define CHESS_SEARCH_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+/* set by the caller of the workers to make running searches return early */
+static atomic_bool chess_search_stop;
+
+/* true in worker threads, which must not touch the state of the caller */
+static _Thread_local bool chess_search_in_worker;
+
+#define SCL_THREAD_LOCAL _Thread_local
+#define SCL_SEARCH_STOP atomic_load_explicit(&chess_search_stop, memory_order_relaxed)
+
+#include "smallchesslib.h"
+
+#define CHESS_SEARCH_MAX_WORKERS 64
+#define CHESS_SEARCH_MAX_MOVES 256
+
+/******************************Transposition table*****************************/
+
+/*
+ * Entries are written and read without locks by all the threads. An entry
+ * keeps its data and key ^ data, so that a torn entry (written by two
+ * threads at once) does not verify and is treated as a miss.
+ */
+typedef struct
+{
+  _Atomic uint64_t check; /* key ^ data */
+  _Atomic uint64_t data;  /* see CHESS_TT_DATA, 0 if empty */
+} ChessTTEntry;
+
+typedef struct
+{
+  ChessTTEntry *entries; /* zeroed by the owner, NULL if there is no table */
+  uint64_t mask;         /* number of entries - 1, a power of two */
+} ChessTT;
+
+static ChessTT chess_search_tt;
+
+#define CHESS_TT_DATA(value, depth, bound)                            \
+  ((uint64_t)(uint16_t)(value) | ((uint64_t)(uint8_t)(depth) << 16) | \
+   ((uint64_t)(bound) << 24) | (UINT64_C(1) << 32))
+
+#define CHESS_TT_VALUE(data) ((int16_t)(uint16_t)(data))
+#define CHESS_TT_DEPTH(data) ((int8_t)(uint8_t)((data) >> 16))
+#define CHESS_TT_BOUND(data) ((uint8_t)((data) >> 24))
+
+static inline uint64_t
+chess_tt_key(SCL_Board board, int8_t takenSquare)
+{
+  return SCL_boardHash64(board) ^ _SCL_mix64((uint64_t)(takenSquare + 1) + 0x100);
+}
+
+static uint8_t
+chess_tt_probe(SCL_Board board, int8_t depth, int8_t takenSquare, int16_t *value, uint8_t *bound)
+{
+  uint64_t key = chess_tt_key(board, takenSquare);
+  ChessTTEntry *entry = &chess_search_tt.entries[key & chess_search_tt.mask];
+  uint64_t data = atomic_load_explicit(&entry->data, memory_order_relaxed);
+  uint64_t check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+
+  if (data == 0 || (check ^ data) != key || CHESS_TT_DEPTH(data) < depth)
+    return 0;
+  *value = CHESS_TT_VALUE(data);
+  *bound = CHESS_TT_BOUND(data);
+  return 1;
+}
+
+// keep the result unless the entry holds a deeper search of the same node
+static void
+chess_tt_store(SCL_Board board, int8_t depth, int8_t takenSquare, int16_t value, uint8_t bound)
+{
+  uint64_t key = chess_tt_key(board, takenSquare);
+  ChessTTEntry *entry = &chess_search_tt.entries[key & chess_search_tt.mask];
+  uint64_t old = atomic_load_explicit(&entry->data, memory_order_relaxed);
+  uint64_t data = CHESS_TT_DATA(value, depth, bound);
+
+  // values of an abandoned search are meaningless
+  if (SCL_SEARCH_STOP)
+    return;
+  if (old != 0 && (atomic_load_explicit(&entry->check, memory_order_relaxed) ^ old) == key &&
+      CHESS_TT_DEPTH(old) > depth)
+    return;
+
+  atomic_store_explicit(&entry->data, data, memory_order_relaxed);
+  atomic_store_explicit(&entry->check, key ^ data, memory_order_relaxed);
+}
+
+// hook the table (if any) into the searches of the calling thread
+static void
+chess_search_use_tt(bool enabled)
+{
+  if (enabled && chess_search_tt.entries != NULL)
+    SCL_setTranspositionTable(chess_tt_probe, chess_tt_store);
+  else
+    SCL_setTranspositionTable(0, 0);
+}
+
+// milliseconds for the search budget, from a clock that any thread may read
+static uint32_t
+chess_search_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/******************************Parallel search*********************************/
+
+/*
+ * Root splitting: the legal moves of the root are searched independently
+ * (as SCL_getAIMove does), each by the next free worker. Without the
+ * transposition table the score of every move, hence the result, does not
+ * depend on the number of workers or their scheduling.
+ *
+ * Root moves are searched to the full depth. Once the node or time budget
+ * is spent (after the first move completes), the workers stop taking moves
+ * and the best of the searched ones is played.
+ */
+typedef struct
+{
+  SCL_Board board;
+  uint8_t depth;
+  uint8_t extension;
+  bool useTT;
+  uint32_t maxNodes;         /* 0 for no limit */
+  SCL_TimeFunction timeFunc; /* NULL for no time limit */
+  uint32_t maxTime;
+  uint32_t startTime;
+  int moveCount;
+  uint8_t from[CHESS_SEARCH_MAX_MOVES];
+  uint8_t to[CHESS_SEARCH_MAX_MOVES];
+  int16_t scores[CHESS_SEARCH_MAX_MOVES];
+  bool searched[CHESS_SEARCH_MAX_MOVES];
+  atomic_int next;            /* next root move to search */
+  atomic_int completed;       /* root moves searched */
+  atomic_uint_fast64_t nodes; /* positions searched by all the workers */
+  atomic_int running;         /* started workers that have not finished */
+} ChessSearchJob;
+
+// forget the searched moves, e.g. to search them again in the caller
+static void
+chess_search_job_reset(ChessSearchJob *job)
+{
+  memset(job->searched, 0, sizeof(job->searched));
+  atomic_store(&job->next, 0);
+  atomic_store(&job->completed, 0);
+  atomic_store(&job->nodes, 0);
+  job->startTime = job->timeFunc != NULL ? job->timeFunc() : 0;
+}
+
+// list the root moves in the order in which SCL_getAIMove tries them
+static void
+chess_search_job_init(ChessSearchJob *job, SCL_Board board, uint8_t depth, uint8_t extension,
+                      bool useTT, uint32_t maxNodes, SCL_TimeFunction timeFunc, uint32_t maxTime)
+{
+  memcpy(job->board, board, SCL_BOARD_STATE_SIZE);
+  job->depth = depth;
+  job->extension = extension;
+  job->useTT = useTT;
+  job->maxNodes = maxNodes;
+  job->timeFunc = maxTime != 0 ? timeFunc : NULL;
+  job->maxTime = maxTime;
+  job->moveCount = 0;
+  atomic_init(&job->next, 0);
+  atomic_init(&job->completed, 0);
+  atomic_init(&job->nodes, 0);
+  atomic_init(&job->running, 0);
+  chess_search_job_reset(job);
+
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i)
+    if (board[i] != '.' && SCL_boardWhitesTurn(board) == SCL_pieceIsWhite(board[i]))
+    {
+      SCL_SquareSet moves;
+
+      SCL_squareSetClear(moves);
+      SCL_boardGetMoves(board, i, moves);
+
+      SCL_SQUARE_SET_ITERATE_BEGIN(moves)
+        if (job->moveCount < CHESS_SEARCH_MAX_MOVES)
+        {
+          job->from[job->moveCount] = i;
+          job->to[job->moveCount] = iteratedSquare;
+          job->moveCount++;
+        }
+      SCL_SQUARE_SET_ITERATE_END
+    }
+}
+
+// whether the budget of the job is spent, never before a move is searched
+static bool
+chess_search_over_budget(ChessSearchJob *job)
+{
+  if (atomic_load(&job->completed) == 0)
+    return false;
+  if (job->maxNodes != 0 && atomic_load(&job->nodes) >= job->maxNodes)
+    return true;
+  return job->timeFunc != NULL && job->timeFunc() - job->startTime >= job->maxTime;
+}
+
+// search root moves until there are none left or the budget is spent, in any thread
+static void
+chess_search_run(ChessSearchJob *job)
+{
+  SCL_Board board;
+
+  chess_search_use_tt(job->useTT);
+  _SCL_searchReset();
+  for (;;)
+  {
+    int i;
+
+    if (chess_search_over_budget(job))
+      break;
+
+    i = atomic_fetch_add(&job->next, 1);
+    if (i >= job->moveCount || SCL_SEARCH_STOP)
+      break;
+
+    memcpy(board, job->board, SCL_BOARD_STATE_SIZE);
+    SCL_boardMakeMove(board, job->from[i], job->to[i], 'q');
+    // mates are scored from the root, one ply above the searched position
+    job->scores[i] = _SCL_mateFromNode(SCL_boardEvaluateDynamic(board, job->depth - 1,
+                                                                job->extension,
+                                                                SCL_boardEvaluateStatic),
+                                       1);
+    if (SCL_SEARCH_STOP)
+      break;
+    job->searched[i] = true;
+    atomic_fetch_add(&job->nodes, _SCL_nodes);
+    atomic_fetch_add(&job->completed, 1);
+  }
+}
+
+static void *
+chess_search_thread(void *arg)
+{
+  ChessSearchJob *job = arg;
+
+  chess_search_in_worker = true;
+  chess_search_run(job);
+  atomic_fetch_sub(&job->running, 1);
+  return NULL;
+}
+
+/*
+ * Start up to nworkers threads running routine(arg), with all signals
+ * blocked so that they are still delivered to the calling thread (except
+ * the ones raised by a fault of the thread itself, which cannot be
+ * blocked). running is set to the number of threads started, each has to
+ * decrement it when done. Returns the number of threads started.
+ */
+static int
+chess_search_spawn(pthread_t *threads, int nworkers, void *(*routine)(void *), void *arg,
+                   atomic_int *running)
+{
+  sigset_t all, old;
+  int started = 0;
+
+  if (nworkers > CHESS_SEARCH_MAX_WORKERS)
+    nworkers = CHESS_SEARCH_MAX_WORKERS;
+
+  sigfillset(&all);
+  sigdelset(&all, SIGSEGV);
+  sigdelset(&all, SIGBUS);
+  sigdelset(&all, SIGFPE);
+  sigdelset(&all, SIGILL);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  atomic_store(running, nworkers);
+  for (; started < nworkers; started++)
+    if (pthread_create(&threads[started], NULL, routine, arg) != 0)
+      break;
+  atomic_fetch_sub(running, nworkers - started);
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  return started;
+}
+
+static int
+chess_search_start(ChessSearchJob *job, pthread_t *threads, int nworkers)
+{
+  return chess_search_spawn(threads, nworkers, chess_search_thread, job, &job->running);
+}
+
+static void
+chess_search_join(pthread_t *threads, int nworkers)
+{
+  for (int i = 0; i < nworkers; i++)
+    pthread_join(threads[i], NULL);
+}
+
+/*
+ * Index of the best searched root move for the side to move, the first of
+ * equally scored moves (as in SCL_getAIMove), -1 if there is no legal move.
+ */
+static int
+chess_search_best(const ChessSearchJob *job)
+{
+  bool white = SCL_boardWhitesTurn((char *)job->board);
+  int best = -1;
+
+  for (int i = 0; i < job->moveCount; i++)
+    if (job->searched[i] &&
+        (best < 0 || (white ? job->scores[i] > job->scores[best]
+                            : job->scores[i] < job->scores[best])))
+      best = i;
+  return best;
+}
+
+#endif /* CHESS_SEARCH_H */
@@ -48,6 +48,9 @@
   board).
 */
 #define SCL_CHESS_PIECE_MAX_MOVES 25
+
+/** Maximum number of legal moves in a position. */
+#define SCL_MAX_MOVES 218
 #define SCL_BOARD_SQUARES 64
 
 typedef uint8_t (*SCL_RandomFunction)(void);
@@ -92,6 +95,24 @@ void SCL_randomBetterSeed(uint16_t seed);
   #undef SCL_EVALUATION_FUNCTION
 #endif
 
+#ifndef SCL_THREAD_LOCAL
+  /**
+    Storage class of the global state of the AI search (e.g. _Thread_local),
+    set it to run searches in several threads at once.
+  */
+  #define SCL_THREAD_LOCAL
+#endif
+
+#ifndef SCL_SEARCH_STOP
+  /**
+    If defined, an expression checked at every node of the AI search, when it
+    is true the search returns immediately with meaningless values (e.g. to
+    abandon a search from another thread).
+  */
+  #define SCL_SEARCH_STOP
+  #undef SCL_SEARCH_STOP
+#endif
+
 #ifndef SCL_960_CASTLING
   /**
     If set, chess 960 (Fisher random) castling will be considered by the library
@@ -286,8 +307,41 @@ void SCL_boardInit960(SCL_Board board, uint16_t positionNumber);
 
 void SCL_boardDisableCastling(SCL_Board board);
 
+/**
+  The primes SCL_boardHash32 multiplies by (square + 1) for each piece, as
+  X(piece, prime) entries, so that the hash can be updated incrementally.
+*/
+#define SCL_BOARD_HASH32_PRIMES(X)\
+  X('P',4003)\
+  X('R',84673)\
+  X('N',93911)\
+  X('B',999331)\
+  X('Q',909091)\
+  X('K',2796203)\
+  X('p',4793)\
+  X('r',19391)\
+  X('n',391939)\
+  X('b',108301)\
+  X('q',174763)\
+  X('k',2474431)
+
 uint32_t SCL_boardHash32(const SCL_Board board);
 
+/**
+  Returns the column of a pawn that the player to move can actually capture en
+  passant, or 0x0f if there is no such pawn. The board state remembers the
+  column after every double pawn move, even when no capture is possible.
+*/
+uint8_t SCL_boardEnPassantColumn(const SCL_Board board);
+
+/**
+  Computes a 64 bit Zobrist-like hash of the position: piece placement, player
+  to move, castling rights and a possible en passant capture. Unlike
+  SCL_boardHash32 it ignores the ply and move counters, so the same position
+  reached by a different move order (a transposition) gets the same hash.
+*/
+uint64_t SCL_boardHash64(const SCL_Board board);
+
 #define SCL_PHASE_OPENING 0
 #define SCL_PHASE_MIDGAME 1
 #define SCL_PHASE_ENDGAME 2
@@ -361,6 +415,37 @@ int16_t SCL_boardEvaluateDynamic(SCL_Board board, uint8_t baseDepth,
 
 #define SCL_EVALUATION_MAX_SCORE 32600 // don't increase this, we need a margin
 
+#define SCL_TT_EXACT 0 ///< stored value is the exact search result
+#define SCL_TT_LOWER 1 ///< stored value is a lower bound for the moving side
+
+/**
+  Looks up a position in a transposition table. depth is the remaining search
+  depth and takenSquare the capture extension square (or -1) of the node.
+  Should return 1 and fill value (with the semantics of an evaluation
+  function, mate scores counting the plies from this position) and bound
+  (SCL_TT_*) if an entry for the position searched at least as deep exists, 0
+  otherwise.
+*/
+typedef uint8_t (*SCL_TTProbeFunction)(SCL_Board board, int8_t depth,
+  int8_t takenSquare, int16_t *value, uint8_t *bound);
+
+/**
+  Stores the result of a searched position in a transposition table, the
+  parameters are the same as for SCL_TTProbeFunction.
+*/
+typedef void (*SCL_TTStoreFunction)(SCL_Board board, int8_t depth,
+  int8_t takenSquare, int16_t value, uint8_t bound);
+
+/**
+  Makes SCL_boardEvaluateDynamic (and so SCL_getAIMove) use a transposition
+  table through the given functions, pass 0s to search without one. The
+  setting is per thread if SCL_THREAD_LOCAL is set. Stored results depend on
+  the extension depth and evaluation function, the table has to be cleared
+  if these change.
+*/
+void SCL_setTranspositionTable(SCL_TTProbeFunction probe,
+  SCL_TTStoreFunction store);
+
 /**
   Checks if the board position is dead, i.e. mate is impossible (e.g. due to
   insufficient material), which by the rules results in a draw. WARNING: This
@@ -583,9 +668,13 @@ uint8_t SCL_gameGetRepetiotionMove(SCL_Game *game,
 /**
   Leads a game record from PGN string. The function will probably not strictly
   adhere to the PGN input format, but should accept most sanely written PGN
-  strings.
+  strings. Parsing stops at the game termination marker ("1-0", "0-1",
+  "1/2-1/2" or "*"), a decisive result is also stored in the end flag of the
+  last record item. Returns the game result as one of SCL_GAME_STATE_WHITE_WIN,
+  SCL_GAME_STATE_BLACK_WIN, SCL_GAME_STATE_DRAW or SCL_GAME_STATE_PLAYING (for
+  "*" or missing marker).
 */
-void SCL_recordFromPGN(SCL_Record r, const char *pgn);
+uint8_t SCL_recordFromPGN(SCL_Record r, const char *pgn);
 
 uint16_t SCL_recordLength(const SCL_Record r);
 
@@ -653,6 +742,35 @@ int16_t SCL_getAIMove(
   uint8_t *resultTo,
   char *resultProm);
 
+/**
+  Returns a time in milliseconds (from any origin, it may wrap around), used
+  to bound the duration of a search.
+*/
+typedef uint32_t (*SCL_TimeFunction)(void);
+
+/**
+  Like SCL_getAIMove without randomness, but searches with iterative
+  deepening: to depth 1, 2, ... up to maxDepth, each iteration searching the
+  principal variation of the previous one first and ordering the other moves
+  by MVV-LVA, killer moves and history. The search stops early once maxNodes
+  positions have been searched or maxTime milliseconds (measured with
+  timeFunc) have passed, 0 meaning no limit, and returns the result of the
+  last completed iteration (the first one always completes). If resultDepth
+  is not 0, the depth of that iteration is written to it.
+*/
+int16_t SCL_getAIMoveIterative(
+  SCL_Board board,
+  uint8_t maxDepth,
+  uint8_t extensionExtraDepth,
+  SCL_StaticEvaluationFunction evalFunc,
+  uint32_t maxNodes,
+  SCL_TimeFunction timeFunc,
+  uint32_t maxTime,
+  uint8_t *resultFrom,
+  uint8_t *resultTo,
+  char *resultProm,
+  uint8_t *resultDepth);
+
 /**
   Function that prints out a single character. This is passed to printing
   functions.
@@ -1002,7 +1120,27 @@ void SCL_recordInit(SCL_Record r)
   r[1] = 0;
 }
 
-void SCL_recordFromPGN(SCL_Record r, const char *pgn)
+/**
+  Checks if a PGN game termination marker starts at given position, returns 1
+  and the SCL_GAME_STATE_* value of the result if so, otherwise 0.
+*/
+static uint8_t _SCL_PGNResult(const char *pgn, uint8_t *result)
+{
+  if (pgn[0] == '*')
+    *result = SCL_GAME_STATE_PLAYING;
+  else if (pgn[0] == '1' && pgn[1] == '-' && pgn[2] == '0')
+    *result = SCL_GAME_STATE_WHITE_WIN;
+  else if (pgn[0] == '0' && pgn[1] == '-' && pgn[2] == '1')
+    *result = SCL_GAME_STATE_BLACK_WIN;
+  else if (pgn[0] == '1' && pgn[1] == '/' && pgn[2] == '2' && pgn[3] == '-')
+    *result = SCL_GAME_STATE_DRAW;
+  else
+    return 0;
+
+  return 1;
+}
+
+uint8_t SCL_recordFromPGN(SCL_Record r, const char *pgn)
 {
   SCL_Board board;
 
@@ -1012,13 +1150,16 @@ void SCL_recordFromPGN(SCL_Record r, const char *pgn)
 
   uint8_t state = 0;
   uint8_t evenMove = 0;
+  uint8_t result = SCL_GAME_STATE_PLAYING;
 
-  while (*pgn != 0)
+  while (*pgn != 0 && state != 5)
   {
     switch (state)
     {
       case 0: // skipping tags and spaces, outside []
-        if (*pgn == '1')
+        if (_SCL_PGNResult(pgn,&result))
+          state = 5;
+        else if (*pgn == '1')
           state = 2;
         else if (*pgn == '[')
           state = 1;
@@ -1032,7 +1173,9 @@ void SCL_recordFromPGN(SCL_Record r, const char *pgn)
         break;
 
       case 2: // reading move number
-        if (*pgn == '{')
+        if (_SCL_PGNResult(pgn,&result))
+          state = 5;
+        else if (*pgn == '{')
           state = 3;
         else if ((*pgn >= 'a' && *pgn <= 'h') || (*pgn >= 'A' && *pgn <= 'Z'))
         {
@@ -1050,6 +1193,12 @@ void SCL_recordFromPGN(SCL_Record r, const char *pgn)
 
       case 4: // reading move
       {
+        if (_SCL_PGNResult(pgn,&result))
+        {
+          state = 5;
+          break;
+        }
+
         char piece = 'p';
         char promoteTo = 'q';
         uint8_t castle = 0;
@@ -1165,7 +1314,10 @@ void SCL_recordFromPGN(SCL_Record r, const char *pgn)
         }
 
         if (*pgn == 0)
-          return;
+        {
+          state = 5;
+          break;
+        }
 
         pgn--;
 
@@ -1177,11 +1329,25 @@ void SCL_recordFromPGN(SCL_Record r, const char *pgn)
         break;
       }
 
-      default: break;
+      default: break; // 5: done, result marker or end of input
     }
 
-    pgn++;
+    if (state != 5)
+      pgn++;
   }
+
+  uint16_t l = SCL_recordLength(r);
+
+  if (l != 0 && 
+    (result == SCL_GAME_STATE_WHITE_WIN || result == SCL_GAME_STATE_BLACK_WIN))
+  {
+    l = (l - 1) * 2;
+
+    r[l] = (r[l] & 0x3f) | (result == SCL_GAME_STATE_WHITE_WIN ?
+      SCL_RECORD_W_WIN : SCL_RECORD_B_WIN);
+  }
+
+  return result;
 }
 
 uint16_t SCL_recordLength(const SCL_Record r)
@@ -2630,9 +2796,159 @@ int16_t SCL_boardEvaluateStatic(SCL_Board board)
 #undef PAWN_PAIR_BONUS
 #undef KING_CENTERNESS
 
-SCL_StaticEvaluationFunction _SCL_staticEvaluationFunction;
-int16_t _SCL_currentEval;
-int8_t _SCL_depthHardLimit;
+SCL_THREAD_LOCAL SCL_StaticEvaluationFunction _SCL_staticEvaluationFunction;
+SCL_THREAD_LOCAL int16_t _SCL_currentEval;
+SCL_THREAD_LOCAL int8_t _SCL_depthHardLimit;
+SCL_THREAD_LOCAL SCL_TTProbeFunction _SCL_ttProbe = 0;
+SCL_THREAD_LOCAL SCL_TTStoreFunction _SCL_ttStore = 0;
+
+void SCL_setTranspositionTable(SCL_TTProbeFunction probe,
+  SCL_TTStoreFunction store)
+{
+  _SCL_ttProbe = probe;
+  _SCL_ttStore = store;
+}
+
+#define _SCL_MAX_PLY 64
+
+/* scores beyond this are mates, scored SCL_EVALUATION_MAX_SCORE minus the ply
+   at which the mate happens */
+#define _SCL_MATE_BOUND (SCL_EVALUATION_MAX_SCORE - _SCL_MAX_PLY)
+
+/* Converts a mate score between the ply of the node (as found by the search)
+   and the node itself (as kept in the transposition table), so that a stored
+   result is valid wherever the position is reached again. */
+static int16_t _SCL_mateToNode(int16_t value, uint8_t ply)
+{
+  return value > _SCL_MATE_BOUND ? value + ply :
+    (value < -1 * _SCL_MATE_BOUND ? value - ply : value);
+}
+
+static int16_t _SCL_mateFromNode(int16_t value, uint8_t ply)
+{
+  return value > _SCL_MATE_BOUND ? value - ply :
+    (value < -1 * _SCL_MATE_BOUND ? value + ply : value);
+}
+
+/* move ordering state: killer moves per ply (from, to) and history counters
+   of quiet moves that caused cutoffs */
+SCL_THREAD_LOCAL uint8_t _SCL_killers[_SCL_MAX_PLY][2][2];
+SCL_THREAD_LOCAL uint16_t _SCL_history[SCL_BOARD_SQUARES][SCL_BOARD_SQUARES];
+
+/* principal variation: _SCL_pv is built by the current search (triangular
+   table), _SCL_prevPV holds the one of the previous iteration, which is
+   searched first while _SCL_followPV is set */
+SCL_THREAD_LOCAL uint8_t _SCL_pv[_SCL_MAX_PLY][_SCL_MAX_PLY][2];
+SCL_THREAD_LOCAL uint8_t _SCL_pvLength[_SCL_MAX_PLY];
+SCL_THREAD_LOCAL uint8_t _SCL_prevPV[_SCL_MAX_PLY][2];
+SCL_THREAD_LOCAL uint8_t _SCL_prevPVLength;
+SCL_THREAD_LOCAL uint8_t _SCL_followPV;
+SCL_THREAD_LOCAL uint8_t _SCL_ply;
+
+/* search budget, checked only while _SCL_limited is set */
+SCL_THREAD_LOCAL uint8_t _SCL_limited;
+SCL_THREAD_LOCAL uint8_t _SCL_aborted;
+SCL_THREAD_LOCAL uint32_t _SCL_nodes;
+SCL_THREAD_LOCAL uint32_t _SCL_maxNodes;
+SCL_THREAD_LOCAL SCL_TimeFunction _SCL_timeFunction;
+SCL_THREAD_LOCAL uint32_t _SCL_startTime;
+SCL_THREAD_LOCAL uint32_t _SCL_maxTime;
+
+// resets the state of a single SCL_boardEvaluateDynamic call
+static void _SCL_searchStart(void)
+{
+  _SCL_prevPVLength = 0;
+  _SCL_followPV = 0;
+  _SCL_ply = 0;
+  _SCL_limited = 0;
+  _SCL_aborted = 0;
+  _SCL_nodes = 0;
+}
+
+/* Also forgets the move ordering tables: done once per search of a move to
+   play, not for each of the root moves it evaluates, as clearing them costs
+   more than a small search. */
+static void _SCL_searchReset(void)
+{
+  for (uint8_t i = 0; i < _SCL_MAX_PLY; ++i)
+  {
+    _SCL_killers[i][0][0] = _SCL_killers[i][0][1] = 0;
+    _SCL_killers[i][1][0] = _SCL_killers[i][1][1] = 0;
+  }
+
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i)
+    for (uint8_t j = 0; j < SCL_BOARD_SQUARES; ++j)
+      _SCL_history[i][j] = 0;
+
+  _SCL_searchStart();
+}
+
+/**
+  Move ordering score: the move of the previous principal variation first,
+  then captures by MVV-LVA (most valuable victim, least valuable attacker),
+  killer moves and quiet moves by their history.
+*/
+static int16_t _SCL_moveOrderScore(SCL_Board board, uint8_t from, uint8_t to,
+  uint8_t pvFrom, uint8_t pvTo)
+{
+  if (from == pvFrom && to == pvTo)
+    return 30000;
+
+  if (board[to] != '.')
+    return 20000 + SCL_pieceValuePositive(board[to]) -
+      SCL_pieceValuePositive(board[from]) / 32;
+
+  if (_SCL_ply < _SCL_MAX_PLY)
+  {
+    if (_SCL_killers[_SCL_ply][0][0] == from &&
+      _SCL_killers[_SCL_ply][0][1] == to)
+      return 19001;
+
+    if (_SCL_killers[_SCL_ply][1][0] == from &&
+      _SCL_killers[_SCL_ply][1][1] == to)
+      return 19000;
+  }
+
+  return _SCL_history[from][to] > 18000 ? 18000 : _SCL_history[from][to];
+}
+
+// remember a quiet move that caused a cutoff
+static void _SCL_recordCutoff(SCL_Board board, uint8_t from, uint8_t to, int8_t depth)
+{
+  if (board[to] != '.')
+    return;
+
+  if (_SCL_ply < _SCL_MAX_PLY &&
+    (_SCL_killers[_SCL_ply][0][0] != from ||
+     _SCL_killers[_SCL_ply][0][1] != to))
+  {
+    _SCL_killers[_SCL_ply][1][0] = _SCL_killers[_SCL_ply][0][0];
+    _SCL_killers[_SCL_ply][1][1] = _SCL_killers[_SCL_ply][0][1];
+    _SCL_killers[_SCL_ply][0][0] = from;
+    _SCL_killers[_SCL_ply][0][1] = to;
+  }
+
+  if (depth > 0)
+  {
+    uint16_t bonus = depth * depth;
+
+    _SCL_history[from][to] = _SCL_history[from][to] > 60000 - bonus ?
+      60000 : _SCL_history[from][to] + bonus;
+  }
+}
+
+// checks the search budget, every 1024 nodes for the time
+static uint8_t _SCL_searchOverBudget(void)
+{
+  if (_SCL_maxNodes != 0 && _SCL_nodes >= _SCL_maxNodes)
+    return 1;
+
+  if (_SCL_timeFunction != 0 && (_SCL_nodes & 0x3ff) == 0 &&
+    _SCL_timeFunction() - _SCL_startTime >= _SCL_maxTime)
+    return 1;
+
+  return 0;
+}
 
 /**
   Inner recursive function for SCL_boardEvaluateDynamic. It is passed a square
@@ -2649,12 +2965,29 @@ int16_t _SCL_boardEvaluateDynamic(SCL_Board board, int8_t depth,
   wdt_reset();
 #endif
 
+#ifdef SCL_SEARCH_STOP
+  if (SCL_SEARCH_STOP)
+    return 0;
+#endif
+
+  _SCL_nodes++;
+
+  if (_SCL_limited && !_SCL_aborted && _SCL_searchOverBudget())
+    _SCL_aborted = 1;
+
+  if (_SCL_aborted)
+    return 0;
+
   uint8_t whitesTurn = SCL_boardWhitesTurn(board);
   int8_t valueMultiply = whitesTurn ? 1 : -1;
   int16_t bestMoveValue = -1 * SCL_EVALUATION_MAX_SCORE;
   uint8_t shouldCompute = depth > 0;
   uint8_t extended = 0;
   uint8_t positionType = SCL_boardGetPosition(board);
+  uint8_t ply = _SCL_ply;
+
+  if (ply < _SCL_MAX_PLY)
+    _SCL_pvLength[ply] = ply;
 
   if (!shouldCompute)
   {
@@ -2673,17 +3006,43 @@ int16_t _SCL_boardEvaluateDynamic(SCL_Board board, int8_t depth,
   uint8_t debugFirst = 1;
 #endif
 
-  if (shouldCompute &&
+  uint8_t searched = 0;
+  uint8_t end = 0;
+  int8_t searchDepth = depth;
+
+  if (shouldCompute && ply + 1 < _SCL_MAX_PLY &&
     (positionType == SCL_POSITION_NORMAL || positionType == SCL_POSITION_CHECK))
   {
+    alphaBeta *= valueMultiply;
+
+    if (_SCL_ttProbe != 0)
+    {
+      int16_t ttValue;
+      uint8_t ttBound;
+
+      if (_SCL_ttProbe(board,depth,takenSquare,&ttValue,&ttBound))
+      {
+        ttValue = _SCL_mateFromNode(ttValue,ply);
+
+        if (ttBound == SCL_TT_EXACT || ttValue * valueMultiply > alphaBeta)
+          return ttValue;
+      }
+    }
+
 #if SCL_DEBUG_AI
     putchar('(');
 #endif
 
-    alphaBeta *= valueMultiply;
-    uint8_t end = 0;
+    uint8_t moveFrom[SCL_MAX_MOVES];
+    uint8_t moveTo[SCL_MAX_MOVES];
+    int16_t moveScore[SCL_MAX_MOVES];
+    uint8_t moveCount = 0;
+    uint8_t followPV = _SCL_followPV && ply < _SCL_prevPVLength;
+    uint8_t pvFrom = followPV ? _SCL_prevPV[ply][0] : 0;
+    uint8_t pvTo = followPV ? _SCL_prevPV[ply][1] : 0;
     const char *b = board;
 
+    searched = 1;
     depth--;
 
     for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i, ++b)
@@ -2698,75 +3057,110 @@ int16_t _SCL_boardEvaluateDynamic(SCL_Board board, int8_t depth,
 
         SCL_boardGetMoves(board,i,moves);
 
-        if (!SCL_squareSetEmpty(moves))
-        {
-          SCL_SQUARE_SET_ITERATE_BEGIN(moves)
+        SCL_SQUARE_SET_ITERATE_BEGIN(moves)
+          if (moveCount < SCL_MAX_MOVES)
+          {
+            moveFrom[moveCount] = i;
+            moveTo[moveCount] = iteratedSquare;
+            moveScore[moveCount] =
+              _SCL_moveOrderScore(board,i,iteratedSquare,pvFrom,pvTo);
+            moveCount++;
+          }
+        SCL_SQUARE_SET_ITERATE_END
+      } // valid piece?
+    } // for each square
 
-            int8_t captureExtension = -1;
-            
-            if (board[iteratedSquare] != '.' &&   // takes a piece
-              (takenSquare == -1 ||               // extend on first taken sq. 
-              (extended && takenSquare != -1) ||  // ignore check extension
-              (iteratedSquare == takenSquare)))   // extend on same sq. taken
-              captureExtension = iteratedSquare;
+    for (uint8_t m = 0; m < moveCount && !end; ++m)
+    {
+      // pick the best ordered move left (selection sort, cutoffs are early)
+      uint8_t pick = m;
 
-            SCL_MoveUndo undo = SCL_boardMakeMove(board,i,iteratedSquare,'q');
+      for (uint8_t j = m + 1; j < moveCount; ++j)
+        if (moveScore[j] > moveScore[pick])
+          pick = j;
 
-            uint8_t s0Dummy, s1Dummy;
-            char pDummy;
+      if (pick != m)
+      {
+        uint8_t t8;
+        int16_t t16;
 
-            SCL_UNUSED(s0Dummy);
-            SCL_UNUSED(s1Dummy);
-            SCL_UNUSED(pDummy);
+        t8 = moveFrom[m]; moveFrom[m] = moveFrom[pick]; moveFrom[pick] = t8;
+        t8 = moveTo[m]; moveTo[m] = moveTo[pick]; moveTo[pick] = t8;
+        t16 = moveScore[m]; moveScore[m] = moveScore[pick]; moveScore[pick] = t16;
+      }
+
+      uint8_t from = moveFrom[m];
+      uint8_t to = moveTo[m];
+      int8_t captureExtension = -1;
+            
+      if (board[to] != '.' &&               // takes a piece
+        (takenSquare == -1 ||               // extend on first taken sq. 
+        (extended && takenSquare != -1) ||  // ignore check extension
+        (to == takenSquare)))               // extend on same sq. taken
+        captureExtension = to;
+
+      SCL_MoveUndo undo = SCL_boardMakeMove(board,from,to,'q');
 
 #if SCL_DEBUG_AI
-            if (debugFirst)
-              debugFirst = 0;
-            else
-              putchar(',');
+      if (debugFirst)
+        debugFirst = 0;
+      else
+        putchar(',');
 
-            if (extended)
-              putchar('*');
+      if (extended)
+        putchar('*');
 
-            printf("%s ",SCL_moveToString(board,i,iteratedSquare,'q',moveStr));
+      printf("%s ",SCL_moveToString(board,from,to,'q',moveStr));
 #endif
 
-            int16_t value = _SCL_boardEvaluateDynamic(
-              board,
-              depth, // this is depth - 1, we decremented it
+      _SCL_followPV = followPV && from == pvFrom && to == pvTo;
+      _SCL_ply = ply + 1;
+
+      int16_t value = _SCL_boardEvaluateDynamic(
+        board,
+        depth, // this is depth - 1, we decremented it
 #if SCL_ALPHA_BETA
-              valueMultiply * bestMoveValue,
+        valueMultiply * bestMoveValue,
 #else
-              0,
+        0,
 #endif      
-              captureExtension
-              ) * valueMultiply;
+        captureExtension
+        ) * valueMultiply;
 
-            SCL_boardUndoMove(board,undo);
+      _SCL_ply = ply;
+      SCL_boardUndoMove(board,undo);
 
-            if (value > bestMoveValue) 
-            {
-              bestMoveValue = value;
+      if (_SCL_aborted)
+        return 0;
 
-#if SCL_ALPHA_BETA
-              // alpha-beta pruning:
+      if (value > bestMoveValue) 
+      {
+        bestMoveValue = value;
 
-              if (value > alphaBeta) // no, >= can't be here
-              {
-                end = 1;
-                iterationEnd = 1;
-              }
-#endif
-            }
+        // extend the principal variation with the one of the child
+        _SCL_pv[ply][ply][0] = from;
+        _SCL_pv[ply][ply][1] = to;
 
-          SCL_SQUARE_SET_ITERATE_END
-        } // !squre set empty?
-      } // valid piece?
+        for (uint8_t j = ply + 1; j < _SCL_pvLength[ply + 1]; ++j)
+        {
+          _SCL_pv[ply][j][0] = _SCL_pv[ply + 1][j][0];
+          _SCL_pv[ply][j][1] = _SCL_pv[ply + 1][j][1];
+        }
 
-      if (end)
-        break;
+        _SCL_pvLength[ply] = _SCL_pvLength[ply + 1] > ply + 1 ?
+          _SCL_pvLength[ply + 1] : ply + 1;
 
-    } // for each square
+#if SCL_ALPHA_BETA
+        // alpha-beta pruning:
+
+        if (value > alphaBeta) // no, >= can't be here
+        {
+          end = 1;
+          _SCL_recordCutoff(board,from,to,searchDepth);
+        }
+#endif
+      }
+    } // for each move
 
 #if SCL_DEBUG_AI
   putchar(')');
@@ -2786,26 +3180,31 @@ int16_t _SCL_boardEvaluateDynamic(SCL_Board board, int8_t depth,
        versa. */
     if (positionType == SCL_POSITION_STALEMATE)
       bestMoveValue *= -1;
+    /* Mates are scored by their distance (in plies) from the start of the
+       search, so that mates far away are seen as worse compared to mates
+       achieved in fewer moves. Without this an AI in winning situation may
+       just repeat random moves and draw by repetition even if it has mate in
+       1 (it sees all moves as leading to mate). */
+    else if (positionType == SCL_POSITION_MATE)
+      bestMoveValue = -1 * SCL_EVALUATION_MAX_SCORE + ply;
   }
 
-  /* Here we either improve (if the move worsens the situation) or devalve (if
-     it improves the situation) the result: this needs to be done so that good
-     moves far away are seen as worse compared to equally good moves achieved
-     in fewer moves. Without this an AI in winning situation may just repeat
-     random moves and draw by repetition even if it has mate in 1 (it sees all
-     moves as leading to mate). */
-  bestMoveValue += bestMoveValue > _SCL_currentEval * valueMultiply ? -1 : 1;
-
 #if SCL_DEBUG_AI
   printf("%d",bestMoveValue * valueMultiply);
 #endif
 
+  if (searched && _SCL_ttStore != 0)
+    _SCL_ttStore(board,searchDepth,takenSquare,
+      _SCL_mateToNode(bestMoveValue * valueMultiply,ply),
+      end ? SCL_TT_LOWER : SCL_TT_EXACT);
+
   return bestMoveValue * valueMultiply;
 }
 
 int16_t SCL_boardEvaluateDynamic(SCL_Board board, uint8_t baseDepth,
   uint8_t extensionExtraDepth, SCL_StaticEvaluationFunction evalFunction)
 {
+  _SCL_searchStart();
   _SCL_staticEvaluationFunction = evalFunction;
   _SCL_currentEval = evalFunction(board);
   _SCL_depthHardLimit = 0;
@@ -2905,6 +3304,7 @@ int16_t SCL_getAIMove(
   *resultFrom = 0;
   *resultTo = 0;
   *resultProm = 'q';
+  _SCL_searchReset();
 
   int16_t bestScore =
     SCL_boardWhitesTurn(board) ?
@@ -2999,6 +3399,166 @@ board,i,iteratedSquare,'q',moveStr));
   return bestScore;
 }
 
+int16_t SCL_getAIMoveIterative(
+  SCL_Board board,
+  uint8_t maxDepth,
+  uint8_t extensionExtraDepth,
+  SCL_StaticEvaluationFunction evalFunc,
+  uint32_t maxNodes,
+  SCL_TimeFunction timeFunc,
+  uint32_t maxTime,
+  uint8_t *resultFrom,
+  uint8_t *resultTo,
+  char *resultProm,
+  uint8_t *resultDepth)
+{
+  uint8_t moveFrom[SCL_MAX_MOVES];
+  uint8_t moveTo[SCL_MAX_MOVES];
+  int16_t moveScore[SCL_MAX_MOVES]; // last iteration, for the side to move
+  uint8_t moveCount = 0;
+  int8_t valueMultiply = SCL_boardWhitesTurn(board) ? 1 : -1;
+  int16_t bestScore;
+
+  _SCL_searchReset();
+  _SCL_staticEvaluationFunction = evalFunc;
+#ifndef SCL_EVALUATION_FUNCTION
+  _SCL_currentEval = evalFunc(board);
+#else
+  _SCL_currentEval = SCL_EVALUATION_FUNCTION(board);
+#endif
+  _SCL_depthHardLimit = 0;
+  _SCL_depthHardLimit -= extensionExtraDepth;
+  _SCL_maxNodes = maxNodes;
+  _SCL_timeFunction = maxTime != 0 ? timeFunc : 0;
+  _SCL_maxTime = maxTime;
+  _SCL_startTime = _SCL_timeFunction != 0 ? _SCL_timeFunction() : 0;
+
+  *resultFrom = 0;
+  *resultTo = 0;
+  *resultProm = 'q';
+  bestScore = _SCL_currentEval;
+
+  if (resultDepth != 0)
+    *resultDepth = 0;
+
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i)
+    if (board[i] != '.' && 
+      SCL_boardWhitesTurn(board) == SCL_pieceIsWhite(board[i]))
+    {
+      SCL_SquareSet moves;
+
+      SCL_squareSetClear(moves);
+
+      SCL_boardGetMoves(board,i,moves);
+
+      SCL_SQUARE_SET_ITERATE_BEGIN(moves)
+        if (moveCount < SCL_MAX_MOVES)
+        {
+          moveFrom[moveCount] = i;
+          moveTo[moveCount] = iteratedSquare;
+          moveScore[moveCount] = _SCL_moveOrderScore(board,i,iteratedSquare,0,0);
+          moveCount++;
+        }
+      SCL_SQUARE_SET_ITERATE_END
+    }
+
+  for (uint8_t depth = 1; depth <= maxDepth && moveCount > 0; ++depth)
+  {
+    int16_t best = -1 * SCL_EVALUATION_MAX_SCORE - 1;
+    uint8_t bestIndex = 0;
+
+    // best moves of the previous iteration first (stable insertion sort)
+    for (uint8_t m = 1; m < moveCount; ++m)
+    {
+      uint8_t from = moveFrom[m], to = moveTo[m];
+      int16_t score = moveScore[m];
+      uint8_t j = m;
+
+      while (j > 0 && moveScore[j - 1] < score)
+      {
+        moveFrom[j] = moveFrom[j - 1];
+        moveTo[j] = moveTo[j - 1];
+        moveScore[j] = moveScore[j - 1];
+        j--;
+      }
+
+      moveFrom[j] = from;
+      moveTo[j] = to;
+      moveScore[j] = score;
+    }
+
+    _SCL_limited = depth > 1;
+
+    for (uint8_t m = 0; m < moveCount; ++m)
+    {
+      uint8_t from = moveFrom[m];
+      uint8_t to = moveTo[m];
+      int8_t captureExtension = board[to] != '.' ? to : -1;
+
+      SCL_MoveUndo undo = SCL_boardMakeMove(board,from,to,'q');
+
+      _SCL_followPV = _SCL_prevPVLength > 1 &&
+        _SCL_prevPV[0][0] == from && _SCL_prevPV[0][1] == to;
+      _SCL_ply = 1;
+
+      int16_t value = _SCL_boardEvaluateDynamic(board,depth - 1,
+        valueMultiply * best,captureExtension) * valueMultiply;
+
+      _SCL_ply = 0;
+      SCL_boardUndoMove(board,undo);
+
+      if (_SCL_aborted)
+        break;
+
+      moveScore[m] = value;
+
+      if (value > best)
+      {
+        best = value;
+        bestIndex = m;
+
+        _SCL_pv[0][0][0] = from;
+        _SCL_pv[0][0][1] = to;
+
+        for (uint8_t j = 1; j < _SCL_pvLength[1]; ++j)
+        {
+          _SCL_pv[0][j][0] = _SCL_pv[1][j][0];
+          _SCL_pv[0][j][1] = _SCL_pv[1][j][1];
+        }
+
+        _SCL_pvLength[0] = _SCL_pvLength[1] > 1 ? _SCL_pvLength[1] : 1;
+      }
+    }
+
+    if (_SCL_aborted)
+      break;
+
+    *resultFrom = moveFrom[bestIndex];
+    *resultTo = moveTo[bestIndex];
+    bestScore = best * valueMultiply;
+
+    if (resultDepth != 0)
+      *resultDepth = depth;
+
+    for (uint8_t j = 0; j < _SCL_pvLength[0]; ++j)
+    {
+      _SCL_prevPV[j][0] = _SCL_pv[0][j][0];
+      _SCL_prevPV[j][1] = _SCL_pv[0][j][1];
+    }
+
+    _SCL_prevPVLength = _SCL_pvLength[0];
+
+    if ((maxNodes != 0 && _SCL_nodes >= maxNodes) ||
+      (_SCL_timeFunction != 0 &&
+       _SCL_timeFunction() - _SCL_startTime >= maxTime))
+      break;
+  }
+
+  _SCL_limited = 0;
+
+  return bestScore;
+}
+
 uint8_t SCL_boardToFEN(SCL_Board board, char *string)
 {
   uint8_t square = 56;
@@ -3357,19 +3917,8 @@ uint32_t SCL_boardHash32(const SCL_Board board)
     switch (*b)
     {
 #define C(p,n) case p: result ^= (i + 1) * n; break;
-      // the below number are primes
-      C('P',4003)
-      C('R',84673)
-      C('N',93911)
-      C('B',999331)
-      C('Q',909091)
-      C('K',2796203)
-      C('p',4793)
-      C('r',19391)
-      C('n',391939)
-      C('b',108301)
-      C('q',174763)
-      C('k',2474431)
+      // the numbers are primes
+      SCL_BOARD_HASH32_PRIMES(C)
 #undef C
       default: break;
     }
@@ -3381,6 +3930,53 @@ uint32_t SCL_boardHash32(const SCL_Board board)
   return result;
 }
 
+uint8_t SCL_boardEnPassantColumn(const SCL_Board board)
+{
+  uint8_t column = board[SCL_BOARD_ENPASSANT_CASTLE_BYTE] & 0x0f;
+
+  if (column > 7)
+    return 0x0f;
+
+  uint8_t white = (((uint8_t) board[SCL_BOARD_PLY_BYTE]) % 2) == 0;
+  const char *row = board + (white ? 32 : 24);
+  char capturer = white ? 'P' : 'p';
+
+  if ((column > 0 && row[column - 1] == capturer) ||
+    (column < 7 && row[column + 1] == capturer))
+    return column;
+
+  return 0x0f;
+}
+
+/**
+  Mixes a number into a pseudorandom 64 bit value (splitmix64 finalizer), used
+  to get Zobrist keys without having to store a table of them.
+*/
+static inline uint64_t _SCL_mix64(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+uint64_t SCL_boardHash64(const SCL_Board board)
+{
+  uint64_t result = 0;
+  const char *b = board;
+
+  for (uint8_t i = 0; i < SCL_BOARD_SQUARES; ++i, ++b)
+    if (*b != '.')
+      result ^= _SCL_mix64((((uint64_t) (uint8_t) *b) << 6) | i);
+
+  result ^= _SCL_mix64(0x10000 |
+    ((((uint8_t) board[SCL_BOARD_PLY_BYTE]) % 2) << 12) |
+    (((uint8_t) board[SCL_BOARD_ENPASSANT_CASTLE_BYTE]) & 0xf0) |
+    SCL_boardEnPassantColumn(board));
+
+  return result;
+}
+
 void SCL_boardDisableCastling(SCL_Board board)
 {
   board[SCL_BOARD_ENPASSANT_CASTLE_BYTE] &= 0x0f;
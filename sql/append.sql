@@ -0,0 +1,54 @@
+-- chessgame || text appends a move in SAN or coordinates
+SELECT '1. e4 e5'::chessgame || 'Nf3';
+SELECT '1. e4 e5'::chessgame || 'g1f3';
+SELECT ''::chessgame || 'e4';
+SELECT '1. e4 e5 2. Nf3 Nc6 3. Bc4 Nf6'::chessgame || 'O-O';
+SELECT '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6'::chessgame || 'bxa8=N';
+SELECT '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6'::chessgame || 'b7a8n';
+
+-- the appended game equals the parsed one, whatever the storage
+CREATE TEMP TABLE moves(ply int, move text);
+INSERT INTO moves VALUES (1, 'd4'), (2, 'Nf6'), (3, 'c4'), (4, 'e6'), (5, 'Nc3'),
+  (6, 'Bb4'), (7, 'Qc2'), (8, 'O-O'), (9, 'a3'), (10, 'Bxc3+'), (11, 'Qxc3');
+CREATE TEMP TABLE appended(storage text, interval int, game chessgame);
+CREATE FUNCTION append_all() RETURNS chessgame LANGUAGE plpgsql AS $$
+DECLARE
+  g chessgame := '';
+  m text;
+BEGIN
+  FOR m IN SELECT move FROM moves ORDER BY ply LOOP
+    g := g || m;
+  END LOOP;
+  RETURN g;
+END $$;
+INSERT INTO appended SELECT 'plain', 0, append_all();
+SET chess.checkpoint_interval = 4;
+INSERT INTO appended SELECT 'plain', 4, append_all();
+RESET chess.checkpoint_interval;
+SET chess.storage_format = packed;
+INSERT INTO appended SELECT 'packed', 0, append_all();
+RESET chess.storage_format;
+SELECT storage, interval, game::text,
+       game = '1. d4 Nf6 2. c4 e6 3. Nc3 Bb4 4. Qc2 O-O 5. a3 Bxc3+ 6. Qxc3'::chessgame AS same,
+       getBoard(game, 7)::text = getBoard('1. d4 Nf6 2. c4 e6 3. Nc3 Bb4 4. Qc2 O-O', 7)::text
+         AS same_board
+FROM appended ORDER BY storage, interval;
+
+-- errors
+SELECT '1. e4 e5'::chessgame || 'Ke3';
+SELECT '1. e4 e5'::chessgame || 'xyz';
+SELECT '1. e4 e5 2. Nc3 Nc6'::chessgame || 'Ne2';
+SELECT '1. f3 e5 2. g4 Qh4#'::chessgame || 'e4';
+SELECT '1. e4 e5 1-0'::chessgame || 'Nf3';
+
+-- up to 256 half-moves, as parsed
+CREATE TEMP TABLE long AS
+  SELECT string_agg(format('%s. %s %s', i, CASE WHEN i % 2 = 1 THEN 'Nf3' ELSE 'Ng1' END,
+                           CASE WHEN i % 2 = 1 THEN 'Nf6' ELSE 'Ng8' END), ' ')::chessgame AS game
+  FROM generate_series(1, 126) AS i;
+SELECT max(ply) FROM long, chessgame_positions(game || 'Nf3' || 'Nf6' || 'Ng1' || 'Ng8');
+SELECT (game || 'Nf3' || 'Nf6' || 'Ng1' || 'Ng8')
+       = (game::text || ' 127. Nf3 Nf6 128. Ng1 Ng8')::chessgame AS same
+FROM long;
+SELECT game || 'Nf3' || 'Nf6' || 'Ng1' || 'Ng8' || 'Nf3' FROM long;
+DROP FUNCTION append_all();
@@ -0,0 +1,116 @@
+-- the batched scan of @> and hasBoard() returns the rows of the plain sequential scan
+CREATE TABLE batch_games(id serial, game chessgame);
+INSERT INTO batch_games(game)
+  SELECT ('1. ' || w || ' ' || b || ' 2. ' || w2)::chessgame
+  FROM unnest(ARRAY['a3', 'a4', 'b3', 'b4', 'c3', 'c4', 'd3', 'd4', 'e3', 'e4',
+                    'f3', 'f4', 'g3', 'g4', 'h3', 'h4', 'Na3', 'Nc3', 'Nf3', 'Nh3']) AS w,
+       unnest(ARRAY['a6', 'a5', 'b6', 'b5', 'c6', 'c5', 'd6', 'd5', 'e6', 'e5',
+                    'f6', 'f5', 'g6', 'g5', 'h6', 'h5', 'Na6', 'Nc6', 'Nf6', 'Nh6']) AS b,
+       unnest(ARRAY['Nh3', 'Na3']) AS w2
+  WHERE w NOT IN ('Nh3', 'Na3');
+INSERT INTO batch_games(game) VALUES
+  ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 9. h3 Nb8 10. d4 Nbd7'),
+  ('1. e4 Nf6 2. e5 d5 3. exd6 Qxd6 4. d4 Bf5 5. Nc3 Nc6 6. Be3 O-O-O 7. Qd2 e5'),
+  ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8 6. h4 g5 7. hxg5 Bg7'),
+  ('1. Nf3 Nf6 2. Ng1 Ng8 3. Nf3 Nf6 4. Ng1 Ng8'),
+  (NULL);
+SELECT count(*) FROM batch_games;
+
+CREATE TEMP TABLE queries(board chessboard, halfmoves integer);
+INSERT INTO queries VALUES
+  ('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', 0),
+  ('rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1', 1),
+  ('rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2', 2),
+  ('rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2', 1),
+  ('rnbqkbnr/pppp1ppp/8/4p3/4P3/7N/PPPP1PPP/RNBQKB1R b KQkq - 1 2', 3),
+  ('rnbqkbnr/pppppppp/8/8/8/5N2/PPPPPPPP/RNBQKB1R b KQkq - 1 1', 8),
+  ('4k3/8/8/8/8/8/8/4K3 w - - 0 1', 10),
+  (NULL, 10),
+  ('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', NULL);
+
+SET chess.enable_batch_scan = on;
+EXPLAIN (COSTS OFF)
+SELECT id FROM batch_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+EXPLAIN (COSTS OFF)
+SELECT id FROM batch_games
+WHERE hasBoard(game, 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1', 1) AND id > 10;
+
+CREATE TEMP TABLE batch_on AS
+  SELECT q.board::text AS board, q.halfmoves, 'contains' AS clause, g.id
+  FROM queries q CROSS JOIN LATERAL
+       (SELECT id FROM batch_games WHERE game @> q.board OFFSET 0) g
+  UNION ALL
+  SELECT q.board::text, q.halfmoves, 'hasBoard', g.id
+  FROM queries q CROSS JOIN LATERAL
+       (SELECT id FROM batch_games WHERE hasBoard(game, q.board, q.halfmoves) OFFSET 0) g;
+
+SET chess.enable_batch_scan = off;
+EXPLAIN (COSTS OFF)
+SELECT id FROM batch_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+
+CREATE TEMP TABLE batch_off AS
+  SELECT q.board::text AS board, q.halfmoves, 'contains' AS clause, g.id
+  FROM queries q CROSS JOIN LATERAL
+       (SELECT id FROM batch_games WHERE game @> q.board OFFSET 0) g
+  UNION ALL
+  SELECT q.board::text, q.halfmoves, 'hasBoard', g.id
+  FROM queries q CROSS JOIN LATERAL
+       (SELECT id FROM batch_games WHERE hasBoard(game, q.board, q.halfmoves) OFFSET 0) g;
+
+SELECT board, halfmoves, clause, count(*) FROM batch_off GROUP BY 1, 2, 3 ORDER BY 1, 2, 3;
+(SELECT * FROM batch_on EXCEPT ALL SELECT * FROM batch_off)
+UNION ALL
+(SELECT * FROM batch_off EXCEPT ALL SELECT * FROM batch_on);
+
+-- the parallel variant shares the heap scan among the workers
+SET chess.enable_batch_scan = on;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+EXPLAIN (COSTS OFF)
+SELECT count(*) FROM batch_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+SELECT count(*) FROM batch_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+RESET parallel_setup_cost;
+RESET parallel_tuple_cost;
+RESET min_parallel_table_scan_size;
+RESET max_parallel_workers_per_gather;
+
+-- the clauses of a row security policy are evaluated before those of the
+-- query: a position clause of the query is only batched when no other
+-- clause of the policy comes first
+CREATE FUNCTION batch_leak(id integer) RETURNS boolean AS $$
+BEGIN
+  RAISE NOTICE 'batch_leak(%)', id;
+  RETURN true;
+END;
+$$ LANGUAGE plpgsql COST 0.0001;
+
+CREATE ROLE regress_chess_batch;
+GRANT SELECT ON batch_games TO regress_chess_batch;
+ALTER TABLE batch_games ENABLE ROW LEVEL SECURITY;
+CREATE POLICY batch_even ON batch_games USING (id % 2 = 0);
+SET ROLE regress_chess_batch;
+EXPLAIN (COSTS OFF)
+SELECT id FROM batch_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+SELECT count(*) FROM batch_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+RESET ROLE;
+DROP POLICY batch_even ON batch_games;
+
+CREATE POLICY batch_ruy_lopez ON batch_games
+  USING (game @> 'r1bqkbnr/1ppp1ppp/p1n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 0 4');
+SET ROLE regress_chess_batch;
+EXPLAIN (COSTS OFF)
+SELECT id FROM batch_games WHERE batch_leak(id);
+SELECT id FROM batch_games WHERE batch_leak(id);
+EXPLAIN (COSTS OFF)
+SELECT id FROM batch_games
+WHERE game @> 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1' AND batch_leak(id);
+SELECT id FROM batch_games
+WHERE game @> 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1' AND batch_leak(id);
+RESET ROLE;
+
+DROP TABLE batch_games;
+DROP ROLE regress_chess_batch;
+DROP FUNCTION batch_leak(integer);
+RESET chess.enable_batch_scan;
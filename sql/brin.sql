@@ -0,0 +1,53 @@
+-- the BRIN Bloom filters find the same games as a sequential scan
+CREATE TEMP TABLE moves(ply int, move text);
+INSERT INTO moves
+  SELECT 1, unnest(ARRAY['a3', 'a4', 'b3', 'b4', 'c3', 'c4', 'd3', 'd4', 'e3', 'e4',
+                         'f3', 'f4', 'g3', 'g4', 'h3', 'h4', 'Na3', 'Nc3', 'Nf3', 'Nh3'])
+  UNION ALL
+  SELECT 2, unnest(ARRAY['a6', 'a5', 'b6', 'b5', 'c6', 'c5', 'd6', 'd5', 'e6', 'e5',
+                         'f6', 'f5', 'g6', 'g5', 'h6', 'h5', 'Na6', 'Nc6', 'Nf6', 'Nh6']);
+
+CREATE TABLE brin_games(id serial, game chessgame);
+INSERT INTO brin_games(game)
+  SELECT ('1. ' || w.move || ' ' || b.move || ' 2. Nf3 Nf6')::chessgame
+  FROM moves w, moves b WHERE w.ply = 1 AND b.ply = 2 AND w.move <> 'Nf3' AND b.move <> 'Nf6'
+  ORDER BY w.move, b.move;
+CREATE INDEX brin_games_idx ON brin_games
+  USING brin (game chessgame_bloom_ops(filter_size = 256)) WITH (pages_per_range = 1);
+-- rows added to summarized ranges and summaries of new ranges
+INSERT INTO brin_games(game)
+  SELECT ('1. ' || w.move || ' e5 2. d4 exd4 3. Qxd4')::chessgame
+  FROM moves w WHERE w.ply = 1 AND w.move IN ('a3', 'b3', 'g3', 'h3', 'Na3', 'Nh3');
+SELECT brin_summarize_new_values('brin_games_idx') >= 0 AS summarized;
+
+CREATE TEMP TABLE queries(board chessboard, opening chessgame);
+INSERT INTO queries VALUES
+  ('rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1', '1. e4'),
+  ('r1bqkbnr/pppppppp/2n5/8/3P4/8/PPP1PPPP/RNBQKBNR w KQkq - 1 2', '1. d4 Nc6'),
+  ('rnbqkb1r/pppp1ppp/5n2/4p3/8/4PN2/PPPP1PPP/RNBQKB1R w KQkq - 2 3', '1. Nf3'),
+  ('rnbqkbnr/pppp1ppp/8/8/3Q4/P7/1PP1PPPP/RNB1KBNR b KQkq - 0 3', '1. a3 e5 2. d4 exd4'),
+  ('8/8/8/4k3/8/8/4K3/8 w - - 0 1', '1. e4 e5 2. d4 exd4 3. Qxd4 Nc6'),
+  ('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', '');
+
+CREATE TEMP TABLE seqscan AS
+  SELECT q.board::text AS board, q.opening::text AS opening,
+         (SELECT count(*) FROM brin_games WHERE game @> q.board) AS contains,
+         (SELECT count(*) FROM brin_games WHERE game ^@ q.opening) AS starts
+  FROM queries q;
+
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF)
+  SELECT id FROM brin_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+EXPLAIN (COSTS OFF)
+  SELECT id FROM brin_games WHERE game ^@ '1. e4';
+SELECT s.opening, s.contains, s.starts,
+       (SELECT count(*) FROM brin_games WHERE game @> q.board) AS index_contains,
+       (SELECT count(*) FROM brin_games WHERE game ^@ q.opening) AS index_starts
+FROM queries q JOIN seqscan s ON s.board = q.board::text AND s.opening = q.opening::text
+ORDER BY s.opening;
+RESET enable_seqscan;
+
+-- the options of the filter
+CREATE INDEX ON brin_games USING brin (game chessgame_bloom_ops(filter_size = 16));
+CREATE INDEX ON brin_games USING brin (game chessgame_bloom_ops(filter_size = 100000));
+DROP TABLE brin_games;
@@ -0,0 +1,29 @@
+-- search budget of iterative deepening and of the parallel search
+CREATE TEMP TABLE boards(id int, board chessboard);
+INSERT INTO boards VALUES
+  (1, 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'),
+  (2, 'r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 2 3');
+
+-- a budget too small for the second depth keeps the result of the first one
+SET chess.deterministic_search = on;
+SET chess.search_workers = 0;
+SET chess.search_node_limit = 1;
+SELECT id, chessboard_eval(board, 6), chessboard_bestmove(board, 6) FROM boards ORDER BY id;
+SET chess.search_node_limit = 0;
+SELECT id, chessboard_eval(board, 1), chessboard_bestmove(board, 1) FROM boards ORDER BY id;
+
+-- parallel deterministic searches ignore the node limit
+SET chess.search_workers = 2;
+SET chess.search_node_limit = 1;
+SELECT id, chessboard_eval(board, 3), chessboard_bestmove(board, 3) FROM boards ORDER BY id;
+
+-- otherwise the workers stop taking root moves once it is spent, and play
+-- the best of the searched ones
+SET chess.deterministic_search = off;
+SET chess.tt_size = 0;
+SELECT id, chessboard_bestmove(board, 4) IN ('b1a3', 'b1c3', 'g1f3', 'g1h3', 'a2a3', 'a2a4',
+  'b2b3', 'b2b4', 'c2c3', 'c2c4', 'd2d3', 'd2d4', 'e2e3', 'e2e4', 'f2f3', 'f2f4', 'g2g3',
+  'g2g4', 'h2h3', 'h2h4') AS legal
+FROM boards WHERE id = 1;
+SET chess.search_time_limit = 1;
+SELECT chessboard_bestmove('k7/8/2K5/8/8/8/8/7R w - - 0 1', 8) IS NOT NULL;
@@ -0,0 +1,35 @@
+-- boards stored along the games for getBoard()
+CREATE TEMP TABLE games(id int, game text);
+INSERT INTO games VALUES
+  (1, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 9. h3 Nb8 10. d4 Nbd7 11. c4 c6 12. cxb5 axb5 13. Nc3 Bb7 14. Bg5 b4 1-0'),
+  (2, '1. e4 Nf6 2. e5 d5 3. exd6 Qxd6 4. d4 Bf5 5. Nc3 Nc6 6. Be3 O-O-O 7. Qd2 e5'),
+  (3, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8'),
+  (4, '1. e4'),
+  (5, '');
+
+CREATE TEMP TABLE boards AS
+  SELECT id, ply, getBoard(game::chessgame, ply) AS cb,
+         getBoard(game::chessgame, ply)::text AS board
+  FROM games, generate_series(-1, 30) AS ply;
+
+-- every board equals the one of a replay from the start, whatever the
+-- interval and format
+SET chess.checkpoint_interval = 3;
+SELECT g.id, count(*) FILTER (WHERE getBoard(g.game::chessgame, b.ply)::text = b.board) AS same,
+       count(*) FILTER (WHERE getBoard(chessgame_pack(g.game::chessgame), b.ply)::text = b.board)
+         AS same_packed
+FROM games g JOIN boards b USING (id) GROUP BY g.id ORDER BY g.id;
+SET chess.checkpoint_interval = 1;
+SELECT g.id, count(*) FILTER (WHERE getBoard(g.game::chessgame, b.ply)::text = b.board) AS same
+FROM games g JOIN boards b USING (id) GROUP BY g.id ORDER BY g.id;
+SET chess.checkpoint_interval = 10;
+SELECT g.id, count(*) FILTER (WHERE getBoard(g.game::chessgame, b.ply)::text = b.board) AS same,
+       count(*) FILTER (WHERE hasBoard(g.game::chessgame, b.cb, 30)) AS found
+FROM games g JOIN boards b USING (id) GROUP BY g.id ORDER BY g.id;
+
+-- checkpoints make the games larger
+SELECT id, pg_column_size(game::chessgame) AS size FROM games ORDER BY id;
+RESET chess.checkpoint_interval;
+SELECT id, pg_column_size(game::chessgame) AS size FROM games ORDER BY id;
+
+SELECT id, board FROM boards WHERE ply IN (-1, 0, 1, 30) AND id IN (2, 4) ORDER BY id, ply;
@@ -0,0 +1,16 @@
+-- evaluation of every position of a game
+SET chess.deterministic_search = on;
+SET chess.search_workers = 0;
+SELECT game_eval_curve('1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7#', 2);
+SELECT game_eval_curve('', 2);
+SELECT game_eval_curve('1. e4', 0);
+
+-- the same with workers, which do not depend on the backend for the time
+SET chess.search_workers = 3;
+SELECT game_eval_curve('1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7#', 2);
+SELECT array_length(game_eval_curve('1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7', 3), 1)
+  = 9 AS complete;
+
+SET chess.deterministic_search = off;
+SET chess.search_time_limit = 1;
+SELECT array_length(game_eval_curve('1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7', 8), 1);
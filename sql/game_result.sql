@@ -0,0 +1,35 @@
+--
+-- Game results: game_result(), @@ and the GIN result keys
+--
+
+SELECT game_result('1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7# 1-0');
+SELECT game_result('1. e4 e5 0-1');
+SELECT game_result('1. e4 e5 1/2-1/2');
+SELECT game_result('1. e4 e5 *');
+SELECT game_result('1. e4 e5');
+
+-- the result is kept through output
+SELECT '1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7# 1-0'::chessgame;
+SELECT '1. d4 d5 1/2-1/2'::chessgame;
+
+SELECT '1. e4 e5 0-1'::chessgame @@ '0-1', '1. e4 e5 0-1'::chessgame @@ '1-0';
+
+CREATE TABLE results (id int, g chessgame);
+INSERT INTO results
+SELECT i, ('1. e4 e5 2. Nf3 ' ||
+           (ARRAY['Nc6', 'd6', 'Nf6'])[i % 3 + 1] || ' ' ||
+           (ARRAY['1-0', '0-1', '1/2-1/2', '*'])[i % 4 + 1])::chessgame
+FROM generate_series(1, 200) i;
+
+SELECT game_result(g), count(*) FROM results GROUP BY 1 ORDER BY 1;
+
+CREATE INDEX results_gin ON results USING gin (g);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM results WHERE g @@ '1/2-1/2';
+SELECT count(*) FROM results WHERE g @@ '1/2-1/2';
+SELECT count(*) FROM results WHERE g @@ '*';
+SELECT count(*) FROM results WHERE g @@ '1/2-1/2' AND g @> getBoard('1. e4 e5 2. Nf3 d6', 4);
+RESET enable_seqscan;
+SELECT count(*) FROM results WHERE g @@ '1/2-1/2' AND g @> getBoard('1. e4 e5 2. Nf3 d6', 4);
+
+DROP TABLE results;
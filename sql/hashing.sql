@@ -0,0 +1,63 @@
+-- the hash opclass of games agrees with = whatever the storage format
+INSERT INTO chess_prefixes (moves) VALUES ('1. c4 e5 2. Nc3 Nf6');
+
+CREATE TEMP TABLE games(id int, game chessgame);
+INSERT INTO games VALUES
+  (1, '1. c4 e5 2. Nc3 Nf6 3. g3 d5 4. cxd5 Nxd5'),
+  (2, '1. c4 e5 2. Nc3 Nf6 3. g3 d5 4. cxd5 Nxd5 1-0'),
+  (3, '[Event "Test"] 1. c4 e5 2. Nc3 Nf6 3. g3 d5 4. cxd5 Nxd5'),
+  (4, '1. c4 e5 2. Nc3 Nf6'),
+  (5, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N'),
+  (6, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=Q'),
+  (7, '');
+-- games of the most half-moves a record holds
+INSERT INTO games
+  SELECT 8, string_agg(format('%s. %s %s', i, CASE WHEN i % 2 = 1 THEN 'Nf3' ELSE 'Ng1' END,
+                              CASE WHEN i % 2 = 1 THEN 'Nf6' ELSE 'Ng8' END), ' ')
+  FROM generate_series(1, 128) AS i;
+INSERT INTO games SELECT 9, game || 'Nf3' FROM games WHERE id = 8;
+INSERT INTO games
+  SELECT 10, string_agg(format('%s. %s %s', i, CASE WHEN i % 2 = 1 THEN 'Nc3' ELSE 'Nb1' END,
+                               CASE WHEN i % 2 = 1 THEN 'Nc6' ELSE 'Nb8' END), ' ') || ' 1-0'
+  FROM generate_series(1, 128) AS i;
+SELECT id, (SELECT max(ply) FROM chessgame_positions(game)) AS length FROM games ORDER BY id;
+
+CREATE TEMP TABLE formats AS
+  SELECT id, 'plain' AS format, chessgame_unpack(game) AS game FROM games
+  UNION ALL
+  SELECT id, 'packed', chessgame_pack(game) FROM games
+  UNION ALL
+  SELECT id, 'prefix', chessgame_compress(game) FROM games;
+SELECT id FROM games
+WHERE pg_column_size(chessgame_compress(game)) < pg_column_size(chessgame_unpack(game))
+ORDER BY id;
+SELECT f.format, count(*) FILTER (WHERE f.game = g.game) AS equal,
+       count(*) FILTER (WHERE chessgame_hash(f.game) = chessgame_hash(g.game)) AS same_hash,
+       count(*) FILTER (WHERE chessgame_hash_extended(f.game, 42)
+                              = chessgame_hash_extended(g.game, 42)) AS same_hash_extended
+FROM formats f JOIN games g USING (id) GROUP BY f.format ORDER BY f.format;
+-- the same games hash alike, tags aside, the others hardly ever do
+SELECT a.id, b.id, a.game = b.game AS equal, chessgame_hash(a.game) = chessgame_hash(b.game) AS same_hash
+FROM games a, games b WHERE a.id < b.id
+  AND (a.game = b.game OR chessgame_hash(a.game) = chessgame_hash(b.game))
+ORDER BY 1, 2;
+SELECT count(*) FROM games a, games b
+WHERE a.id < b.id AND chessgame_hash_extended(a.game, 0) = chessgame_hash_extended(b.game, 0)
+  AND NOT a.game = b.game;
+
+-- hash joins, hash aggregation and hash indexes find the equal games
+SET enable_mergejoin = off;
+SET enable_nestloop = off;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM formats f JOIN games g ON f.game = g.game;
+SELECT f.format, count(*) FROM formats f JOIN games g ON f.game = g.game
+GROUP BY f.format ORDER BY f.format;
+RESET enable_mergejoin;
+RESET enable_nestloop;
+SET enable_sort = off;
+SELECT count(*) FROM (SELECT DISTINCT game FROM formats) d;
+RESET enable_sort;
+CREATE INDEX ON formats USING hash (game);
+SET enable_seqscan = off;
+SELECT g.id, (SELECT count(*) FROM formats f WHERE f.game = g.game) AS matches
+FROM games g ORDER BY g.id;
+RESET enable_seqscan;
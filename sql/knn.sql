@@ -0,0 +1,66 @@
+-- chessboard <-> chessboard and the nearest boards through chessboard_gist_ops
+SELECT 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'::chessboard <->
+       'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'::chessboard AS same,
+       'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'::chessboard <->
+       'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1'::chessboard AS moved,
+       'rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2'::chessboard <->
+       'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'::chessboard AS two_moves,
+       'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'::chessboard <->
+       '4k3/8/8/8/8/8/8/4K3 w - - 0 1'::chessboard AS kings;
+
+-- the positions of a few games and openings, enough for the index to split its pages
+CREATE TABLE knn_boards(id serial, board chessboard);
+INSERT INTO knn_boards(board)
+  SELECT p.board
+  FROM (VALUES ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 9. h3 Nb8 10. d4 Nbd7 11. c4 c6 12. cxb5 axb5 13. Nc3 Bb7 14. Bg5 b4 15. Nb1 h6 16. Bh4 c5 17. dxe5 Nxe4 18. Bxe7 Qxe7 19. exd6 Qf6 20. Nbd2 Nxd6 21. Nc4 Nxc4 22. Bxc4 Nb6 23. Ne5 Rae8 24. Bxf7+ Rxf7 25. Nxf7 Rxe1+ 26. Qxe1 Kxf7 27. Qe3 Qg5 28. Qxg5 hxg5 29. b3 Ke6 30. a3 Kd6 31. axb4 cxb4 32. Ra5 Nd5 33. f3 Bc8 34. Kf2 Bf5 35. Ra7 g6 36. Ra6+ Kc5 37. Ke1 Nf4 38. g3 Nxh3 39. Kd2 Kb5 40. Rd6 Kc5 41. Ra6 Nf2 42. g4 Bd3 43. Re6'),
+               ('1. e4 Nf6 2. e5 d5 3. exd6 Qxd6 4. d4 Bf5 5. Nc3 Nc6 6. Be3 O-O-O 7. Qd2 e5'),
+               ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8 6. h4 g5 7. hxg5 Bg7 8. g6 Nf6 9. gxh7 Rf8 10. h8=R Bxh8 11. Rxh8 Rxh8 12. Nxc7+ Kd8'),
+               ('1. d4 Nf6 2. c4 e6 3. Nc3 Bb4 4. Qc2 O-O 5. a3 Bxc3+ 6. Qxc3'),
+               ('1. e4 c5 2. Nf3 d6 3. d4 cxd4 4. Nxd4 Nf6 5. Nc3 a6'),
+               ('1. c4 e5 2. Nc3 Nf6 3. g3 d5 4. cxd5 Nxd5')) AS g(game),
+       chessgame_positions(g.game::chessgame) AS p;
+INSERT INTO knn_boards(board)
+  SELECT getBoard(('1. ' || w || ' ' || b)::chessgame, 2)
+  FROM unnest(ARRAY['a3', 'a4', 'b3', 'b4', 'c3', 'c4', 'd3', 'd4', 'e3', 'e4',
+                    'f3', 'f4', 'g3', 'g4', 'h3', 'h4', 'Na3', 'Nc3', 'Nf3', 'Nh3']) AS w,
+       unnest(ARRAY['a6', 'a5', 'b6', 'b5', 'c6', 'c5', 'd6', 'd5', 'e6', 'e5',
+                    'f6', 'f5', 'g6', 'g5', 'h6', 'h5', 'Na6', 'Nc6', 'Nf6', 'Nh6']) AS b;
+CREATE INDEX ON knn_boards USING gist (board);
+
+CREATE TEMP TABLE queries(query chessboard);
+INSERT INTO queries VALUES
+  ('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'),
+  ('r1bqkb1r/pppp1ppp/2n2n2/4p3/4P3/2N2N2/PPPP1PPP/R1BQKB1R w KQkq - 4 4'),
+  ('8/8/2k5/8/8/8/8/4K3 w - - 0 1'),
+  ('4k3/8/8/8/8/8/8/4K3 w - - 0 1');
+
+-- the distances of the nearest boards, and the boards nearer than the
+-- last one, are those of a sequential scan
+CREATE TEMP TABLE seqscan AS
+  SELECT q.query::text AS query,
+         ARRAY(SELECT board <-> q.query FROM knn_boards ORDER BY board <-> q.query, id LIMIT 25)
+           AS distances
+  FROM queries q;
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+EXPLAIN (COSTS OFF)
+  SELECT id FROM knn_boards
+  ORDER BY board <-> 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1' LIMIT 5;
+SELECT s.query, s.distances,
+       ARRAY(SELECT board <-> q.query FROM knn_boards ORDER BY board <-> q.query LIMIT 25)
+         = s.distances AS same
+FROM queries q JOIN seqscan s ON s.query = q.query::text ORDER BY s.query;
+SELECT q.query::text,
+       (SELECT count(*) FROM (SELECT board <-> q.query AS d FROM knn_boards
+                              ORDER BY board <-> q.query LIMIT 25) n
+        WHERE d < s.distances[25]) = (SELECT count(*) FROM knn_boards
+                                       WHERE board <-> q.query < s.distances[25]) AS nearer
+FROM queries q JOIN seqscan s ON s.query = q.query::text ORDER BY 1;
+SELECT board::text, board <-> 'r1bqkb1r/pppp1ppp/2n2n2/4p3/4P3/2N2N2/PPPP1PPP/R1BQKB1R w KQkq - 4 4' AS d
+FROM (SELECT board FROM knn_boards
+      ORDER BY board <-> 'r1bqkb1r/pppp1ppp/2n2n2/4p3/4P3/2N2N2/PPPP1PPP/R1BQKB1R w KQkq - 4 4'
+      LIMIT 4) n
+ORDER BY d, 1;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+DROP TABLE knn_boards;
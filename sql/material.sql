@@ -0,0 +1,32 @@
+--
+-- Material: reaches_material() (@#) and the GIN material keys
+--
+
+SELECT '1. e4 d5 2. exd5 Qxd5'::chessgame @# 'KQRRBBNNPPPPPPPvKQRRBBNNPPPPPPP',
+       '1. e4 d5 2. exd5'::chessgame @# 'KQRRBBNNPPPPPPPPvKQRRBBNNPPPPPPP',
+       '1. e4 d5 2. exd5'::chessgame @# 'KQRRBBNNPPPPPPPvKQRRBBNNPPPPPPP';
+-- balances can also be written case-sensitively
+SELECT '1. e4 d5 2. exd5 Qxd5'::chessgame @# 'KQRRBBNNPPPPPPPkqrrbbnnppppppp';
+-- promotions change the material
+SELECT '1. a4 h5 2. a5 h4 3. a6 h3 4. axb7 hxg2 5. Ra4 gxh1=N'::chessgame @# 'KQRBBNNPPPPPPPvKQRRBBNNNPPPPPP';
+SELECT '1. e4'::chessgame @# 'KQvK';
+SELECT '1. e4'::chessgame @# 'nonsense';
+
+CREATE TABLE mat (id int, g chessgame);
+INSERT INTO mat
+SELECT i, (ARRAY['1. e4 d5 2. exd5 Qxd5 3. Nc3 Qa5',
+                 '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Bxc6 dxc6',
+                 '1. d4 d5 2. c4 dxc4 3. e4 b5',
+                 '1. e4 e5'])[i % 4 + 1]
+FROM generate_series(1, 400) i;
+
+SELECT count(*) FROM mat WHERE g @# 'KQRRBBNNPPPPPPPvKQRRBBNNPPPPPPP';
+SELECT count(*) FROM mat WHERE g @# 'KQRRBNNPPPPPPPPvKQRRBBNPPPPPPPP';
+CREATE INDEX mat_gin ON mat USING gin (g);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM mat WHERE g @# 'KQRRBBNNPPPPPPPvKQRRBBNNPPPPPPP';
+SELECT count(*) FROM mat WHERE g @# 'KQRRBBNNPPPPPPPvKQRRBBNNPPPPPPP';
+SELECT count(*) FROM mat WHERE g @# 'KQRRBNNPPPPPPPPvKQRRBBNPPPPPPPP';
+RESET enable_seqscan;
+
+DROP TABLE mat;
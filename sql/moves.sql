@@ -0,0 +1,42 @@
+-- move patterns (@!) through chessgame_move_gin_ops, as in a sequential scan
+CREATE TABLE move_games(id serial, game chessgame);
+INSERT INTO move_games(game) VALUES
+  ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 9. h3 Nb8 10. d4 Nbd7 11. c4 c6 12. cxb5 axb5 13. Nc3 Bb7 14. Bg5 b4 15. Nb1 h6 16. Bh4 c5 17. dxe5 Nxe4 18. Bxe7 Qxe7 19. exd6 Qf6 20. Nbd2 Nxd6 21. Nc4 Nxc4 22. Bxc4 Nb6 23. Ne5 Rae8 24. Bxf7+ Rxf7 25. Nxf7 Rxe1+ 26. Qxe1 Kxf7 27. Qe3 Qg5 28. Qxg5 hxg5 29. b3 Ke6 30. a3 Kd6 31. axb4 cxb4 32. Ra5 Nd5 33. f3 Bc8 34. Kf2 Bf5 35. Ra7 g6 36. Ra6+ Kc5 37. Ke1 Nf4 38. g3 Nxh3 39. Kd2 Kb5 40. Rd6 Kc5 41. Ra6 Nf2 42. g4 Bd3 43. Re6 1/2-1/2'),
+  ('1. e4 Nf6 2. e5 d5 3. exd6 Qxd6 4. d4 Bf5 5. Nc3 Nc6 6. Be3 O-O-O 7. Qd2 e5'),
+  ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8 6. h4 g5 7. hxg5 Bg7 8. g6 Nf6 9. gxh7 Rf8 10. h8=R Bxh8 11. Rxh8 Rxh8 12. Nxc7+ Kd8 0-1'),
+  ('1. e4 d5 2. exd5 c6 3. dxc6 e5 4. cxb7 Ke7 5. bxa8=B f6 6. d4 Kf7 7. d5 Ne7 8. d6 Nf5 9. d7 Nd6 10. dxc8=Q Nb5'),
+  ('1. d4 Nf6 2. c4 e6 3. Nc3 Bb4 4. Qc2 O-O 5. a3 Bxc3+ 6. Qxc3'),
+  ('1. f3 e5 2. g4 Qh4# 0-1'),
+  ('1. e4 e5 2. Bc4 Nc6 3. Qh5 Nf6 4. Qxf7# 1-0');
+CREATE TEMP TABLE moves(ply int, move text);
+INSERT INTO moves
+  SELECT 1, unnest(ARRAY['a3', 'a4', 'b3', 'b4', 'c3', 'c4', 'd3', 'd4', 'e3', 'e4',
+                         'f3', 'f4', 'g3', 'g4', 'h3', 'h4', 'Na3', 'Nc3', 'Nf3', 'Nh3'])
+  UNION ALL
+  SELECT 2, unnest(ARRAY['a6', 'a5', 'b6', 'b5', 'c6', 'c5', 'd6', 'd5', 'e6', 'e5',
+                         'f6', 'f5', 'g6', 'g5', 'h6', 'h5', 'Na6', 'Nc6', 'Nf6', 'Nh6']);
+INSERT INTO move_games(game)
+  SELECT ('1. ' || w.move || ' ' || b.move)::chessgame
+  FROM moves w, moves b WHERE w.ply = 1 AND b.ply = 2;
+
+CREATE TEMP TABLE patterns(pattern text);
+INSERT INTO patterns VALUES ('Bxf7+'), ('Q??'), ('*xf7'), ('*x??+'), ('*???#'), ('O-O'),
+  ('O-O-O'), ('bxa8=N'), ('??8=?'), ('??8=Q'), ('N??'), ('Nf3'), ('e4'), ('a?'), ('Kd8'),
+  ('Rxh8'), ('Qh4#'), ('h8=R'), ('Ke2');
+CREATE TEMP TABLE seqscan AS
+  SELECT pattern, (SELECT count(*) FROM move_games WHERE game @! pattern) AS games
+  FROM patterns;
+
+-- the default opclass indexes positions only
+CREATE INDEX move_games_positions ON move_games USING gin (game);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT id FROM move_games WHERE game @! 'Q??';
+DROP INDEX move_games_positions;
+
+CREATE INDEX move_games_moves ON move_games USING gin (game chessgame_move_gin_ops);
+EXPLAIN (COSTS OFF) SELECT id FROM move_games WHERE game @! 'Q??';
+EXPLAIN (COSTS OFF) SELECT id FROM move_games WHERE game @> 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1';
+SELECT s.pattern, s.games,
+       (SELECT count(*) FROM move_games WHERE game @! s.pattern) AS index_games
+FROM seqscan s ORDER BY s.pattern;
+RESET enable_seqscan;
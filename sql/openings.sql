@@ -0,0 +1,33 @@
+-- ECO classification through the opening trie
+SELECT eco_classify('1. e4 e5 2. Nf3 Nc6 3. Bb5');
+
+INSERT INTO chess_openings VALUES
+  ('B00', 'King''s Pawn', '1. e4'),
+  ('C20', 'King''s Pawn Game', '1. e4 e5'),
+  ('C60', 'Ruy Lopez', '1. e4 e5 2. Nf3 Nc6 3. Bb5'),
+  ('C68', 'Ruy Lopez, Exchange', '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Bxc6'),
+  ('A40', 'Queen''s Pawn', '1. d4'),
+  ('D00', 'Queen''s Pawn Game', '1. d4 d5');
+
+-- the longest opening the game starts with
+SELECT g, eco_classify(g::chessgame)
+FROM (VALUES ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Bxc6 dxc6 5. O-O'),
+             ('1. e4 e5 2. Nf3 Nc6 3. Bb5 Nf6'),
+             ('1. e4 e5 2. Nf3'),
+             ('1. e4 c5'),
+             ('1. d4 Nf6'),
+             ('1. c4'),
+             ('')) AS t(g);
+
+-- the trie follows the changes of the table
+UPDATE chess_openings SET eco = 'C65' WHERE eco = 'C60';
+SELECT eco_classify('1. e4 e5 2. Nf3 Nc6 3. Bb5 Nf6');
+DELETE FROM chess_openings WHERE eco = 'C65';
+SELECT eco_classify('1. e4 e5 2. Nf3 Nc6 3. Bb5 Nf6');
+
+-- when several openings have the same moves the first code wins
+INSERT INTO chess_openings VALUES ('A00', 'Duplicate', '1. d4 d5');
+SELECT eco_classify('1. d4 d5 2. c4');
+
+TRUNCATE chess_openings;
+SELECT eco_classify('1. d4 d5 2. c4');
@@ -0,0 +1,72 @@
+-- orderings of games and boards, and the upgrade from 1.0 that adds them
+SELECT extversion FROM pg_extension WHERE extname = 'chess';
+
+-- games by length, then moves and result
+CREATE TEMP TABLE games(id int, game chessgame);
+INSERT INTO games VALUES
+  (1, '1. e4 e5 2. Nf3'), (2, '1. e4 e5 2. Nc3'), (3, '1. e4'), (4, '1. d4'), (5, ''),
+  (6, '1. e4 e5 2. Nf3 1-0'), (7, '1. e4 e5 2. Nf3 0-1'), (8, '1. e4 c5 2. Nf3 d6 3. d4'),
+  (9, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N'),
+  (10, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=Q'), (11, '1. e4 e5 2. Nf3');
+SELECT id, game FROM games ORDER BY game, id;
+SELECT a.id, b.id FROM games a JOIN games b ON a.game = b.game AND a.id < b.id ORDER BY 1, 2;
+SELECT count(*) FROM games a, games b
+WHERE (a.game < b.game) <> (b.game > a.game) OR (a.game <= b.game) = (a.game > b.game)
+   OR (a.game = b.game) <> (a.game <= b.game AND a.game >= b.game);
+-- sorts with abbreviated keys agree with the comparison function and a btree
+-- index, in both storage formats
+CREATE TEMP TABLE many AS
+  SELECT g.id * 100 + i AS id, g.game FROM games g, generate_series(1, 50) i;
+SET chess.storage_format = packed;
+INSERT INTO many SELECT id + 10000, game::text::chessgame FROM many;
+RESET chess.storage_format;
+CREATE TEMP TABLE sorted AS SELECT row_number() OVER (ORDER BY game, id) AS n, id FROM many;
+SELECT count(*) AS unordered
+FROM sorted a JOIN many ga USING (id), sorted b JOIN many gb USING (id)
+WHERE b.n = a.n + 1 AND hasOpening_cmp(ga.game, gb.game) > 0;
+CREATE INDEX ON many (game);
+SET enable_seqscan = off;
+SET enable_bitmapscan = off;
+SELECT count(*) AS differ FROM sorted s
+  JOIN (SELECT row_number() OVER () AS n, id FROM (SELECT id FROM many ORDER BY game, id) o) t
+  USING (n) WHERE s.id <> t.id;
+RESET enable_seqscan;
+RESET enable_bitmapscan;
+-- merge joins on games and on boards
+SET enable_hashjoin = off;
+SET enable_nestloop = off;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM games a JOIN games b ON a.game = b.game;
+SELECT count(*) FROM games a JOIN games b ON a.game = b.game;
+SELECT count(*) FROM games a JOIN games b ON getBoard(a.game, 1) = getBoard(b.game, 1);
+RESET enable_hashjoin;
+RESET enable_nestloop;
+SELECT count(DISTINCT getBoard(game, 2)) FROM games;
+
+-- the update from 1.0 makes the operators of a new install
+CREATE TEMP TABLE operators AS
+  SELECT o.oprname, o.oprleft::regtype::text AS oprleft, o.oprcanmerge, o.oprcanhash,
+         c.oprname AS commutator, n.oprname AS negator
+  FROM pg_operator o LEFT JOIN pg_operator c ON c.oid = o.oprcom
+       LEFT JOIN pg_operator n ON n.oid = o.oprnegate
+  WHERE o.oprleft IN ('chessgame'::regtype, 'chessboard'::regtype) AND o.oprleft = o.oprright
+    AND o.oprname IN ('<', '<=', '=', '>=', '>');
+SELECT * FROM operators ORDER BY 2, 1;
+SET client_min_messages = warning;
+DROP EXTENSION chess CASCADE;
+CREATE EXTENSION chess VERSION '1.0';
+RESET client_min_messages;
+SELECT count(*) FROM pg_opclass WHERE opcname = 'chessboard_ops';
+ALTER EXTENSION chess UPDATE;
+SELECT extversion FROM pg_extension WHERE extname = 'chess';
+CREATE TEMP TABLE updated AS
+  SELECT o.oprname, o.oprleft::regtype::text AS oprleft, o.oprcanmerge, o.oprcanhash,
+         c.oprname AS commutator, n.oprname AS negator
+  FROM pg_operator o LEFT JOIN pg_operator c ON c.oid = o.oprcom
+       LEFT JOIN pg_operator n ON n.oid = o.oprnegate
+  WHERE o.oprleft IN ('chessgame'::regtype, 'chessboard'::regtype) AND o.oprleft = o.oprright
+    AND o.oprname IN ('<', '<=', '=', '>=', '>');
+(SELECT * FROM updated EXCEPT SELECT * FROM operators)
+UNION ALL
+(SELECT * FROM operators EXCEPT SELECT * FROM updated);
+SELECT amproc::regproc FROM pg_amproc p JOIN pg_opfamily f ON f.oid = p.amprocfamily
+WHERE f.opfname IN ('chessgame_hasopening_ops', 'chessboard_ops') ORDER BY amproc::regproc::text;
@@ -0,0 +1,32 @@
+-- packed storage of the moves as legal move indexes
+CREATE TEMP TABLE games(id int, game chessgame);
+INSERT INTO games VALUES
+  (1, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 1/2-1/2'),
+  -- en passant, long castling and promotions to every piece
+  (2, '1. e4 Nf6 2. e5 d5 3. exd6 Qxd6 4. d4 Bf5 5. Nc3 Nc6 6. Be3 O-O-O 7. Qd2 e5'),
+  (3, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8 6. h4 g5 7. hxg5 Bg7 8. g6 Nf6 9. gxh7 Rf8 10. h8=R Bxh8 11. Rxh8 Rxh8 12. Nxc7+ Kd8 0-1'),
+  (4, '1. e4 d5 2. exd5 c6 3. dxc6 e5 4. cxb7 Ke7 5. bxa8=B f6 6. d4 Kf7 7. d5 Ne7 8. d6 Nf5 9. d7 Nd6 10. dxc8=Q Nb5'),
+  (5, '1. d4'),
+  (6, '');
+
+CREATE TEMP TABLE packed AS SELECT id, game, chessgame_pack(game) AS p FROM games;
+
+SELECT id, pg_column_size(p) <= pg_column_size(game) AS not_larger, p = game AS equal,
+       p::text = game::text AS same_text, chessgame_unpack(p)::text = game::text AS unpacked,
+       chessgame_pack(p)::text = game::text AS repacked,
+       getBoard(p, 1000)::text = getBoard(game, 1000)::text AS same_final_board,
+       getFirstMoves(p, 3)::text = getFirstMoves(game, 3)::text AS same_first_moves
+FROM packed ORDER BY id;
+SELECT id, p FROM packed WHERE id IN (2, 3, 4) ORDER BY id;
+
+-- operators read packed games like the others
+SELECT id, hasOpening(p, '1. e4'), p @> getBoard(game, 3), hasBoard(p, getBoard(game, 5), 4)
+FROM packed ORDER BY id;
+
+-- chess.storage_format = packed makes input pack the games
+SET chess.storage_format = packed;
+SELECT id, pg_column_size(g) = pg_column_size(chessgame_pack(g)) AS packed_input,
+       g::text = game::text AS same_text
+FROM (SELECT id, game, game::text::chessgame AS g FROM games) t ORDER BY id;
+SELECT getFirstMoves('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6', 2);
+RESET chess.storage_format;
@@ -0,0 +1,25 @@
+-- root splitting over worker threads
+CREATE TEMP TABLE boards(id int, board chessboard);
+INSERT INTO boards VALUES
+  (1, 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'),
+  (2, 'r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 2 3'),
+  (3, 'k7/8/2K5/8/8/8/8/7R w - - 0 1'),
+  (4, '7k/5Q2/6K1/8/8/8/8/8 b - - 0 1');
+
+-- without the transposition table the thread count does not matter
+SET chess.deterministic_search = on;
+SET chess.search_workers = 0;
+CREATE TEMP TABLE serial AS
+  SELECT id, chessboard_eval(board, 3) AS eval, chessboard_bestmove(board, 3) AS move
+  FROM boards;
+SET chess.search_workers = 3;
+SELECT b.id, s.eval, s.move,
+       chessboard_eval(b.board, 3) = s.eval AS same_eval,
+       chessboard_bestmove(b.board, 3) IS NOT DISTINCT FROM s.move AS same_move
+FROM boards b JOIN serial s USING (id) ORDER BY id;
+
+-- the workers are stopped and joined when the statement is cancelled
+SET statement_timeout = '100ms';
+SELECT chessboard_eval('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', 8);
+RESET statement_timeout;
+SELECT chessboard_bestmove('k7/8/2K5/8/8/8/8/7R w - - 0 1', 3);
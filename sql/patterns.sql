@@ -0,0 +1,40 @@
+--
+-- Patterns: chesspattern, @> on boards and games, and the GiST opclass
+--
+
+SELECT 'Ne5 kg8 .f7'::chesspattern;
+SELECT 'xe5'::chesspattern;
+
+SELECT getBoard('1. e4 e5 2. Nf3', 3) @> 'Nf3 pe5 Pe4'::chesspattern,
+       getBoard('1. e4 e5 2. Nf3', 3) @> 'Nf3 .g1'::chesspattern,
+       getBoard('1. e4 e5 2. Nf3', 3) @> 'Ng1'::chesspattern;
+-- an untyped literal on the right of @> is still a board
+SELECT '1. e4'::chessgame @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1';
+
+SELECT '1. e4 e5 2. Nf3 Nc6 3. Bb5'::chessgame @> 'Bb5 nc6'::chesspattern,
+       '1. e4 e5 2. Nf3 Nc6 3. Bb5'::chessgame @> 'Bb5 .c6'::chesspattern;
+
+-- enough games for the index to split its pages
+CREATE TABLE pat (id int, g chessgame);
+INSERT INTO pat
+SELECT i, (ARRAY['1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O',
+                 '1. d4 Nf6 2. c4 g6 3. Nc3 Bg7 4. e4 d6',
+                 '1. e4 c5 2. Nf3 d6 3. d4 cxd4 4. Nxd4 Nf6 5. Nc3 a6',
+                 '1. c4 e5 2. Nc3 Nf6 3. g3 d5 4. cxd5 Nxd5',
+                 '1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7'])[i % 5 + 1] ||
+          (ARRAY['', ' h6', ' h5', ' a5'])[i % 4 + 1]
+FROM generate_series(1, 2000) i;
+
+SELECT count(*) FROM pat WHERE g @> 'Bb5 nc6'::chesspattern;
+SELECT count(*) FROM pat WHERE g @> 'bg7 Pe4 Ph2'::chesspattern;
+SELECT count(*) FROM pat WHERE g @> 'ph5'::chesspattern;
+
+CREATE INDEX pat_gist ON pat USING gist (g);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM pat WHERE g @> 'Bb5 nc6'::chesspattern;
+SELECT count(*) FROM pat WHERE g @> 'Bb5 nc6'::chesspattern;
+SELECT count(*) FROM pat WHERE g @> 'bg7 Pe4 Ph2'::chesspattern;
+SELECT count(*) FROM pat WHERE g @> 'ph5'::chesspattern;
+RESET enable_seqscan;
+
+DROP TABLE pat;
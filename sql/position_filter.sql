@@ -0,0 +1,55 @@
+-- the Bloom filter of positions is off by default
+SHOW chess.position_filter;
+
+CREATE TEMP TABLE games(id int, game text);
+INSERT INTO games VALUES
+  (1, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 1-0'),
+  (2, '1. d4 d5 2. c4 e6 3. Nc3 Nf6 4. Bg5 Be7 5. e3 O-O 6. Nf3 Nbd7'),
+  (3, '1. e4 c5 2. Nf3 d6 3. d4 cxd4 4. Nxd4 Nf6 5. Nc3 a6'),
+  (4, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8'),
+  (5, '');
+
+CREATE TEMP TABLE boards AS
+  SELECT DISTINCT getBoard(game::chessgame, ply) AS cb
+  FROM games, generate_series(0, 20) AS ply;
+INSERT INTO boards VALUES
+  ('rnbqkbnr/pppppppp/8/8/8/5P2/PPPPP1PP/RNBQKBNR b KQkq - 0 1'),
+  ('8/8/8/4k3/8/8/4K3/8 w - - 0 1');
+
+CREATE TEMP TABLE sizes AS
+  SELECT id, pg_column_size(game::chessgame) AS size FROM games;
+CREATE TEMP TABLE without_filter AS
+  SELECT b.cb::text AS board, g.id, g.game::chessgame @> b.cb AS contains,
+         hasBoard(g.game::chessgame, b.cb, 6) AS within
+  FROM games g, boards b;
+SELECT count(*), count(*) FILTER (WHERE contains) AS contains,
+       count(*) FILTER (WHERE within) AS within
+FROM without_filter;
+
+-- the filter only skips replays, @> and hasBoard() find the same boards
+SET chess.position_filter = on;
+SELECT id, pg_column_size(game::chessgame) - size AS filter_bytes
+FROM games JOIN sizes USING (id) ORDER BY id;
+SELECT count(*) AS differ
+FROM games g, boards b, without_filter w
+WHERE w.board = b.cb::text AND w.id = g.id
+  AND (g.game::chessgame @> b.cb IS DISTINCT FROM w.contains
+       OR hasBoard(g.game::chessgame, b.cb, 6) IS DISTINCT FROM w.within);
+-- also on games stored in the other formats
+SET chess.storage_format = packed;
+SELECT count(*) AS differ
+FROM games g, boards b, without_filter w
+WHERE w.board = b.cb::text AND w.id = g.id
+  AND g.game::chessgame @> b.cb IS DISTINCT FROM w.contains;
+RESET chess.storage_format;
+
+-- games parsed with the filter keep it after the setting is turned off
+CREATE TEMP TABLE filtered AS SELECT id, game::chessgame AS game FROM games;
+RESET chess.position_filter;
+SELECT count(*) AS differ
+FROM filtered g, boards b, without_filter w
+WHERE w.board = b.cb::text AND w.id = g.id
+  AND g.game @> b.cb IS DISTINCT FROM w.contains;
+SELECT count(*) AS differ
+FROM filtered f JOIN games g USING (id)
+WHERE NOT f.game = g.game::chessgame OR f.game::text <> g.game::chessgame::text;
@@ -0,0 +1,44 @@
+--
+-- Materialized positions: chessgame_positions() and the chess_positions table
+--
+
+SELECT ply, board FROM chessgame_positions('1. e4 e5 2. Nf3');
+SELECT count(*) FROM chessgame_positions('1. e4 e5 2. Nf3') p
+WHERE p.board_hash = chessboard_hash(p.board);
+
+CREATE TABLE pgames (id int, g chessgame);
+INSERT INTO pgames VALUES (1, '1. e4 e5 2. Nf3 Nc6'), (2, '1. d4 d5'), (3, '1. Nf3 Nc6 2. e4 e5');
+SELECT chess_materialize_positions('pgames', 'g');
+
+-- lookups agree with @>
+CREATE FUNCTION stored_lookup(b chessboard) RETURNS SETOF int AS $$
+  SELECT DISTINCT t.id FROM chess_positions p JOIN pgames t ON t.ctid = p.game_tid
+  WHERE p.game_rel = 'pgames'::regclass AND p.board_hash = chessboard_hash(b) AND p.board = b
+  ORDER BY 1
+$$ LANGUAGE sql;
+SELECT stored_lookup(getBoard('1. e4 e5 2. Nf3 Nc6', 4));
+SELECT id FROM pgames WHERE g @> getBoard('1. e4 e5 2. Nf3 Nc6', 4) ORDER BY 1;
+
+-- the triggers follow the table
+INSERT INTO pgames VALUES (4, '1. e4 e5 2. Nf3 Nc6 3. Bb5');
+UPDATE pgames SET g = '1. c4' WHERE id = 1;
+DELETE FROM pgames WHERE id = 3;
+SELECT stored_lookup(getBoard('1. e4 e5 2. Nf3 Nc6', 4));
+SELECT count(*) FROM chess_positions WHERE game_rel = 'pgames'::regclass;
+SELECT count(*) FROM pgames, chessgame_positions(g);
+
+TRUNCATE pgames;
+SELECT count(*) FROM chess_positions WHERE game_rel = 'pgames'::regclass;
+
+INSERT INTO pgames VALUES (1, '1. e4');
+SELECT chess_refresh_positions('pgames', 'g');
+SELECT chess_dematerialize_positions('pgames');
+SELECT count(*) FROM chess_positions;
+SELECT tgname FROM pg_trigger WHERE tgrelid = 'pgames'::regclass;
+
+-- the stored positions are dumped with the extension
+SELECT extconfig::regclass[] @> ARRAY['chess_positions'::regclass]
+FROM pg_extension WHERE extname = 'chess';
+
+DROP FUNCTION stored_lookup(chessboard);
+DROP TABLE pgames;
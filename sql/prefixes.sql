@@ -0,0 +1,53 @@
+-- games referring to shared first moves of chess_prefixes
+INSERT INTO chess_prefixes (moves) VALUES
+  ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6'),
+  ('1. e4 e5 2. Nf3 Nc6'),
+  ('1. d4');
+
+CREATE TEMP TABLE games(id int, game chessgame);
+INSERT INTO games VALUES
+  (1, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 1-0'),
+  (2, '1. e4 e5 2. Nf3 Nc6 3. Bc4 Bc5'),
+  (3, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6'),
+  (4, '1. d4 d5 2. c4'),
+  (5, '');
+
+-- input stores all the moves, whatever the table holds: it is not a format
+-- of chess.storage_format
+SELECT id, pg_column_size(g) = pg_column_size(chessgame_unpack(g)) AS plain
+FROM (SELECT id, game::text::chessgame AS g FROM games) t ORDER BY id;
+SET chess.storage_format = prefix;
+
+-- round trips between the formats keep the game
+CREATE TEMP TABLE compressed AS
+  SELECT id, game, chessgame_compress(game) AS c FROM games;
+SELECT id, pg_column_size(c) < pg_column_size(game) AS smaller, c = game AS equal,
+       c::text = game::text AS same_text,
+       chessgame_unpack(c)::text = game::text AS unpacked,
+       chessgame_pack(c)::text = game::text AS packed,
+       chessgame_compress(chessgame_pack(game))::text = game::text AS from_packed,
+       getBoard(c, 5)::text = getBoard(game, 5)::text AS same_board
+FROM compressed ORDER BY id;
+SELECT id, c FROM compressed ORDER BY id;
+
+-- a new backend loads the table when a comparator or the output function
+-- first decodes a game
+CREATE TABLE prefixed AS SELECT id, c FROM compressed;
+\c
+CREATE INDEX ON prefixed (c);
+SELECT id FROM prefixed ORDER BY c, id;
+COPY (SELECT c FROM prefixed ORDER BY id) TO STDOUT;
+
+-- the rows games refer to cannot change
+UPDATE chess_prefixes SET moves = '1. c4' WHERE id = 3;
+DELETE FROM chess_prefixes;
+TRUNCATE chess_prefixes;
+
+-- unless the triggers are bypassed, which corrupts the games
+ALTER TABLE chess_prefixes DISABLE TRIGGER chess_prefixes_frozen;
+DELETE FROM chess_prefixes WHERE moves = '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6';
+ALTER TABLE chess_prefixes ENABLE TRIGGER chess_prefixes_frozen;
+\c
+SELECT c::text FROM prefixed WHERE id = 4;
+SELECT c::text FROM prefixed WHERE id = 1;
+DROP TABLE prefixed;
@@ -0,0 +1,37 @@
+-- engine searches backed by the transposition table
+SET chess.search_workers = 0;
+
+-- mate in one, scored as a mate one ply away
+SELECT chessboard_eval('6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1', 3),
+       chessboard_bestmove('6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1', 3);
+SELECT chessboard_eval('6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1', 1);
+
+-- no legal move
+SELECT chessboard_eval('R5k1/5ppp/8/8/8/8/8/6K1 b - - 1 1', 3),
+       chessboard_bestmove('R5k1/5ppp/8/8/8/8/8/6K1 b - - 1 1', 3);
+SELECT chessboard_eval('7k/5Q2/6K1/8/8/8/8/8 b - - 0 1', 3),
+       chessboard_bestmove('7k/5Q2/6K1/8/8/8/8/8 b - - 0 1', 3);
+
+SELECT chessboard_bestmove('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', 0);
+SELECT chessboard_bestmove('rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1', 9);
+
+-- results found through the table from another root equal the ones of a
+-- search without it, mates included
+CREATE TEMP TABLE roots(id int, parent chessboard, child chessboard);
+INSERT INTO roots VALUES
+  (1, '1k6/8/2K5/8/8/8/8/7R b - - 0 1', 'k7/8/2K5/8/8/8/8/7R w - - 1 2'),
+  (2, 'r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 2 3',
+      'r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR b KQkq - 2 3');
+
+SET chess.deterministic_search = on;
+CREATE TEMP TABLE plain AS
+  SELECT id, chessboard_eval(child, 3) AS eval, chessboard_bestmove(child, 3) AS move
+  FROM roots;
+
+SET chess.deterministic_search = off;
+SET chess.tt_size = 0;
+SET chess.tt_size = 1024;
+SELECT id, chessboard_eval(parent, 4) FROM roots ORDER BY id;
+SELECT r.id, p.eval, chessboard_eval(r.child, 3) = p.eval AS same_eval,
+       chessboard_bestmove(r.child, 3) = p.move AS same_move
+FROM roots r JOIN plain p USING (id) ORDER BY id;
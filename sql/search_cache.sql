@@ -0,0 +1,48 @@
+-- searches through the shared cache (when chess is preloaded), which only
+-- keeps the results of deterministic searches: repeating a search, from the
+-- cache or not, gives the same result
+CREATE TEMP TABLE boards(id int, board chessboard);
+INSERT INTO boards VALUES
+  (1, 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'),
+  (2, 'r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 2 3'),
+  (3, 'k7/8/2K5/8/8/8/8/7R w - - 0 1');
+
+SET chess.deterministic_search = on;
+SET chess.search_workers = 0;
+CREATE TEMP TABLE first AS
+  SELECT id, chessboard_eval(board, 3) AS eval, chessboard_bestmove(board, 3) AS move
+  FROM boards;
+SELECT f.id, f.eval, f.move,
+       chessboard_eval(b.board, 3) = f.eval AS same_eval,
+       chessboard_bestmove(b.board, 3) = f.move AS same_move
+FROM boards b JOIN first f USING (id) ORDER BY id;
+
+SET chess.search_workers = 2;
+SELECT f.id, chessboard_eval(b.board, 3) = f.eval AS same_eval
+FROM boards b JOIN first f USING (id) ORDER BY id;
+
+SET chess.search_workers = 0;
+SELECT game_eval_curve('1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7#', 2);
+SELECT game_eval_curve('1. e4 e5 2. Qh5 Nc6 3. Bc4 Nf6 4. Qxf7#', 2);
+
+-- a search of the table does not fill the cache of deterministic ones
+SET chess.deterministic_search = off;
+SET chess.tt_size = 64;
+SELECT chessboard_eval('r1bqkbnr/pppp1ppp/2n5/4p3/2B1P3/5Q2/PPPP1PPP/RNB1K1NR w KQkq - 2 3', 3)
+  IS NOT NULL AS searched;
+SET chess.deterministic_search = on;
+SELECT chessboard_eval(board, 3) = eval AS same_eval FROM boards JOIN first USING (id)
+WHERE id = 2;
+
+-- boards of games through the cache agree with a replay of the game,
+-- whatever the storage format and the games sharing first moves
+CREATE TEMP TABLE games(id int, game chessgame);
+INSERT INTO games VALUES
+  (1, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 1-0'), (2, '1. e4 e5 2. Nf3 Nc6 3. Bc4'),
+  (3, '1. d4 d5 2. c4 e6 3. Nc3 Nf6');
+SET chess.storage_format = packed;
+INSERT INTO games SELECT id + 10, game::text::chessgame FROM games;
+RESET chess.storage_format;
+SELECT count(*) AS differ
+FROM games g, generate_series(1, 2) pass, chessgame_positions(g.game) p
+WHERE getBoard(g.game, p.ply)::text <> p.board::text;
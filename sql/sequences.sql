@@ -0,0 +1,53 @@
+-- move sequences (~>, ~>>) through chessgame_move_gin_ops, as in a
+-- sequential scan
+CREATE TABLE seq_games(id serial, game chessgame);
+INSERT INTO seq_games(game) VALUES
+  ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 9. h3 Nb8 10. d4 Nbd7 11. c4 c6 12. cxb5 axb5 13. Nc3 Bb7 14. Bg5 b4 15. Nb1 h6 16. Bh4 c5 17. dxe5 Nxe4 18. Bxe7 Qxe7 19. exd6 Qf6 20. Nbd2 Nxd6 21. Nc4 Nxc4 22. Bxc4 Nb6 23. Ne5 Rae8 24. Bxf7+ Rxf7 25. Nxf7 Rxe1+ 26. Qxe1 Kxf7 27. Qe3 Qg5 28. Qxg5 hxg5 29. b3 Ke6 30. a3 Kd6 31. axb4 cxb4 32. Ra5 Nd5 33. f3 Bc8 34. Kf2 Bf5 35. Ra7 g6 36. Ra6+ Kc5 37. Ke1 Nf4 38. g3 Nxh3 39. Kd2 Kb5 40. Rd6 Kc5 41. Ra6 Nf2 42. g4 Bd3 43. Re6 1/2-1/2'),
+  ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 6. Re1 b5 7. Bb3 d6 8. c3 O-O 1-0'),
+  ('1. Nf3 Nf6 2. e4 e5 3. Nc3 Nc6'),
+  ('1. e4 Nf6 2. e5 d5 3. exd6 Qxd6 4. d4 Bf5 5. Nc3 Nc6 6. Be3 O-O-O 7. Qd2 e5'),
+  ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N Qb8 6. h4 g5 7. hxg5 Bg7 8. g6 Nf6 9. gxh7 Rf8 10. h8=R Bxh8 11. Rxh8 Rxh8 12. Nxc7+ Kd8 0-1'),
+  ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=Q Qb8'),
+  ('1. d4 Nf6 2. c4 e6 3. Nc3 Bb4 4. Qc2 O-O 5. a3 Bxc3+ 6. Qxc3'),
+  ('1. e4 e5 2. Bc4 Nc6 3. Qh5 Nf6 4. Qxf7# 1-0'),
+  ('');
+INSERT INTO seq_games(game)
+  SELECT ('1. ' || w || ' ' || b || ' 2. Nf3 Nf6 3. Ng1 Ng8')::chessgame
+  FROM unnest(ARRAY['a3', 'b3', 'c3', 'd3', 'e3', 'f3', 'g3', 'h3']) AS w,
+       unnest(ARRAY['a6', 'b6', 'c6', 'd6', 'e6', 'f6', 'g6', 'h6']) AS b;
+
+CREATE TEMP TABLE sequences(sequence chessgame);
+INSERT INTO sequences VALUES ('1. e4'), ('1. Nf3'), ('1. Nf3 Nf6'), ('1. e4 e5 2. Nf3'),
+  ('1. e4 e5 2. Nf3 Nc6 3. Bb5 a6'), ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N'),
+  ('1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=Q'), ('1. Nf3 Nf6 2. Ng1 Ng8'),
+  ('1. d4 d5'), ('');
+CREATE TEMP TABLE coordinates(moves text);
+INSERT INTO coordinates VALUES ('g1f3'), ('b7a8n'), ('b7a8q'), ('f1b5 a7a6 b5a4'),
+  ('c4f7 f8f7 e5f7'), ('c2c4 e7e6 b1c3 f8b4'), ('h5f7'), ('d2d4 d7d5'), ('');
+
+CREATE TEMP TABLE seqscan AS
+  SELECT '~>' AS op, sequence::text AS query,
+         (SELECT count(*) FROM seq_games WHERE game ~> sequence) AS games
+  FROM sequences
+  UNION ALL
+  SELECT '~>>', moves, (SELECT count(*) FROM seq_games WHERE game ~>> moves) FROM coordinates;
+
+CREATE INDEX ON seq_games USING gin (game chessgame_move_gin_ops);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT id FROM seq_games WHERE game ~> '1. Nf3 Nf6 2. Ng1 Ng8';
+EXPLAIN (COSTS OFF) SELECT id FROM seq_games WHERE game ~>> 'c4f7 f8f7 e5f7';
+SELECT s.query, s.games,
+       (SELECT count(*) FROM seq_games WHERE game ~> q.sequence) AS index_games
+FROM sequences q JOIN seqscan s ON s.op = '~>' AND s.query = q.sequence::text ORDER BY s.query;
+SELECT s.query, s.games,
+       (SELECT count(*) FROM seq_games WHERE game ~>> q.moves) AS index_games
+FROM coordinates q JOIN seqscan s ON s.op = '~>>' AND s.query = q.moves ORDER BY s.query;
+RESET enable_seqscan;
+
+-- openings compare the promotion piece as well as the squares
+SELECT id, hasOpening(game, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N') AS knight,
+       hasOpening(game, '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=Q') AS queen,
+       game ^@ '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=N' AS starts_knight,
+       game ^@ '1. a4 b5 2. axb5 a6 3. bxa6 Bb7 4. axb7 Nc6 5. bxa8=Q' AS starts_queen
+FROM seq_games WHERE id IN (5, 6) ORDER BY id;
+DROP TABLE seq_games;
@@ -0,0 +1,36 @@
+--
+-- PGN header tags: pgn_tags(), chess.store_tags, game_tags() and game_tag()
+--
+
+SELECT pgn_tags('[Event "Casual"] [White "Anderssen, A."] [WhiteElo "2600"] [MyTag "x \"y\""] 1. e4 e5');
+SELECT pgn_tags('1. e4 e5');
+
+-- tags are dropped by default
+SELECT game_tags('[Event "Casual"] 1. e4 e5'::text::chessgame);
+
+SET chess.store_tags = on;
+CREATE TABLE tagged (g chessgame);
+INSERT INTO tagged VALUES
+  ('[Event "London"] [White "Anderssen"] [Black "Kieseritzky"] [Result "1-0"] [Custom "abc"] 1. e4 e5 2. f4 exf4 1-0'),
+  ('[Event "Paris"] [WhiteElo "2700"] 1. d4 d5 1/2-1/2'),
+  ('1. c4 e5');
+SELECT game_tags(g) FROM tagged;
+SELECT game_tag(g, 'Event'), game_tag(g, 'WhiteElo'), game_tag(g, 'Custom') FROM tagged;
+-- output writes the tags back as a PGN header, so they survive a dump
+SELECT g FROM tagged;
+SELECT g::text::chessgame = g, game_tags(g::text::chessgame) = game_tags(g) FROM tagged;
+
+-- values are truncated to 255 bytes without splitting a character
+SELECT octet_length(game_tag(('[Event "' || repeat('é', 200) || '"] 1. e4')::text::chessgame, 'Event')),
+       length(game_tag(('[Event "' || repeat('é', 200) || '"] 1. e4')::text::chessgame, 'Event'));
+SELECT octet_length(game_tag(('[Event "x' || repeat('é', 200) || '"] 1. e4')::text::chessgame, 'Event'));
+
+-- input depends on the setting, so it is not immutable
+SELECT provolatile FROM pg_proc WHERE oid = 'chessgame_in'::regproc;
+SELECT provolatile FROM pg_proc WHERE oid = 'chessgame(text)'::regprocedure;
+CREATE INDEX ON tagged (chessgame(g::text));
+
+RESET chess.store_tags;
+SELECT game_tags(g::text::chessgame) FROM tagged;
+
+DROP TABLE tagged;
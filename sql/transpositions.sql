@@ -0,0 +1,43 @@
+--
+-- Transpositions: chessboard_position_key() and @~
+--
+
+-- the same position by two move orders, with different move clocks
+SELECT getBoard('1. e4 e5 2. Nf3 Nc6', 4) = getBoard('1. Nf3 Nc6 2. e4 e5', 4);
+SELECT chessboard_position_key(getBoard('1. e4 e5 2. Nf3 Nc6', 4)) =
+       chessboard_position_key(getBoard('1. Nf3 Nc6 2. e4 e5', 4));
+SELECT chessboard_position_key('rnbqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3') =
+       chessboard_position_key('rnbqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 9');
+-- the player to move and castling rights count
+SELECT chessboard_position_key('rnbqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3') =
+       chessboard_position_key('rnbqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R b KQkq - 2 3');
+SELECT chessboard_position_key('rnbqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3') =
+       chessboard_position_key('rnbqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w Kkq - 2 3');
+-- an en passant square only counts when the capture is possible
+SELECT chessboard_position_key('rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2') =
+       chessboard_position_key('rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq - 0 2');
+SELECT chessboard_position_key('rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3') =
+       chessboard_position_key('rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq - 0 3');
+
+SELECT '1. e4 e5 2. Nf3 Nc6'::chessgame @~ getBoard('1. Nf3 Nc6 2. e4 e5', 4),
+       '1. e4 e5 2. Nf3 Nc6'::chessgame @> getBoard('1. Nf3 Nc6 2. e4 e5', 4);
+SELECT '1. e4 e5 2. Nf3 Nc6'::chessgame @~ getBoard('1. Nf3 Nc6 2. e4 e5', 3);
+
+CREATE TABLE transp (id int, g chessgame);
+INSERT INTO transp
+SELECT i, (ARRAY['1. e4 e5 2. Nf3 Nc6 3. Bb5',
+                 '1. Nf3 Nc6 2. e4 e5 3. Bc4',
+                 '1. e4 Nc6 2. Nf3 e5 3. d4',
+                 '1. d4 d5 2. c4 e6'])[i % 4 + 1]
+FROM generate_series(1, 100) i;
+
+SELECT count(*) FROM transp WHERE g @~ getBoard('1. e4 e5 2. Nf3 Nc6', 4);
+CREATE INDEX transp_gin ON transp USING gin (g);
+SET enable_seqscan = off;
+EXPLAIN (COSTS OFF) SELECT count(*) FROM transp WHERE g @~ getBoard('1. e4 e5 2. Nf3 Nc6', 4);
+SELECT count(*) FROM transp WHERE g @~ getBoard('1. e4 e5 2. Nf3 Nc6', 4);
+SELECT count(*) FROM transp WHERE g @> getBoard('1. e4 e5 2. Nf3 Nc6', 4);
+SELECT count(*) FROM transp WHERE g @~ getBoard('1. d4 d5 2. c4', 3);
+RESET enable_seqscan;
+
+DROP TABLE transp;
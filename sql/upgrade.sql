@@ -0,0 +1,55 @@
+-- the update from 1.0, whose chessgame is a whole record of fixed size, and
+-- the conversion of its columns
+SET client_min_messages = warning;
+DROP EXTENSION chess CASCADE;
+CREATE EXTENSION chess VERSION '1.0';
+RESET client_min_messages;
+CREATE TABLE old_games(id int, game chessgame, board chessboard);
+INSERT INTO old_games VALUES
+  (1, '1. e4 e5 2. Nf3 Nc6 3. Bb5 a6', 'r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3'),
+  (2, '1. e4 c5 2. Nf3 d6 3. d4 cxd4', 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1'),
+  (3, '1. f3 e5 2. g4 Qh4# 0-1', 'rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1'),
+  (4, '', 'rnbqkbnr/pppppppp/8/8/3P4/8/PPP1PPPP/RNBQKBNR b KQkq d3 0 1');
+
+-- the functions of 1.0 keep working with this library
+SELECT id, game, getBoard(game, 1), getFirstMoves(game, 2) FROM old_games ORDER BY id;
+SELECT id, game @> board AS contains, hasOpening(game, '1. e4') AS e4 FROM old_games ORDER BY id;
+-- 1.0 orders games by length only
+SELECT a.id, b.id FROM old_games a JOIN old_games b ON a.game = b.game AND a.id < b.id ORDER BY 1, 2;
+-- neither the batched scan nor the index of 1.1 read its games
+EXPLAIN (COSTS OFF) SELECT id FROM old_games WHERE game @> board;
+CREATE INDEX old_games_game_idx ON old_games USING gin (game);
+SET enable_seqscan = off;
+SELECT id FROM old_games
+WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1'::chessboard ORDER BY id;
+RESET enable_seqscan;
+
+-- objects of 1.0 the update drops, e.g. its opclasses, cannot be in use
+\set VERBOSITY terse
+ALTER EXTENSION chess UPDATE;
+\set VERBOSITY default
+DROP INDEX old_games_game_idx;
+ALTER EXTENSION chess UPDATE;
+SELECT extversion FROM pg_extension WHERE extname = 'chess';
+
+-- the columns keep the types of 1.0 until converted
+SELECT attname, atttypid::regtype FROM pg_attribute
+WHERE attrelid = 'old_games'::regclass AND attnum > 1 ORDER BY attnum;
+SELECT id, game, board FROM old_games ORDER BY id;
+ALTER TABLE old_games ALTER COLUMN game TYPE chessgame, ALTER COLUMN board TYPE chessboard;
+SELECT attname, atttypid::regtype FROM pg_attribute
+WHERE attrelid = 'old_games'::regclass AND attnum > 1 ORDER BY attnum;
+SELECT id, game, game_result(game), board, game @> board AS contains FROM old_games ORDER BY id;
+SELECT a.id, b.id FROM old_games a JOIN old_games b ON a.game = b.game AND a.id < b.id ORDER BY 1, 2;
+CREATE INDEX ON old_games USING gin (game);
+SET enable_seqscan = off;
+SELECT id FROM old_games
+WHERE game @> 'rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1' ORDER BY id;
+RESET enable_seqscan;
+
+-- a new install for the other tests
+DROP TABLE old_games;
+SET client_min_messages = warning;
+DROP EXTENSION chess CASCADE;
+CREATE EXTENSION chess;
+RESET client_min_messages;